@@ -14,15 +14,33 @@ extern const struct stab __STAB_BEGIN__[];  // beginning of stabs table
 extern const struct stab __STAB_END__[];    // end of stabs table
 extern const char __STABSTR_BEGIN__[];      // beginning of string table
 extern const char __STABSTR_END__[];        // end of string table
+extern const char __KSYMTAB_BEGIN__[];      // function table made by tools/ksymtab.c
+extern const char __KSYMTAB_END__[];
 
-/* debug information about a particular instruction pointer */
-struct eipdebuginfo {
-    const char *eip_file;                   // source code filename for eip
-    int eip_line;                           // source code line number for eip
-    const char *eip_fn_name;                // name of function containing eip
-    int eip_fn_namelen;                     // length of function's name
-    uintptr_t eip_fn_addr;                  // start address of function
-    int eip_fn_narg;                        // number of function arguments
+#define KSYMTAB_MAGIC   0x4d59534b          // "KSYM"
+
+/* *
+ * The function table is built from .stab after a first link and placed in
+ * .ksymtab by the second one (see the kernel rule in the Makefile). It holds
+ * one entry per function sorted by address, so finding the function is a
+ * plain binary search; only the line number and file name are read from
+ * .stab, within the entry's range. Keep in sync with tools/ksymtab.c.
+ * */
+struct ksymtab_header {
+    uint32_t magic;
+    uint32_t nsyms;
+    uint32_t nstabs;                        // # of stabs the table was built from
+};
+
+struct ksym {
+    uint32_t addr;                          // first address of the function
+    uint32_t size;                          // size of the function in bytes
+    uint32_t name;                          // offset of the name in .stabstr
+    uint16_t namelen;                       // length of the name, up to the ':'
+    uint16_t narg;                          // number of arguments
+    uint32_t stab_file;                     // index of the N_SO stab of the source file
+    uint32_t stab_fun;                      // index of the N_FUN stab
+    uint32_t stab_last;                     // index of the last stab of the function
 };
 
 /* *
@@ -112,6 +130,34 @@ stab_binsearch(const struct stab *stabs, int *region_left, int *region_right,
     }
 }
 
+/* *
+ * ksym_lookup - binary search the function table for the function that
+ * contains @addr, return NULL if there is no (valid) table or no such function
+ * */
+static const struct ksym *
+ksym_lookup(uintptr_t addr) {
+    const struct ksymtab_header *hdr = (const struct ksymtab_header *)__KSYMTAB_BEGIN__;
+    if (__KSYMTAB_END__ - __KSYMTAB_BEGIN__ < sizeof(struct ksymtab_header)
+            || hdr->magic != KSYMTAB_MAGIC || hdr->nstabs != __STAB_END__ - __STAB_BEGIN__) {
+        return NULL;
+    }
+    const struct ksym *syms = (const struct ksym *)(hdr + 1);
+    int l = 0, r = (int)hdr->nsyms - 1;
+    while (l <= r) {
+        int m = (l + r) / 2;
+        if (addr < syms[m].addr) {
+            r = m - 1;
+        }
+        else if (addr - syms[m].addr >= syms[m].size) {
+            l = m + 1;
+        }
+        else {
+            return syms + m;
+        }
+    }
+    return NULL;
+}
+
 /* *
  * debuginfo_eip - Fill in the @info structure with information about
  * the specified instruction address, @addr.  Returns 0 if information
@@ -140,21 +186,39 @@ debuginfo_eip(uintptr_t addr, struct eipdebuginfo *info) {
         return -1;
     }
 
+    // Fast path: the function comes from the precomputed table, and only
+    // its own stabs are searched for the line number and file name.
+    const struct ksym *sym;
+    int lfile, rfile, lfun, rfun, lline, rline;
+    if ((sym = ksym_lookup(addr)) != NULL) {
+        info->eip_fn_name = stabstr + sym->name;
+        info->eip_fn_namelen = sym->namelen;
+        info->eip_fn_addr = sym->addr;
+        info->eip_fn_narg = sym->narg;
+        lfile = sym->stab_file;
+        lline = sym->stab_fun, rline = sym->stab_last;
+        stab_binsearch(stabs, &lline, &rline, N_SLINE, addr - sym->addr);
+        if (lline > rline) {
+            return -1;
+        }
+        info->eip_line = stabs[rline].n_desc;
+        goto find_file;
+    }
+
     // Now we find the right stabs that define the function containing
     // 'eip'.  First, we find the basic source file containing 'eip'.
     // Then, we look in that source file for the function.  Then we look
     // for the line number.
 
     // Search the entire set of stabs for the source file (type N_SO).
-    int lfile = 0, rfile = (stab_end - stabs) - 1;
+    lfile = 0, rfile = (stab_end - stabs) - 1;
     stab_binsearch(stabs, &lfile, &rfile, N_SO, addr);
     if (lfile == 0)
         return -1;
 
     // Search within that file's stabs for the function definition
     // (N_FUN).
-    int lfun = lfile, rfun = rfile;
-    int lline, rline;
+    lfun = lfile, rfun = rfile;
     stab_binsearch(stabs, &lfun, &rfun, N_FUN, addr);
 
     if (lfun <= rfun) {
@@ -187,6 +251,17 @@ debuginfo_eip(uintptr_t addr, struct eipdebuginfo *info) {
         return -1;
     }
 
+    // Set eip_fn_narg to the number of arguments taken by the function,
+    // or 0 if there was no containing function.
+    if (lfun < rfun) {
+        for (rfile = lfun + 1;
+             rfile < rfun && stabs[rfile].n_type == N_PSYM;
+             rfile ++) {
+            info->eip_fn_narg ++;
+        }
+    }
+
+find_file:
     // Search backwards from the line number for the relevant filename stab.
     // We can't just use the "lfile" stab because inlined functions
     // can interpolate code from a different file!
@@ -199,16 +274,6 @@ debuginfo_eip(uintptr_t addr, struct eipdebuginfo *info) {
     if (lline >= lfile && stabs[lline].n_strx < stabstr_end - stabstr) {
         info->eip_file = stabstr + stabs[lline].n_strx;
     }
-
-    // Set eip_fn_narg to the number of arguments taken by the function,
-    // or 0 if there was no containing function.
-    if (lfun < rfun) {
-        for (lline = lfun + 1;
-             lline < rfun && stabs[lline].n_type == N_PSYM;
-             lline ++) {
-            info->eip_fn_narg ++;
-        }
-    }
     return 0;
 }
 
@@ -4,6 +4,17 @@
 #include <defs.h>
 #include <trap.h>
 
+/* debug information about a particular instruction pointer */
+struct eipdebuginfo {
+    const char *eip_file;                   // source code filename for eip
+    int eip_line;                           // source code line number for eip
+    const char *eip_fn_name;                // name of function containing eip
+    int eip_fn_namelen;                     // length of function's name
+    uintptr_t eip_fn_addr;                  // start address of function
+    int eip_fn_narg;                        // number of function arguments
+};
+
+int debuginfo_eip(uintptr_t addr, struct eipdebuginfo *info);
 void print_kerninfo(void);
 void print_stackframe(void);
 void print_debuginfo(uintptr_t eip);
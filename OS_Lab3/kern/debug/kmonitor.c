@@ -4,6 +4,16 @@
 #include <trap.h>
 #include <kmonitor.h>
 #include <kdebug.h>
+#include <kprof.h>
+#include <trace.h>
+#include <clock.h>
+#include <softirq.h>
+#include <irq.h>
+#include <sync.h>
+#include <smp.h>
+#include <spinlock.h>
+#include <vmm.h>
+#include <prefetch.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -21,6 +31,20 @@ static struct command commands[] = {
     {"help", "Display this list of commands.", mon_help},
     {"kerninfo", "Display information about the kernel.", mon_kerninfo},
     {"backtrace", "Print backtrace of stack frame.", mon_backtrace},
+    {"profile", "Sampling profiler: profile start [ticks] | stop | report [n].", mon_profile},
+    {"clock", "Display timer interrupt, softirq and idle statistics.", mon_clock},
+    {"interrupts", "Display per-vector hit counts, cycles and irq handlers.", mon_interrupts},
+    {"latency", "Trap latency and irq-off time: latency [reset].", mon_latency},
+    {"cpus", "Display the online cpus and the cross-cpu calls they ran.", mon_cpus},
+    {"lockstat", "Lock acquisitions and contention: lockstat [reset].", mon_lockstat},
+    {"vmstat", "Display page fault and fault-around counters.", mon_vmstat},
+    {"mlocklimit", "Set the most pages all address spaces may lock: mlocklimit [pages].", mon_mlocklimit},
+    {"lockbench", "Stress the spin, ticket and mcs locks: lockbench [iterations].", mon_lockbench},
+    {"cowbench", "Time mm_dup against an eager copy, and writing out shared pages: cowbench [megabytes].", mon_cowbench},
+    {"vmabench", "Vma count and find_vma steps with and without merging: vmabench [vmas].", mon_vmabench},
+    {"populatebench", "Faults and time of demand faulting and VM_POPULATE: populatebench [megabytes].", mon_populatebench},
+    {"prefetchbench", "Faults of a strided swap-in with and without prefetch: prefetchbench [pages] [stride].", mon_prefetchbench},
+    {"trace", "Tracepoints: trace [on|off|echo|noecho <event|all>] | dump [event] | clear.", mon_trace},
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -130,3 +154,176 @@ mon_backtrace(int argc, char **argv, struct trapframe *tf) {
     return 0;
 }
 
+/* *
+ * mon_profile - control the timer-driven profiler in kern/debug/kprof.c,
+ * report symbolizes the hottest functions and their callers.
+ * */
+int
+mon_profile(int argc, char **argv, struct trapframe *tf) {
+    if (argc >= 1 && strcmp(argv[0], "start") == 0) {
+        kprof_start(argc >= 2 ? strtol(argv[1], NULL, 10) : 1);
+    }
+    else if (argc >= 1 && strcmp(argv[0], "stop") == 0) {
+        kprof_stop();
+    }
+    else if (argc >= 1 && strcmp(argv[0], "report") == 0) {
+        kprof_report(argc >= 2 ? strtol(argv[1], NULL, 10) : 10);
+    }
+    else {
+        cprintf("usage: profile start [ticks] | stop | report [n]\n");
+    }
+    return 0;
+}
+
+/* *
+ * mon_trace - list the tracepoints in kern/debug/trace.h, switch recording
+ * or console echo of an event, and decode what has been recorded.
+ * */
+int
+mon_trace(int argc, char **argv, struct trapframe *tf) {
+    static const struct {
+        const char *cmd;
+        uint32_t set, clear;
+    } modes[] = {
+        {"on", TRACE_RECORD, 0}, {"off", 0, TRACE_RECORD},
+        {"echo", TRACE_ECHO, 0}, {"noecho", 0, TRACE_ECHO},
+    };
+    int i;
+    if (argc == 0) {
+        trace_list();
+        return 0;
+    }
+    if (strcmp(argv[0], "dump") == 0) {
+        trace_dump(argc >= 2 ? argv[1] : NULL);
+        return 0;
+    }
+    if (strcmp(argv[0], "clear") == 0) {
+        trace_clear();
+        return 0;
+    }
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i ++) {
+        if (argc >= 2 && strcmp(argv[0], modes[i].cmd) == 0) {
+            if (trace_set_flags(argv[1], modes[i].set, modes[i].clear) != 0) {
+                cprintf("unknown event '%s'\n", argv[1]);
+            }
+            return 0;
+        }
+    }
+    cprintf("usage: trace [on|off|echo|noecho <event|all>] | dump [event] | clear\n");
+    return 0;
+}
+
+/* mon_interrupts - call irq_print_stats in kern/trap/irq.c */
+int
+mon_interrupts(int argc, char **argv, struct trapframe *tf) {
+    irq_print_stats();
+    return 0;
+}
+
+/* *
+ * mon_latency - print the per-vector trap latencies and the longest
+ * interrupts-off regions, or reset both with 'latency reset'
+ * */
+int
+mon_latency(int argc, char **argv, struct trapframe *tf) {
+    if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+        irq_reset_stats();
+        irqoff_reset_stats();
+        return 0;
+    }
+    if (argc != 0) {
+        cprintf("usage: latency [reset]\n");
+        return 0;
+    }
+    irq_print_latency();
+    irqoff_print_stats(10);
+    return 0;
+}
+
+/* mon_cpus - call smp_print_stats in kern/driver/smp.c */
+int
+mon_cpus(int argc, char **argv, struct trapframe *tf) {
+    smp_print_stats();
+    return 0;
+}
+
+/* mon_vmstat - call vmm_print_stats in kern/mm/vmm.c */
+int
+mon_vmstat(int argc, char **argv, struct trapframe *tf) {
+    vmm_print_stats();
+    return 0;
+}
+
+/* mon_lockstat - print the lock statistics, or clear them with 'lockstat reset' */
+int
+mon_lockstat(int argc, char **argv, struct trapframe *tf) {
+    if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+        lockstat_reset();
+        return 0;
+    }
+    if (argc != 0) {
+        cprintf("usage: lockstat [reset]\n");
+        return 0;
+    }
+    lockstat_print();
+    return 0;
+}
+
+/* mon_lockbench - call lock_bench in kern/sync/lockbench.c */
+int
+mon_lockbench(int argc, char **argv, struct trapframe *tf) {
+    lock_bench(argc >= 1 ? strtol(argv[0], NULL, 10) : 100000);
+    return 0;
+}
+
+/* mon_cowbench - call cow_bench in kern/mm/cowbench.c */
+int
+mon_cowbench(int argc, char **argv, struct trapframe *tf) {
+    cow_bench(argc >= 1 ? strtol(argv[0], NULL, 10) : 64);
+    return 0;
+}
+
+/* mon_vmabench - call vma_bench in kern/mm/vmabench.c */
+int
+mon_vmabench(int argc, char **argv, struct trapframe *tf) {
+    vma_bench(argc >= 1 ? strtol(argv[0], NULL, 10) : 512);
+    return 0;
+}
+
+/* mon_populatebench - call populate_bench in kern/mm/populatebench.c */
+int
+mon_populatebench(int argc, char **argv, struct trapframe *tf) {
+    populate_bench(argc >= 1 ? strtol(argv[0], NULL, 10) : 16);
+    return 0;
+}
+
+/* mon_mlocklimit - set mlock_limit in kern/mm/vmm.c, or print it */
+int
+mon_mlocklimit(int argc, char **argv, struct trapframe *tf) {
+    if (argc >= 1) {
+        long limit = strtol(argv[0], NULL, 10);
+        if (limit < 0) {
+            cprintf("usage: mlocklimit [pages], pages >= 0\n");
+            return 0;
+        }
+        mlock_limit = limit;
+    }
+    cprintf("mlock limit: %u pages\n", mlock_limit);
+    return 0;
+}
+
+/* mon_prefetchbench - call prefetch_bench in kern/mm/prefetchbench.c */
+int
+mon_prefetchbench(int argc, char **argv, struct trapframe *tf) {
+    prefetch_bench(argc >= 1 ? strtol(argv[0], NULL, 10) : 1024, argc >= 2 ? strtol(argv[1], NULL, 10) : 4);
+    return 0;
+}
+
+/* mon_clock - call clock_print_stats and softirq_print_stats */
+int
+mon_clock(int argc, char **argv, struct trapframe *tf) {
+    clock_print_stats();
+    softirq_print_stats();
+    return 0;
+}
+
@@ -8,6 +8,20 @@ void kmonitor(struct trapframe *tf);
 int mon_help(int argc, char **argv, struct trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct trapframe *tf);
+int mon_profile(int argc, char **argv, struct trapframe *tf);
+int mon_trace(int argc, char **argv, struct trapframe *tf);
+int mon_clock(int argc, char **argv, struct trapframe *tf);
+int mon_interrupts(int argc, char **argv, struct trapframe *tf);
+int mon_latency(int argc, char **argv, struct trapframe *tf);
+int mon_cpus(int argc, char **argv, struct trapframe *tf);
+int mon_vmstat(int argc, char **argv, struct trapframe *tf);
+int mon_lockstat(int argc, char **argv, struct trapframe *tf);
+int mon_lockbench(int argc, char **argv, struct trapframe *tf);
+int mon_cowbench(int argc, char **argv, struct trapframe *tf);
+int mon_vmabench(int argc, char **argv, struct trapframe *tf);
+int mon_populatebench(int argc, char **argv, struct trapframe *tf);
+int mon_mlocklimit(int argc, char **argv, struct trapframe *tf);
+int mon_prefetchbench(int argc, char **argv, struct trapframe *tf);
 int mon_continue(int argc, char **argv, struct trapframe *tf);
 int mon_step(int argc, char **argv, struct trapframe *tf);
 int mon_breakpoint(int argc, char **argv, struct trapframe *tf);
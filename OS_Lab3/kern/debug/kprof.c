@@ -0,0 +1,240 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <sync.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <kdebug.h>
+#include <kprof.h>
+#include <clock.h>
+
+/* *
+ * A sampling profiler driven by the timer interrupt.
+ *
+ * Every @interval ticks, kprof_tick() records the interrupted eip into a
+ * histogram of fixed-size buckets over the kernel text, and walks the saved
+ * ebp chain (the same way print_stackframe does) to record caller -> callee
+ * edges. Symbolization with debuginfo_eip is slow, so it is only done when
+ * the report is printed, merging buckets into functions.
+ * */
+
+#define PROF_NBUCKETS           8192                    // # of histogram buckets
+#define PROF_NEDGES             512                     // # of slots in the edge hash table
+#define PROF_DEPTH              8                       // max frames walked per sample
+#define PROF_NFUNCS             128                     // max functions in a report
+
+extern char kern_entry[], etext[];
+
+/* a caller -> callee edge, keyed by the call site and the bucket of the callee */
+struct prof_edge {
+    uintptr_t from;             // return address in the caller
+    uintptr_t to;               // eip (or return address) in the callee
+    uint32_t count;
+};
+
+/* per-function totals, built at report time */
+struct prof_func {
+    uintptr_t addr;
+    const char *name;
+    int namelen;
+    uint32_t count;
+};
+
+static uint32_t prof_hist[PROF_NBUCKETS];
+static struct prof_edge prof_edges[PROF_NEDGES];
+static struct prof_func prof_funcs[PROF_NFUNCS];
+
+static bool prof_enabled = 0;
+static int prof_interval = 1, prof_countdown;
+static unsigned int prof_shift;                         // log2 of bucket size in bytes
+static uint32_t prof_samples, prof_outside, prof_dropped_edges;
+
+/* kprof_start - reset the profile and sample every @interval timer ticks */
+void
+kprof_start(int interval) {
+    size_t text = etext - kern_entry;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        // smallest bucket size so that the whole text fits in the histogram
+        for (prof_shift = 2; (text >> prof_shift) >= PROF_NBUCKETS; prof_shift ++)
+            /* do nothing */;
+        memset(prof_hist, 0, sizeof(prof_hist));
+        memset(prof_edges, 0, sizeof(prof_edges));
+        prof_samples = prof_outside = prof_dropped_edges = 0;
+        prof_interval = prof_countdown = (interval > 0) ? interval : 1;
+        prof_enabled = 1;
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* kprof_stop - stop sampling, the collected profile is kept for kprof_report */
+void
+kprof_stop(void) {
+    prof_enabled = 0;
+}
+
+static inline bool
+in_text(uintptr_t eip) {
+    return eip >= (uintptr_t)kern_entry && eip < (uintptr_t)etext;
+}
+
+/* *
+ * prof_add_edge - count one @from -> @to edge, @to is truncated to its bucket
+ * so that samples in the same callee share a slot
+ * */
+static void
+prof_add_edge(uintptr_t from, uintptr_t to) {
+    to &= ~((1 << prof_shift) - 1);
+    uint32_t h = ((from * 0x9E3779B1U) ^ (to >> prof_shift)) % PROF_NEDGES;
+    int i;
+    for (i = 0; i < PROF_NEDGES; i ++, h = (h + 1) % PROF_NEDGES) {
+        struct prof_edge *e = prof_edges + h;
+        if (e->count == 0) {
+            e->from = from, e->to = to;
+        }
+        if (e->from == from && e->to == to) {
+            e->count ++;
+            return;
+        }
+    }
+    prof_dropped_edges ++;
+}
+
+/* *
+ * kprof_tick - called from the timer interrupt with the interrupted context
+ *
+ * The ebp chain is only followed while it stays inside the boot stack, so a
+ * sample taken in a function prologue or in code that does not keep frame
+ * pointers just stops the walk early.
+ * */
+void
+kprof_tick(struct trapframe *tf) {
+    if (!prof_enabled) {
+        return;
+    }
+    // keep the tick going while profiling, even when the clock is tickless
+    clock_request_tick(ticks + 1);
+    if (-- prof_countdown > 0) {
+        return;
+    }
+    prof_countdown = prof_interval;
+    prof_samples ++;
+
+    uintptr_t eip = tf->tf_eip;
+    if ((tf->tf_cs & 3) != 0 || !in_text(eip)) {
+        prof_outside ++;
+        return;
+    }
+    prof_hist[(eip - (uintptr_t)kern_entry) >> prof_shift] ++;
+
+    uintptr_t ebp = tf->tf_regs.reg_ebp, callee = eip;
+    int i;
+    for (i = 0; i < PROF_DEPTH; i ++) {
+        if (ebp < (uintptr_t)bootstack || ebp + 8 > (uintptr_t)bootstacktop) {
+            break;
+        }
+        uintptr_t ret = ((uintptr_t *)ebp)[1];
+        if (!in_text(ret)) {
+            break;
+        }
+        prof_add_edge(ret, callee);
+        callee = ret, ebp = ((uintptr_t *)ebp)[0];
+    }
+}
+
+/* *
+ * prof_func_of - find (or add) the report entry for the function holding @eip,
+ * returns NULL when the table is full
+ * */
+static struct prof_func *
+prof_func_of(uintptr_t eip) {
+    struct eipdebuginfo info;
+    debuginfo_eip(eip, &info);
+    int i;
+    for (i = 0; i < PROF_NFUNCS && prof_funcs[i].namelen != 0; i ++) {
+        if (prof_funcs[i].addr == info.eip_fn_addr) {
+            return prof_funcs + i;
+        }
+    }
+    if (i == PROF_NFUNCS) {
+        return NULL;
+    }
+    prof_funcs[i].addr = info.eip_fn_addr;
+    prof_funcs[i].name = info.eip_fn_name;
+    prof_funcs[i].namelen = info.eip_fn_namelen;
+    prof_funcs[i].count = 0;
+    return prof_funcs + i;
+}
+
+/* prof_sort_funcs - sort the report entries by count, largest first */
+static int
+prof_sort_funcs(void) {
+    int n, i, j;
+    for (n = 0; n < PROF_NFUNCS && prof_funcs[n].namelen != 0; n ++)
+        /* do nothing */;
+    for (i = 1; i < n; i ++) {
+        struct prof_func f = prof_funcs[i];
+        for (j = i; j > 0 && prof_funcs[j - 1].count < f.count; j --) {
+            prof_funcs[j] = prof_funcs[j - 1];
+        }
+        prof_funcs[j] = f;
+    }
+    return n;
+}
+
+/* *
+ * kprof_report - print the @nentries functions with the most samples, then,
+ * for each of them, the call sites that led there
+ * */
+void
+kprof_report(int nentries) {
+    bool was_enabled = prof_enabled;
+    int i, j, n;
+    struct prof_func *f;
+
+    prof_enabled = 0;
+    cprintf("profile: %u samples every %d ticks, %u outside kernel text, %d byte buckets\n",
+            prof_samples, prof_interval, prof_outside, 1 << prof_shift);
+
+    // flat view: buckets merged into functions
+    memset(prof_funcs, 0, sizeof(prof_funcs));
+    for (i = 0; i < PROF_NBUCKETS; i ++) {
+        if (prof_hist[i] != 0 && (f = prof_func_of((uintptr_t)kern_entry + (i << prof_shift))) != NULL) {
+            f->count += prof_hist[i];
+        }
+    }
+    n = prof_sort_funcs();
+    if (nentries > n) {
+        nentries = n;
+    }
+    cprintf("  samples  %%     function\n");
+    for (i = 0; i < nentries; i ++) {
+        f = prof_funcs + i;
+        cprintf("  %7u  %3u  %.*s\n", f->count,
+                prof_samples ? f->count * 100 / prof_samples : 0, f->namelen, f->name);
+    }
+
+    // caller view: for each hot function, the call sites whose edges point into it
+    cprintf("  callers:\n");
+    for (i = 0; i < nentries; i ++) {
+        struct eipdebuginfo info;
+        uintptr_t addr = prof_funcs[i].addr;
+        cprintf("  %.*s\n", prof_funcs[i].namelen, prof_funcs[i].name);
+        for (j = 0; j < PROF_NEDGES; j ++) {
+            struct prof_edge *e = prof_edges + j;
+            if (e->count == 0 || debuginfo_eip(e->to, &info) != 0 || info.eip_fn_addr != addr) {
+                continue;
+            }
+            debuginfo_eip(e->from - 1, &info);
+            cprintf("    %7u  <- %.*s+%d (%s:%d)\n", e->count, info.eip_fn_namelen, info.eip_fn_name,
+                    e->from - info.eip_fn_addr, info.eip_file, info.eip_line);
+        }
+    }
+    if (prof_dropped_edges != 0) {
+        cprintf("  %u call edges dropped, edge table full\n", prof_dropped_edges);
+    }
+    prof_enabled = was_enabled;
+}
+
@@ -0,0 +1,13 @@
+#ifndef __KERN_DEBUG_KPROF_H__
+#define __KERN_DEBUG_KPROF_H__
+
+#include <defs.h>
+#include <trap.h>
+
+void kprof_start(int interval);
+void kprof_stop(void);
+void kprof_report(int nentries);
+void kprof_tick(struct trapframe *tf);
+
+#endif /* !__KERN_DEBUG_KPROF_H__ */
+
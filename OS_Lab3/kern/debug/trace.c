@@ -0,0 +1,135 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <sync.h>
+#include <trace.h>
+
+/* the rings of all events, see kern/debug/trace.h */
+static struct trace_record trace_rings[TRACE_NEVENTS][TRACE_RING_SIZE];
+
+struct trace_event trace_events[TRACE_NEVENTS] = {
+#define TRACE_INIT(name, dflags, fmt, ...)                                                  \
+    [TRACE_##name] = {#name, fmt, dflags, 0, trace_rings[TRACE_##name]},
+    TRACE_EVENT_LIST(TRACE_INIT)
+#undef TRACE_INIT
+};
+
+static void
+trace_print(struct trace_event *ev, const uint32_t *args) {
+    cprintf(ev->fmt, args[0], args[1], args[2], args[3]);
+}
+
+/* *
+ * __trace_emit - slow path of trace_<name>(), only called when the event
+ * has any flag set
+ * */
+void
+__trace_emit(int id, const uint32_t *args, int nargs) {
+    struct trace_event *ev = trace_events + id;
+    uint32_t buf[TRACE_MAXARGS] = {0};
+    memcpy(buf, args, nargs * sizeof(uint32_t));
+    if (ev->flags & TRACE_RECORD) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            struct trace_record *rec = ev->ring + (ev->count ++ & (TRACE_RING_SIZE - 1));
+            rec->tsc = rdtsc();
+            memcpy(rec->args, buf, sizeof(buf));
+        }
+        local_intr_restore(intr_flag);
+    }
+    if (ev->flags & TRACE_ECHO) {
+        trace_print(ev, buf);
+    }
+}
+
+/* *
+ * trace_set_flags - set then clear flags of the event called @name, or of
+ * all events if @name is "all"; return -E_INVAL for an unknown event
+ * */
+int
+trace_set_flags(const char *name, uint32_t set, uint32_t clear) {
+    int i, found = 0;
+    for (i = 0; i < TRACE_NEVENTS; i ++) {
+        if (strcmp(name, "all") == 0 || strcmp(name, trace_events[i].name) == 0) {
+            trace_events[i].flags = (trace_events[i].flags | set) & ~clear;
+            found = 1;
+        }
+    }
+    return found ? 0 : -E_INVAL;
+}
+
+/* trace_clear - drop every recorded event */
+void
+trace_clear(void) {
+    bool intr_flag;
+    int i;
+    local_intr_save(intr_flag);
+    {
+        for (i = 0; i < TRACE_NEVENTS; i ++) {
+            trace_events[i].count = 0;
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* trace_list - print the events with their flags and record counts */
+void
+trace_list(void) {
+    int i;
+    for (i = 0; i < TRACE_NEVENTS; i ++) {
+        struct trace_event *ev = trace_events + i;
+        cprintf("  %-12s %s %s %u records\n", ev->name,
+                (ev->flags & TRACE_RECORD) ? "record" : "------",
+                (ev->flags & TRACE_ECHO) ? "echo" : "----", ev->count);
+    }
+}
+
+/* *
+ * trace_dump - decode the rings of the event called @name (all events if
+ * @name is NULL) and print the records merged in time order, stamped with
+ * the cycles elapsed since the first one
+ * */
+void
+trace_dump(const char *name) {
+    uint32_t next[TRACE_NEVENTS];
+    uint64_t first = 0;
+    int i, dropped = 0;
+    for (i = 0; i < TRACE_NEVENTS; i ++) {
+        struct trace_event *ev = trace_events + i;
+        next[i] = ev->count;
+        if (name == NULL || strcmp(name, ev->name) == 0) {
+            next[i] = (ev->count > TRACE_RING_SIZE) ? ev->count - TRACE_RING_SIZE : 0;
+            dropped += next[i];
+        }
+    }
+    while (1) {
+        // pick the oldest pending record among all rings
+        struct trace_record *rec = NULL;
+        int id = -1;
+        for (i = 0; i < TRACE_NEVENTS; i ++) {
+            struct trace_event *ev = trace_events + i;
+            if (next[i] < ev->count) {
+                struct trace_record *r = ev->ring + (next[i] & (TRACE_RING_SIZE - 1));
+                if (rec == NULL || r->tsc < rec->tsc) {
+                    rec = r, id = i;
+                }
+            }
+        }
+        if (rec == NULL) {
+            break;
+        }
+        if (first == 0) {
+            first = rec->tsc;
+        }
+        next[id] ++;
+        cprintf("  +%12llu %s: ", rec->tsc - first, trace_events[id].name);
+        trace_print(trace_events + id, rec->args);
+    }
+    if (dropped != 0) {
+        cprintf("  (%d older records overwritten)\n", dropped);
+    }
+}
+
@@ -0,0 +1,81 @@
+#ifndef __KERN_DEBUG_TRACE_H__
+#define __KERN_DEBUG_TRACE_H__
+
+#include <defs.h>
+
+/* *
+ * Static tracepoints.
+ *
+ * Every event is declared once in TRACE_EVENT_LIST below as
+ *      EVENT(name, default flags, format, (typed fields), (values))
+ * which generates an enum TRACE_<name> and an inline trace_<name>(fields).
+ * A disabled event costs one load and branch. When TRACE_RECORD is set the
+ * values are stored (as 32-bit words, with a tsc stamp) in the event's own
+ * ring; when TRACE_ECHO is set they are printed right away with @format.
+ * Strings passed as values must be static, the ring keeps the pointer only.
+ * */
+
+#define TRACE_MAXARGS           4
+#define TRACE_RING_SIZE         64                  // records per event, power of 2
+
+#define TRACE_RECORD            0x1                 // store records in the ring
+#define TRACE_ECHO              0x2                 // print each event on the console
+
+#define TRACE_EVENT_LIST(EVENT)                                                             \
+    EVENT(pgfault, TRACE_ECHO, "page fault at 0x%08x: %c/%c [%s].\n",                       \
+          (uintptr_t addr, char us, char rw, const char *why),                              \
+          (addr, us, rw, (uintptr_t)why))                                                   \
+    EVENT(do_pgfault, 0, "do_pgfault: addr 0x%08x err %x ret %d\n",                         \
+          (uintptr_t addr, uint32_t err, int ret),                                          \
+          (addr, err, ret))                                                                 \
+    EVENT(swap_out, TRACE_ECHO, "swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", \
+          (int i, uintptr_t vaddr, uint32_t entry),                                         \
+          (i, vaddr, entry))                                                                \
+    EVENT(swap_in, TRACE_ECHO, "swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", \
+          (uint32_t entry, uintptr_t addr),                                                 \
+          (entry, addr))
+
+enum {
+#define TRACE_ENUM(name, ...)   TRACE_##name,
+    TRACE_EVENT_LIST(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACE_NEVENTS,
+};
+
+struct trace_record {
+    uint64_t tsc;                                   // time stamp of the event
+    uint32_t args[TRACE_MAXARGS];                   // field values, in declaration order
+};
+
+struct trace_event {
+    const char *name;
+    const char *fmt;                                // printf format of the fields
+    uint32_t flags;                                 // TRACE_RECORD | TRACE_ECHO
+    uint32_t count;                                 // # of records ever written to the ring
+    struct trace_record *ring;
+};
+
+extern struct trace_event trace_events[TRACE_NEVENTS];
+
+void __trace_emit(int id, const uint32_t *args, int nargs);
+
+#define TRACE_UNPAREN(...)      __VA_ARGS__
+
+#define TRACE_DEFINE(name, dflags, fmt, fields, values)                                     \
+    static inline void                                                                      \
+    trace_##name fields {                                                                   \
+        if (trace_events[TRACE_##name].flags != 0) {                                        \
+            uint32_t __args[] = {TRACE_UNPAREN values};                                     \
+            __trace_emit(TRACE_##name, __args, sizeof(__args) / sizeof(uint32_t));          \
+        }                                                                                   \
+    }
+TRACE_EVENT_LIST(TRACE_DEFINE)
+#undef TRACE_DEFINE
+
+int trace_set_flags(const char *name, uint32_t set, uint32_t clear);
+void trace_clear(void);
+void trace_dump(const char *name);
+void trace_list(void);
+
+#endif /* !__KERN_DEBUG_TRACE_H__ */
+
@@ -0,0 +1,231 @@
+#include <defs.h>
+#include <stdio.h>
+#include <string.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <acpi.h>
+
+/* *
+ * Just enough ACPI to route interrupts: find the RSDP the BIOS left in
+ * low memory, walk the RSDT and read the MADT ("APIC") for the local APIC
+ * ids of the processors, the first IOAPIC and the interrupt source
+ * overrides that tell which global system interrupt an ISA IRQ is wired
+ * to. Everything else in the tables is ignored.
+ * */
+
+#define EBDA_SEG_PTR            0x40E           // bda word: segment of the ebda
+#define BIOS_ROM_BEGIN          0xE0000
+#define BIOS_ROM_END            0x100000
+
+#define MADT_LAPIC              0
+#define MADT_IOAPIC             1
+#define MADT_ISO                2
+#define MADT_LAPIC_ENABLED      0x1
+
+#define NISAIRQ                 16
+
+struct acpi_rsdp {
+    char signature[8];                  // "RSD PTR "
+    uint8_t checksum;                   // of the first 20 bytes
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;                    // of the whole table
+    uint8_t revision;
+    uint8_t checksum;                   // of the whole table
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct acpi_madt {
+    struct acpi_sdt_header hdr;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[0];                 // variable sized, each starts with type and length
+} __attribute__((packed));
+
+struct madt_lapic {
+    uint8_t type, length;
+    uint8_t processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    uint8_t type, length;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_iso {
+    uint8_t type, length;
+    uint8_t bus;                        // 0, ISA
+    uint8_t source;                     // ISA irq
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+bool acpi_madt_found = 0;
+int acpi_ncpu = 0;
+uint8_t acpi_lapic_ids[ACPI_MAX_CPU];
+uintptr_t acpi_ioapic_addr = 0;
+uint8_t acpi_ioapic_id;
+uint32_t acpi_ioapic_gsi_base;
+
+// ISA irq -> global system interrupt, identity unless overridden
+static struct {
+    uint32_t gsi;
+    uint16_t flags;
+} isa_irq[NISAIRQ];
+
+/* *
+ * acpi_map - the kernel address of @len bytes of tables at physical @pa.
+ * The tables usually sit right below the top of RAM, in the linear map,
+ * but outside the pages the pmm manages, so KADDR can not be used.
+ * */
+static void *
+acpi_map(uintptr_t pa, size_t len) {
+    if (pa + len > pa && pa + len <= KMEMSIZE) {
+        return (void *)(pa + KERNBASE);
+    }
+    return mmio_map_region(pa, len);
+}
+
+/* acpi_map_table - map the whole table whose header is at physical @pa */
+static struct acpi_sdt_header *
+acpi_map_table(uintptr_t pa) {
+    struct acpi_sdt_header *h = acpi_map(pa, sizeof(struct acpi_sdt_header));
+    if ((uintptr_t)h != pa + KERNBASE) {
+        // only the header got an mmio mapping, map it again with the length
+        h = acpi_map(pa, h->length);
+    }
+    return h;
+}
+
+static uint8_t
+sum(const void *addr, size_t len) {
+    const uint8_t *p = addr;
+    uint8_t s = 0;
+    while (len -- > 0) {
+        s += *p ++;
+    }
+    return s;
+}
+
+static struct acpi_rsdp *
+rsdp_search(uintptr_t pa, size_t len) {
+    uintptr_t end = pa + len;
+    for (; pa + sizeof(struct acpi_rsdp) <= end; pa += 16) {
+        struct acpi_rsdp *rsdp = (struct acpi_rsdp *)(pa + KERNBASE);
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && sum(rsdp, sizeof(struct acpi_rsdp)) == 0) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/* rsdp_find - search the first KB of the EBDA, then the BIOS ROM area */
+static struct acpi_rsdp *
+rsdp_find(void) {
+    struct acpi_rsdp *rsdp = NULL;
+    uintptr_t ebda = (uintptr_t)(*(uint16_t *)(KERNBASE + EBDA_SEG_PTR)) << 4;
+    if (ebda != 0) {
+        rsdp = rsdp_search(ebda, 1024);
+    }
+    if (rsdp == NULL) {
+        rsdp = rsdp_search(BIOS_ROM_BEGIN, BIOS_ROM_END - BIOS_ROM_BEGIN);
+    }
+    return rsdp;
+}
+
+static void
+madt_parse(struct acpi_madt *madt) {
+    uint8_t *p = madt->entries, *end = (uint8_t *)madt + madt->hdr.length;
+    while (p + 2 <= end && p[1] >= 2 && p + p[1] <= end) {
+        switch (p[0]) {
+        case MADT_LAPIC: {
+                struct madt_lapic *e = (struct madt_lapic *)p;
+                if ((e->flags & MADT_LAPIC_ENABLED) && acpi_ncpu < ACPI_MAX_CPU) {
+                    acpi_lapic_ids[acpi_ncpu ++] = e->apic_id;
+                }
+            }
+            break;
+        case MADT_IOAPIC: {
+                struct madt_ioapic *e = (struct madt_ioapic *)p;
+                // only the first one is used, it has the ISA irqs
+                if (acpi_ioapic_addr == 0) {
+                    acpi_ioapic_addr = e->addr;
+                    acpi_ioapic_id = e->ioapic_id;
+                    acpi_ioapic_gsi_base = e->gsi_base;
+                }
+            }
+            break;
+        case MADT_ISO: {
+                struct madt_iso *e = (struct madt_iso *)p;
+                if (e->bus == 0 && e->source < NISAIRQ) {
+                    isa_irq[e->source].gsi = e->gsi;
+                    isa_irq[e->source].flags = e->flags;
+                }
+            }
+            break;
+        }
+        p += p[1];
+    }
+}
+
+/* acpi_init - find and parse the MADT, leaves acpi_madt_found 0 on failure */
+void
+acpi_init(void) {
+    int i;
+    for (i = 0; i < NISAIRQ; i ++) {
+        isa_irq[i].gsi = i;
+        isa_irq[i].flags = 0;
+    }
+
+    struct acpi_rsdp *rsdp = rsdp_find();
+    if (rsdp == NULL) {
+        cprintf("acpi: no rsdp\n");
+        return;
+    }
+    struct acpi_sdt_header *rsdt = acpi_map_table(rsdp->rsdt_addr);
+    if (memcmp(rsdt->signature, "RSDT", 4) != 0 || sum(rsdt, rsdt->length) != 0) {
+        cprintf("acpi: bad rsdt at 0x%08x\n", rsdp->rsdt_addr);
+        return;
+    }
+    uint32_t *entry = (uint32_t *)(rsdt + 1);
+    int n = (rsdt->length - sizeof(struct acpi_sdt_header)) / sizeof(uint32_t);
+    for (i = 0; i < n; i ++) {
+        struct acpi_sdt_header *h = acpi_map_table(entry[i]);
+        if (memcmp(h->signature, "APIC", 4) == 0 && sum(h, h->length) == 0) {
+            madt_parse((struct acpi_madt *)h);
+            acpi_madt_found = 1;
+            break;
+        }
+    }
+    if (!acpi_madt_found) {
+        cprintf("acpi: no madt\n");
+        return;
+    }
+    cprintf("acpi: %d cpu(s), ioapic at 0x%08x\n", acpi_ncpu, acpi_ioapic_addr);
+}
+
+/* acpi_irq_to_gsi - the global system interrupt ISA @irq is wired to, and its INTI flags */
+uint32_t
+acpi_irq_to_gsi(unsigned int irq, uint16_t *flags) {
+    if (irq >= NISAIRQ) {
+        *flags = 0;
+        return irq;
+    }
+    *flags = isa_irq[irq].flags;
+    return isa_irq[irq].gsi;
+}
+
@@ -0,0 +1,25 @@
+#ifndef __KERN_DRIVER_ACPI_H__
+#define __KERN_DRIVER_ACPI_H__
+
+#include <defs.h>
+
+#define ACPI_MAX_CPU            8
+
+// polarity and trigger mode of an interrupt source override, MPS INTI flags
+#define ACPI_IRQ_POLARITY       0x3
+#define ACPI_IRQ_ACTIVE_LOW     0x3
+#define ACPI_IRQ_TRIGGER        0xC
+#define ACPI_IRQ_LEVEL          0xC
+
+extern bool acpi_madt_found;
+extern int acpi_ncpu;
+extern uint8_t acpi_lapic_ids[ACPI_MAX_CPU];
+extern uintptr_t acpi_ioapic_addr;              // 0 if the MADT lists no IOAPIC
+extern uint8_t acpi_ioapic_id;
+extern uint32_t acpi_ioapic_gsi_base;
+
+void acpi_init(void);
+uint32_t acpi_irq_to_gsi(unsigned int irq, uint16_t *flags);
+
+#endif /* !__KERN_DRIVER_ACPI_H__ */
+
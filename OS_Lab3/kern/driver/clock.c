@@ -2,6 +2,15 @@
 #include <trap.h>
 #include <stdio.h>
 #include <picirq.h>
+#include <sync.h>
+#include <fpu.h>
+#include <clock.h>
+#include <lapic.h>
+#include <timer.h>
+#include <softirq.h>
+#include <irq.h>
+#include <kprof.h>
+#include <assert.h>
 
 /* *
  * Support for time-related hardware gadgets - the 8253 timer,
@@ -20,26 +29,353 @@
 
 #define TIMER_MODE      (IO_TIMER1 + 3)         // timer mode port
 #define TIMER_SEL0      0x00                    // select counter 0
+#define TIMER_SEL2      0x80                    // select counter 2
+#define TIMER_INTTC     0x00                    // mode 0, interrupt on terminal count
 #define TIMER_RATEGEN   0x04                    // mode 2, rate generator
+#define TIMER_LATCH     0x00                    // latch counter for reading
 #define TIMER_16BIT     0x30                    // r/w counter 16 bits, LSB first
 
+#define TIMER_CNTR2     (IO_TIMER1 + 2)         // timer 2 counter port
+#define IO_PPI          0x061                   // 8255 port B, gate/output of timer 2
+#define PPI_T2GATE      0x01                    // timer 2 gate
+#define PPI_SPKR        0x02                    // speaker data enable
+#define PPI_T2OUT       0x20                    // timer 2 output
+
+#define HZ              100
+#define NSEC_PER_SEC    1000000000U
+#define NSEC_PER_TICK   (NSEC_PER_SEC / HZ)
+
+#define CAL_MS          10                      // length of one calibration run
+#define CAL_TRIES       3
+
 volatile size_t ticks;
 
 /* *
- * clock_init - initialize 8253 clock to interrupt 100 times per second,
- * and then enable IRQ_TIMER.
+ * Timekeeping.
+ *
+ * The TSC is calibrated against PIT channel 2 at boot. Cycle counts are
+ * converted to ns with a multiply and shift: ns = (cycles * mult) >> shift,
+ * where mult/2^shift is the ns length of one cycle. If there is no TSC, or
+ * the calibration runs disagree (e.g. a frequency-scaling host), clock_ns()
+ * falls back to ticks plus a latched read of PIT channel 0, which is only
+ * meaningful after clock_init().
+ * */
+uint32_t tsc_khz = 0;
+bool tsc_reliable = 0;
+
+static uint64_t tsc_base;
+static uint32_t cyc2ns_mult, cyc2ns_shift;
+static uint32_t ns2cyc_mult, ns2cyc_shift;
+static uint64_t last_pit_ns;
+
+/* *
+ * pit_calibrate_tsc - count TSC cycles during CAL_MS of PIT channel 2
+ * counting down in mode 0, return the TSC frequency in kHz or 0 on failure
+ * */
+static uint32_t
+pit_calibrate_tsc(void) {
+    uint32_t latch = TIMER_FREQ / (1000 / CAL_MS), loops = 0;
+    uint64_t t1, t2;
+
+    // gate high, speaker off
+    outb(IO_PPI, (inb(IO_PPI) & ~PPI_SPKR) | PPI_T2GATE);
+    outb(TIMER_MODE, TIMER_SEL2 | TIMER_INTTC | TIMER_16BIT);
+    outb(TIMER_CNTR2, latch % 256);
+    outb(TIMER_CNTR2, latch / 256);
+
+    t1 = rdtsc();
+    while ((inb(IO_PPI) & PPI_T2OUT) == 0) {
+        if (++ loops > 10000000) {
+            return 0;
+        }
+    }
+    t2 = rdtsc();
+
+    // cycles per CAL_MS, scaled to cycles per ms
+    t2 -= t1;
+    do_div(t2, CAL_MS);
+    return (t2 >> 32) ? 0 : (uint32_t)t2;
+}
+
+/* *
+ * calc_mult_shift - find the largest @shift <= 32 for which
+ * mult = (@from_ratio << shift) / @to_ratio fits in 32 bits
+ * */
+static void
+calc_mult_shift(uint32_t *mult, uint32_t *shift, uint32_t from_ratio, uint32_t to_ratio) {
+    uint32_t sh;
+    for (sh = 32; sh > 0; sh --) {
+        uint64_t tmp = (uint64_t)from_ratio << sh;
+        tmp += to_ratio / 2;
+        do_div(tmp, to_ratio);
+        if ((tmp >> 32) == 0) {
+            *mult = (uint32_t)tmp, *shift = sh;
+            return;
+        }
+    }
+    *mult = 0, *shift = 0;
+}
+
+/* *
+ * tsc_init - calibrate the TSC against the PIT and set up the conversions,
+ * must run with interrupts disabled
+ * */
+void
+tsc_init(void) {
+    uint32_t edx = 0, khz, lo = 0, hi = 0;
+    int i;
+    if (cpuid_supported()) {
+        cpuid(1, NULL, NULL, NULL, &edx);
+    }
+    if (edx & CPUID_FEAT_TSC) {
+        for (i = 0; i < CAL_TRIES; i ++) {
+            if ((khz = pit_calibrate_tsc()) == 0) {
+                lo = 0;
+                break;
+            }
+            lo = (i == 0 || khz < lo) ? khz : lo;
+            hi = (i == 0 || khz > hi) ? khz : hi;
+        }
+        // the runs must agree within 1%
+        if (lo != 0 && hi - lo <= lo / 100) {
+            tsc_khz = lo;
+            tsc_reliable = 1;
+        }
+    }
+    if (tsc_reliable) {
+        // one cycle is 10^6 / tsc_khz ns
+        calc_mult_shift(&cyc2ns_mult, &cyc2ns_shift, 1000000, tsc_khz);
+        calc_mult_shift(&ns2cyc_mult, &ns2cyc_shift, tsc_khz, 1000000);
+        tsc_base = rdtsc();
+        cprintf("tsc: %u.%03u MHz\n", tsc_khz / 1000, tsc_khz % 1000);
+    }
+    else {
+        cprintf("tsc: unreliable, using the PIT for clock_ns\n");
+    }
+}
+
+/* cycles_to_ns - convert a TSC cycle count into ns, 0 without a usable TSC */
+uint64_t
+cycles_to_ns(uint64_t cycles) {
+    return mul_u64_u32_shr(cycles, cyc2ns_mult, cyc2ns_shift);
+}
+
+/* ns_to_cycles - convert ns into TSC cycles, 0 without a usable TSC */
+uint64_t
+ns_to_cycles(uint64_t ns) {
+    return mul_u64_u32_shr(ns, ns2cyc_mult, ns2cyc_shift);
+}
+
+/* *
+ * pit_clock_ns - ns since clock_init, from ticks and a latched read of the
+ * count left in the current tick
+ * */
+static uint64_t
+pit_clock_ns(void) {
+    uint64_t ns;
+    size_t t;
+    uint32_t count;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        do {
+            t = ticks;
+            outb(TIMER_MODE, TIMER_SEL0 | TIMER_LATCH);
+            count = inb(IO_TIMER1);
+            count |= inb(IO_TIMER1) << 8;
+        } while (t != ticks);
+        ns = (uint64_t)(TIMER_DIV(HZ) - count) * NSEC_PER_SEC;
+        do_div(ns, TIMER_FREQ);
+        ns += (uint64_t)t * NSEC_PER_TICK;
+        // a tick pending while interrupts are off would make time go back
+        if (ns < last_pit_ns) {
+            ns = last_pit_ns;
+        }
+        last_pit_ns = ns;
+    }
+    local_intr_restore(intr_flag);
+    return ns;
+}
+
+/* clock_ns - monotonic ns since tsc_init (since clock_init on the PIT fallback) */
+uint64_t
+clock_ns(void) {
+    if (tsc_reliable) {
+        return cycles_to_ns(rdtsc() - tsc_base);
+    }
+    return pit_clock_ns();
+}
+
+/* *
+ * Tickless operation.
+ *
+ * With a local APIC, the timer interrupt is no longer periodic: 'ticks' is
+ * derived from clock_ns() whenever the interrupt fires, and the one-shot
+ * LAPIC timer is armed for the earliest tick anybody asked for with
+ * clock_request_tick(). Requests are consumed by each timer interrupt, so
+ * users ask again from their tick handler. An idle CPU with nothing due
+ * sleeps in hlt without taking timer interrupts at all.
+ * Without a LAPIC the 8253 keeps ticking at HZ and requests are ignored.
+ * */
+static bool tickless = 0;
+static uint64_t tick_base_ns;                   // clock_ns() at tick 0
+static size_t next_tick_req = (size_t)-1;       // earliest requested tick, -1 for none
+static uint32_t ns2lapic_mult, ns2lapic_shift;
+
+// statistics, see clock_print_stats()
+static size_t timer_irqs, idle_wakeups;
+static uint64_t idle_ns, idle_since;
+
+/* clock_program_next - arm the one-shot timer for tick @next_tick_req */
+static void
+clock_program_next(void) {
+    uint64_t now = clock_ns() - tick_base_ns;
+    uint64_t deadline = (uint64_t)next_tick_req * NSEC_PER_TICK;
+    uint64_t delta = (deadline > now) ? deadline - now : 1000;
+    // round up so the interrupt never comes before the deadline
+    uint64_t count = mul_u64_u32_shr(delta, ns2lapic_mult, ns2lapic_shift) + 1;
+    lapic_timer_oneshot((count >> 32) ? 0xFFFFFFFF : (uint32_t)count);
+}
+
+/* clock_request_tick - make sure a timer interrupt happens at tick @tick */
+void
+clock_request_tick(size_t tick) {
+    bool intr_flag;
+    if (!tickless) {
+        return;
+    }
+    local_intr_save(intr_flag);
+    {
+        if (tick < next_tick_req) {
+            next_tick_req = tick;
+            clock_program_next();
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* *
+ * clock_ticks - the current tick. When tickless, 'ticks' is only brought up
+ * to date by timer interrupts, so it may lag behind after a long idle
+ * period; this reads the clock instead.
+ * */
+size_t
+clock_ticks(void) {
+    if (tickless) {
+        uint64_t t = clock_ns() - tick_base_ns;
+        do_div(t, NSEC_PER_TICK);
+        if ((size_t)t > ticks) {
+            ticks = (size_t)t;
+        }
+    }
+    return ticks;
+}
+
+/* *
+ * clock_tick - called first thing by the timer interrupt: bring 'ticks'
+ * up to date and drop the requests that are now served
+ * */
+static void
+clock_tick(void) {
+    timer_irqs ++;
+    if (!tickless) {
+        ticks ++;
+        return;
+    }
+    clock_ticks();
+    next_tick_req = (size_t)-1;
+}
+
+static bool
+clock_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    // print_ticks() is a kernel timer now, see clock_init()
+    clock_tick();
+    kprof_tick(tf);
+    timer_tick();
+    return 1;
+}
+
+/* *
+ * cpu_idle - what the boot CPU does once initialization is over: sleep in
+ * hlt until the next interrupt, accounting the time spent there
+ * */
+void
+cpu_idle(void) {
+    while (1) {
+        // sti only takes effect after hlt, no wakeup is lost in between
+        intr_disable();
+        if (softirq_pending()) {
+            do_softirq();
+            intr_enable();
+            continue;
+        }
+        idle_since = clock_ns();
+        asm volatile ("sti; hlt");
+        idle_ns += clock_ns() - idle_since;
+        idle_wakeups ++;
+    }
+}
+
+/* clock_print_stats - print the timer interrupt and idle statistics */
+void
+clock_print_stats(void) {
+    uint64_t now = clock_ns(), idle = idle_ns;
+    uint32_t pct = 0;
+    if (now != 0) {
+        uint64_t tmp = idle * 100;
+        // scale both down so the divisor fits do_div
+        while ((now >> 32) != 0) {
+            now >>= 1, tmp >>= 1;
+        }
+        do_div(tmp, (uint32_t)now);
+        pct = (uint32_t)tmp;
+    }
+    do_div(idle, 1000000);
+    cprintf("clock: %s, %u ticks, %u timer interrupts\n",
+            tickless ? "tickless lapic" : "periodic 8253", ticks, timer_irqs);
+    cprintf("idle: %u wakeups, %llu ms idle (%u%%)\n", idle_wakeups, idle, pct);
+}
+
+#define TICK_NUM 100
+
+static struct timer print_ticks_timer;
+
+static void print_ticks(void *data) {
+    cprintf("%d ticks\n",TICK_NUM);
+#ifdef DEBUG_GRADE
+    cprintf("End of Test.\n");
+    panic("EOT: kernel seems ok.");
+#endif
+    timer_add(&print_ticks_timer, print_ticks_timer.expires + TICK_NUM);
+}
+
+/* *
+ * clock_init - start the tick: the one-shot LAPIC timer if lapic_init found
+ * one, else the 8253 interrupting 100 times per second on IRQ_TIMER.
  * */
 void
 clock_init(void) {
     // set 8253 timer-chip
     outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-    outb(IO_TIMER1, TIMER_DIV(100) % 256);
-    outb(IO_TIMER1, TIMER_DIV(100) / 256);
+    outb(IO_TIMER1, TIMER_DIV(HZ) % 256);
+    outb(IO_TIMER1, TIMER_DIV(HZ) / 256);
 
     // initialize time counter 'ticks' to zero
     ticks = 0;
 
     cprintf("++ setup timer interrupts\n");
-    pic_enable(IRQ_TIMER);
+    timer_setup(&print_ticks_timer, print_ticks, NULL);
+    timer_add(&print_ticks_timer, TICK_NUM);
+    if (lapic_present) {
+        calc_mult_shift(&ns2lapic_mult, &ns2lapic_shift, lapic_timer_khz, 1000000);
+        tick_base_ns = clock_ns();
+        tickless = 1;
+        // the 8253 stays masked, vector IRQ_OFFSET + IRQ_TIMER is the lapic timer
+        irq_set_chip(IRQ_TIMER, &lapic_chip);
+        request_irq(IRQ_TIMER, clock_irq, 0, "timer", NULL);
+        clock_request_tick(1);
+        return;
+    }
+    request_irq(IRQ_TIMER, clock_irq, 0, "timer", NULL);
 }
 
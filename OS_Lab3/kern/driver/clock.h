@@ -4,8 +4,19 @@
 #include <defs.h>
 
 extern volatile size_t ticks;
+extern uint32_t tsc_khz;
+extern bool tsc_reliable;
 
 void clock_init(void);
+void tsc_init(void);
+size_t clock_ticks(void);
+void clock_request_tick(size_t tick);
+void cpu_idle(void) __attribute__((noreturn));
+void clock_print_stats(void);
+
+uint64_t clock_ns(void);
+uint64_t cycles_to_ns(uint64_t cycles);
+uint64_t ns_to_cycles(uint64_t ns);
 
 #endif /* !__KERN_DRIVER_CLOCK_H__ */
 
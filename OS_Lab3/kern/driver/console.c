@@ -7,6 +7,8 @@
 #include <trap.h>
 #include <memlayout.h>
 #include <sync.h>
+#include <irq.h>
+#include <softirq.h>
 
 /* stupid I/O delay routine necessitated by historical PC design flaws */
 static void
@@ -105,10 +107,6 @@ serial_init(void) {
     serial_exists = (inb(COM1 + COM_LSR) != 0xFF);
     (void) inb(COM1+COM_IIR);
     (void) inb(COM1+COM_RX);
-
-    if (serial_exists) {
-        pic_enable(IRQ_COM1);
-    }
 }
 
 static void
@@ -408,18 +406,6 @@ static void
 kbd_init(void) {
     // drain the kbd buffer
     kbd_intr();
-    pic_enable(IRQ_KBD);
-}
-
-/* cons_init - initializes the console devices */
-void
-cons_init(void) {
-    cga_init();
-    serial_init();
-    kbd_init();
-    if (!serial_exists) {
-        cprintf("serial port does not exist!!\n");
-    }
 }
 
 /* cons_putc - print a single character @c to console devices */
@@ -435,6 +421,21 @@ cons_putc(int c) {
     local_intr_restore(intr_flag);
 }
 
+/* cons_puts - print @n characters of @str to console devices with one interrupt-off section */
+void
+cons_puts(const char *str, size_t n) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        for (; n > 0; n --, str ++) {
+            lpt_putc((unsigned char)*str);
+            cga_putc((unsigned char)*str);
+            serial_putc((unsigned char)*str);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
 /* *
  * cons_getc - return the next input character from console,
  * or 0 if none waiting.
@@ -463,3 +464,70 @@ cons_getc(void) {
     return c;
 }
 
+/* *
+ * Console input echo. The hard irq drains the characters the device has
+ * into cons_echo, remembering which irq brought them in, and the printing
+ * is left to CONSOLE_SOFTIRQ. The indexes run freely, the ring is full
+ * when they are CONS_ECHO_SIZE apart; characters that do not fit are
+ * dropped.
+ * */
+#define CONS_ECHO_SIZE          64
+#define CONS_ECHO_BUDGET        16
+
+static struct {
+    char c;
+    bool kbd;
+} cons_echo[CONS_ECHO_SIZE];
+static volatile uint32_t cons_echo_rpos, cons_echo_wpos;
+static size_t cons_echo_dropped;
+
+static bool
+cons_echo_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    bool kbd = (irq == IRQ_KBD);
+    int c;
+    while ((c = cons_getc()) != 0) {
+        if (cons_echo_wpos - cons_echo_rpos == CONS_ECHO_SIZE) {
+            cons_echo_dropped ++;
+            continue;
+        }
+        cons_echo[cons_echo_wpos % CONS_ECHO_SIZE].c = c;
+        cons_echo[cons_echo_wpos % CONS_ECHO_SIZE].kbd = kbd;
+        cons_echo_wpos ++;
+    }
+    raise_softirq(CONSOLE_SOFTIRQ);
+    return 1;
+}
+
+static bool
+cons_echo_softirq(int budget) {
+    while (cons_echo_rpos != cons_echo_wpos) {
+        if (budget -- == 0) {
+            return 1;
+        }
+        char c = cons_echo[cons_echo_rpos % CONS_ECHO_SIZE].c;
+        bool kbd = cons_echo[cons_echo_rpos % CONS_ECHO_SIZE].kbd;
+        cons_echo_rpos ++;
+        cprintf(kbd ? "kbd [%03d] %c\n" : "serial [%03d] %c\n", c, c);
+    }
+    if (cons_echo_dropped != 0) {
+        cprintf("console: %u characters dropped\n", cons_echo_dropped);
+        cons_echo_dropped = 0;
+    }
+    return 0;
+}
+
+/* cons_init - initializes the console devices */
+void
+cons_init(void) {
+    cga_init();
+    serial_init();
+    kbd_init();
+    open_softirq(CONSOLE_SOFTIRQ, cons_echo_softirq, CONS_ECHO_BUDGET);
+    if (serial_exists) {
+        request_irq(IRQ_COM1, cons_echo_irq, 0, "serial", NULL);
+    }
+    request_irq(IRQ_KBD, cons_echo_irq, 0, "kbd", NULL);
+    if (!serial_exists) {
+        cprintf("serial port does not exist!!\n");
+    }
+}
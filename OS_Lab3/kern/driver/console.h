@@ -3,6 +3,7 @@
 
 void cons_init(void);
 void cons_putc(int c);
+void cons_puts(const char *str, size_t n);
 int cons_getc(void);
 void serial_intr(void);
 void kbd_intr(void);
@@ -0,0 +1,100 @@
+#include <defs.h>
+#include <x86.h>
+#include <mmu.h>
+#include <sync.h>
+#include <stdio.h>
+#include <assert.h>
+#include <fpu.h>
+#include <smp.h>
+
+/* *
+ * Kernel use of the x87/SSE register file.
+ *
+ * The kernel itself is built without floating point, so the FPU is kept
+ * disabled with CR0.TS set: any stray FPU/SSE instruction traps with
+ * T_DEVICE instead of silently corrupting state. Code that wants the SSE
+ * registers (clear_page, copy_page, ...) brackets itself with
+ * kernel_fpu_begin()/kernel_fpu_end().
+ *
+ * The register file only holds live data while some kernel_fpu section
+ * is active, so fxsave is needed only when a section nests inside another
+ * one (e.g. an exception raised in the middle of a copy). The outermost
+ * section just clears CR0.TS and sets it again when done. Interrupts are
+ * disabled for the duration of a section, which is short (one page).
+ * The nesting state is per cpu, in struct cpu.
+ * */
+
+bool cpu_has_sse2 = 0;
+
+static inline void
+stts(void) {
+    lcr0(rcr0() | CR0_TS);
+}
+
+/* cpuid_supported - test whether the ID flag in eflags can be toggled */
+bool
+cpuid_supported(void) {
+    uint32_t eflags = read_eflags();
+    write_eflags(eflags ^ FL_ID);
+    bool ret = ((read_eflags() ^ eflags) & FL_ID) != 0;
+    write_eflags(eflags);
+    return ret;
+}
+
+/* fpu_init - detect fxsr/sse2 support and put the FPU in its idle (trapping) state */
+void
+fpu_init(void) {
+    uint32_t edx = 0;
+    if (cpuid_supported()) {
+        cpuid(1, NULL, NULL, NULL, &edx);
+    }
+
+    uint32_t need = CPUID_FEAT_FXSR | CPUID_FEAT_SSE | CPUID_FEAT_SSE2;
+    cpu_has_sse2 = ((edx & need) == need);
+    fpu_init_cpu();
+
+    cprintf("fpu: %s page operations\n", cpu_has_sse2 ? "sse2" : "scalar");
+}
+
+/* fpu_init_cpu - set up the FPU of the calling cpu as detected by fpu_init */
+void
+fpu_init_cpu(void) {
+    lcr0((rcr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    asm volatile ("fninit");
+    if (cpu_has_sse2) {
+        lcr4(rcr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    }
+    stts();
+}
+
+/* kernel_fpu_begin - make the SSE registers usable by the kernel, saving them if in use */
+void
+kernel_fpu_begin(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    struct cpu *c = this_cpu();
+    assert(c->fpu_depth < FPU_NEST_MAX);
+    if (c->fpu_depth > 0) {
+        fxsave(&c->fpu_save[c->fpu_depth - 1]);
+    }
+    else {
+        clts();
+    }
+    c->fpu_intr_flag[c->fpu_depth ++] = intr_flag;
+}
+
+/* kernel_fpu_end - give back the SSE registers taken by kernel_fpu_begin */
+void
+kernel_fpu_end(void) {
+    struct cpu *c = this_cpu();
+    assert(c->fpu_depth > 0);
+    bool intr_flag = c->fpu_intr_flag[-- c->fpu_depth];
+    if (c->fpu_depth > 0) {
+        fxrstor(&c->fpu_save[c->fpu_depth - 1]);
+    }
+    else {
+        stts();
+    }
+    local_intr_restore(intr_flag);
+}
+
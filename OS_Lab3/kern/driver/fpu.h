@@ -0,0 +1,22 @@
+#ifndef __KERN_DRIVER_FPU_H__
+#define __KERN_DRIVER_FPU_H__
+
+#include <defs.h>
+
+#define FPU_NEST_MAX            4
+
+struct fxsave_area {
+    uint8_t data[512];
+} __attribute__((aligned(16)));
+
+extern bool cpu_has_sse2;
+
+bool cpuid_supported(void);
+void fpu_init(void);
+void fpu_init_cpu(void);
+
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
+
+#endif /* !__KERN_DRIVER_FPU_H__ */
+
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <trap.h>
 #include <picirq.h>
+#include <irq.h>
 #include <fs.h>
 #include <ide.h>
 #include <x86.h>
@@ -75,6 +76,12 @@ ide_wait_ready(unsigned short iobase, bool check_error) {
     return 0;
 }
 
+/* ide_irq - transfers are polled, the interrupt carries no work */
+static bool
+ide_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    return 1;
+}
+
 void
 ide_init(void) {
     static_assert((SECTSIZE % 4) == 0);
@@ -137,8 +144,8 @@ ide_init(void) {
     }
 
     // enable ide interrupt
-    pic_enable(IRQ_IDE1);
-    pic_enable(IRQ_IDE2);
+    request_irq(IRQ_IDE1, ide_irq, 0, "ide1", NULL);
+    request_irq(IRQ_IDE2, ide_irq, 0, "ide2", NULL);
 }
 
 bool
@@ -0,0 +1,114 @@
+#include <defs.h>
+#include <stdio.h>
+#include <trap.h>
+#include <pmm.h>
+#include <acpi.h>
+#include <lapic.h>
+#include <picirq.h>
+#include <ioapic.h>
+
+/* *
+ * I/O APIC, found through the ACPI MADT.
+ *
+ * The registers are reached indirectly: write the register index to
+ * IOREGSEL, then access IOWIN. Each redirection entry is 64 bits, the low
+ * word has the vector and the delivery mode, the high word the local APIC
+ * id of the destination. ISA IRQ n is delivered as vector IRQ_OFFSET + n,
+ * as with the 8259A, so trap_dispatch does not care who routed it; the
+ * difference is that the handler has to send the local APIC an EOI.
+ * */
+
+#define IOREGSEL            0x00                // register select, in words
+#define IOWIN               0x04                // data window, in words
+
+#define IOAPIC_ID           0x00
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL(n)    (0x10 + 2 * (n))
+
+#define RED_MASKED          0x00010000          // interrupt masked
+#define RED_LEVEL           0x00008000          // level triggered (else edge)
+#define RED_ACTIVELOW       0x00002000          // active low (else high)
+#define RED_LOGICAL         0x00000800          // logical destination (else physical)
+
+bool ioapic_present = 0;
+
+static volatile uint32_t *ioapic;
+static uint32_t ioapic_nredir;
+
+static inline uint32_t
+ioapic_read(uint32_t reg) {
+    ioapic[IOREGSEL] = reg;
+    return ioapic[IOWIN];
+}
+
+static inline void
+ioapic_write(uint32_t reg, uint32_t val) {
+    ioapic[IOREGSEL] = reg;
+    ioapic[IOWIN] = val;
+}
+
+/* *
+ * ioapic_init - map the IOAPIC the MADT reported and mask all its inputs,
+ * then hand the IRQs enabled so far over from the 8259A. The IOAPIC only
+ * delivers to an enabled local APIC, so without one nothing changes.
+ * */
+void
+ioapic_init(void) {
+    if (!acpi_madt_found || acpi_ioapic_addr == 0 || !lapic_present) {
+        cprintf("ioapic: not used, irqs stay on the 8259A\n");
+        return;
+    }
+    ioapic = mmio_map_region(acpi_ioapic_addr, PGSIZE);
+    ioapic_nredir = ((ioapic_read(IOAPIC_VER) >> 16) & 0xFF) + 1;
+
+    uint32_t i;
+    for (i = 0; i < ioapic_nredir; i ++) {
+        ioapic_write(IOAPIC_REDTBL(i), RED_MASKED | (IRQ_OFFSET + i));
+        ioapic_write(IOAPIC_REDTBL(i) + 1, 0);
+    }
+    ioapic_present = 1;
+    cprintf("ioapic: id %d, %d inputs from gsi %d\n",
+            ioapic_read(IOAPIC_ID) >> 24, ioapic_nredir, acpi_ioapic_gsi_base);
+    pic_route_ioapic();
+}
+
+/* ioapic_pin - the redirection entry of ISA @irq, -1 if it is not on this IOAPIC */
+static int
+ioapic_pin(unsigned int irq, uint16_t *flags) {
+    uint32_t gsi = acpi_irq_to_gsi(irq, flags);
+    if (gsi < acpi_ioapic_gsi_base || gsi - acpi_ioapic_gsi_base >= ioapic_nredir) {
+        return -1;
+    }
+    return gsi - acpi_ioapic_gsi_base;
+}
+
+/* ioapic_enable - deliver ISA @irq as vector IRQ_OFFSET + @irq to local APIC @apicid */
+void
+ioapic_enable(unsigned int irq, uint32_t apicid) {
+    uint16_t flags;
+    int pin = ioapic_pin(irq, &flags);
+    if (pin < 0) {
+        cprintf("ioapic: irq %d is not routed\n", irq);
+        return;
+    }
+    // ISA irqs are edge triggered and active high unless overridden
+    uint32_t low = IRQ_OFFSET + irq;
+    if ((flags & ACPI_IRQ_POLARITY) == ACPI_IRQ_ACTIVE_LOW) {
+        low |= RED_ACTIVELOW;
+    }
+    if ((flags & ACPI_IRQ_TRIGGER) == ACPI_IRQ_LEVEL) {
+        low |= RED_LEVEL;
+    }
+    ioapic_write(IOAPIC_REDTBL(pin) + 1, apicid << 24);
+    ioapic_write(IOAPIC_REDTBL(pin), low);
+}
+
+/* ioapic_disable - mask ISA @irq */
+void
+ioapic_disable(unsigned int irq) {
+    uint16_t flags;
+    int pin = ioapic_pin(irq, &flags);
+    if (pin >= 0) {
+        ioapic_write(IOAPIC_REDTBL(pin), ioapic_read(IOAPIC_REDTBL(pin)) | RED_MASKED);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef __KERN_DRIVER_IOAPIC_H__
+#define __KERN_DRIVER_IOAPIC_H__
+
+#include <defs.h>
+
+extern bool ioapic_present;
+
+void ioapic_init(void);
+void ioapic_enable(unsigned int irq, uint32_t apicid);
+void ioapic_disable(unsigned int irq);
+
+#endif /* !__KERN_DRIVER_IOAPIC_H__ */
+
@@ -0,0 +1,248 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <trap.h>
+#include <pmm.h>
+#include <fpu.h>
+#include <clock.h>
+#include <irq.h>
+#include <lapic.h>
+
+/* *
+ * Local APIC, used for its timer and for inter-processor interrupts.
+ *
+ * Device IRQs come from the IOAPIC (see ioapic.c) or, without one, from
+ * the 8259A pair through LINT0 (virtual wire mode, as left by the BIOS),
+ * so only the timer, error and spurious vectors are set up here. The
+ * timer runs in one-shot mode on vector IRQ_OFFSET + IRQ_TIMER, and
+ * clock.c reprograms it for every deadline.
+ * Only the boot cpu runs the timer; the other cpus get their local APIC
+ * enabled with LINT0/1 and the timer masked (lapic_init_ap).
+ * */
+
+#define MSR_APIC_BASE       0x1B                // IA32_APIC_BASE
+#define APIC_BASE_ENABLE    0x800               // global enable
+#define APIC_BASE_ADDR      0xFFFFF000
+
+// register offsets, in bytes
+#define LAPIC_ID            0x020               // ID
+#define LAPIC_VER           0x030               // version
+#define LAPIC_TPR           0x080               // task priority
+#define LAPIC_EOI           0x0B0               // EOI
+#define LAPIC_SVR           0x0F0               // spurious interrupt vector
+#define SVR_ENABLE          0x100               // unit enable
+#define LAPIC_ESR           0x280               // error status
+#define LAPIC_ICRLO         0x300               // interrupt command
+#define ICR_INIT            0x00000500          // INIT/RESET
+#define ICR_STARTUP         0x00000600          // startup IPI
+#define ICR_DELIVS          0x00001000          // delivery status
+#define ICR_ASSERT          0x00004000          // assert interrupt (vs deassert)
+#define ICR_LEVEL           0x00008000          // level triggered
+#define LAPIC_ICRHI         0x310               // interrupt command [63:32], destination
+#define LAPIC_TIMER         0x320               // local vector table 0 (timer)
+#define LVT_MASKED          0x10000             // interrupt masked
+#define LVT_ONESHOT         0x00000             // timer: one-shot mode
+#define LAPIC_LINT0         0x350               // local vector table 1 (LINT0)
+#define LAPIC_LINT1         0x360               // local vector table 2 (LINT1)
+#define LAPIC_ERROR         0x370               // local vector table 3 (error)
+#define LAPIC_TICR          0x380               // timer initial count
+#define LAPIC_TCCR          0x390               // timer current count
+#define LAPIC_TDCR          0x3E0               // timer divide configuration
+#define TDCR_X16            0x3                 // divide counts by 16
+
+#define CAL_MS              10
+
+#define IO_RTC              0x70                // cmos index port
+#define CMOS_SHUTDOWN       0x0F                // shutdown status byte
+#define SHUTDOWN_WARM_JMP   0x0A                // warm reset: far jump through 40:67
+#define WARM_RESET_VECTOR   0x467
+
+bool lapic_present = 0;
+uint32_t lapic_timer_khz = 0;                   // timer counts per ms
+
+static volatile uint32_t *lapic;
+
+static inline uint32_t
+lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void
+lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+    lapic[LAPIC_ID / 4];                        // wait for write to finish, by reading
+}
+
+/* *
+ * lapic_calibrate - count timer decrements over CAL_MS measured with the
+ * TSC, the timer is left stopped
+ * */
+static uint32_t
+lapic_calibrate(void) {
+    uint64_t end = rdtsc() + ns_to_cycles(CAL_MS * 1000000);
+    lapic_write(LAPIC_TIMER, LVT_MASKED | (IRQ_OFFSET + IRQ_TIMER));
+    lapic_write(LAPIC_TICR, 0xFFFFFFFF);
+    while (rdtsc() < end)
+        /* do nothing */;
+    uint32_t count = 0xFFFFFFFF - lapic_read(LAPIC_TCCR);
+    lapic_write(LAPIC_TICR, 0);
+    return count / CAL_MS;
+}
+
+static void
+lapic_ack(unsigned int irq) {
+    lapic_eoi();
+}
+
+// the irq_chip of the local APIC vectors, always enabled
+struct irq_chip lapic_chip = {
+    .name = "lapic",
+    .ack = lapic_ack,
+};
+
+static bool
+lapic_error_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    cprintf("lapic: error 0x%x\n", lapic_error());
+    return 1;
+}
+
+/* spurious interrupts are not acknowledged, the line has no chip */
+static bool
+lapic_spurious_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    return 1;
+}
+
+/* lapic_enable - enable the unit, set the spurious and error vectors */
+static void
+lapic_enable(void) {
+    lapic_write(LAPIC_SVR, SVR_ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
+    lapic_write(LAPIC_ERROR, IRQ_OFFSET + IRQ_ERROR);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/* *
+ * lapic_init - map and enable the local APIC and calibrate its timer.
+ * The timer is only usable against a calibrated TSC; without one
+ * lapic_present stays 0 and clock.c keeps the 8253.
+ * */
+void
+lapic_init(void) {
+    uint32_t edx = 0;
+    if (cpuid_supported()) {
+        cpuid(1, NULL, NULL, NULL, &edx);
+    }
+    if (!(edx & CPUID_FEAT_APIC) || !(edx & CPUID_FEAT_MSR) || !tsc_reliable) {
+        cprintf("lapic: not used\n");
+        return;
+    }
+
+    uint64_t base = rdmsr(MSR_APIC_BASE);
+    if (!(base & APIC_BASE_ENABLE)) {
+        wrmsr(MSR_APIC_BASE, base | APIC_BASE_ENABLE);
+    }
+    lapic = mmio_map_region((uint32_t)base & APIC_BASE_ADDR, PGSIZE);
+
+    irq_set_chip(IRQ_ERROR, &lapic_chip);
+    request_irq(IRQ_ERROR, lapic_error_irq, 0, "lapic-error", NULL);
+    request_irq(IRQ_SPURIOUS, lapic_spurious_irq, 0, "spurious", NULL);
+    lapic_enable();
+
+    lapic_write(LAPIC_TDCR, TDCR_X16);
+    if ((lapic_timer_khz = lapic_calibrate()) == 0) {
+        cprintf("lapic: timer does not count, not used\n");
+        return;
+    }
+    lapic_write(LAPIC_TIMER, LVT_ONESHOT | (IRQ_OFFSET + IRQ_TIMER));
+    lapic_present = 1;
+    cprintf("lapic: id %d version 0x%x, timer %u kHz\n",
+            lapic_id(), lapic_read(LAPIC_VER) & 0xFF, lapic_timer_khz);
+}
+
+/* lapic_init_ap - enable the local APIC of an application processor, it takes no device irqs */
+void
+lapic_init_ap(void) {
+    lapic_enable();
+    lapic_write(LAPIC_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LINT1, LVT_MASKED);
+    lapic_write(LAPIC_TIMER, LVT_MASKED | (IRQ_OFFSET + IRQ_TIMER));
+}
+
+static void
+udelay(uint32_t us) {
+    uint64_t end = rdtsc() + ns_to_cycles((uint64_t)us * 1000);
+    while (rdtsc() < end) {
+        pause();
+    }
+}
+
+static void
+lapic_icr(uint32_t apicid, uint32_t cmd) {
+    lapic_write(LAPIC_ICRHI, apicid << 24);
+    lapic_write(LAPIC_ICRLO, cmd);
+    while (lapic_read(LAPIC_ICRLO) & ICR_DELIVS) {
+        pause();
+    }
+}
+
+/* *
+ * lapic_startap - start the processor @apicid running real mode code at
+ * physical @addr (page aligned, below 1MB) with the universal INIT-SIPI-SIPI
+ * sequence. The warm reset vector is set too, for processors that take
+ * the INIT as a reset through the BIOS.
+ * */
+void
+lapic_startap(uint32_t apicid, uintptr_t addr) {
+    outb(IO_RTC, CMOS_SHUTDOWN);
+    outb(IO_RTC + 1, SHUTDOWN_WARM_JMP);
+    uint16_t *wrv = (uint16_t *)(KERNBASE + WARM_RESET_VECTOR);
+    wrv[0] = 0;
+    wrv[1] = addr >> 4;
+
+    lapic_icr(apicid, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    udelay(200);
+    lapic_icr(apicid, ICR_INIT | ICR_LEVEL);
+    udelay(10000);
+
+    int i;
+    for (i = 0; i < 2; i ++) {
+        lapic_icr(apicid, ICR_STARTUP | (addr >> 12));
+        udelay(200);
+    }
+}
+
+/* lapic_send_ipi - send fixed interrupt @vector to the cpu with local APIC id @apicid */
+void
+lapic_send_ipi(uint32_t apicid, uint32_t vector) {
+    lapic_icr(apicid, vector);
+}
+
+/* lapic_id - the local APIC id of this cpu */
+uint32_t
+lapic_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/* lapic_eoi - acknowledge the interrupt being serviced */
+void
+lapic_eoi(void) {
+    if (lapic_present) {
+        lapic_write(LAPIC_EOI, 0);
+    }
+}
+
+/* lapic_timer_oneshot - fire the timer interrupt once after @count counts, 0 stops it */
+void
+lapic_timer_oneshot(uint32_t count) {
+    lapic_write(LAPIC_TICR, count);
+}
+
+/* lapic_error - read and clear the error status register */
+uint32_t
+lapic_error(void) {
+    lapic_write(LAPIC_ESR, 0);
+    return lapic_read(LAPIC_ESR);
+}
+
@@ -0,0 +1,22 @@
+#ifndef __KERN_DRIVER_LAPIC_H__
+#define __KERN_DRIVER_LAPIC_H__
+
+#include <defs.h>
+
+struct irq_chip;
+
+extern bool lapic_present;
+extern struct irq_chip lapic_chip;
+extern uint32_t lapic_timer_khz;
+
+void lapic_init(void);
+void lapic_init_ap(void);
+void lapic_startap(uint32_t apicid, uintptr_t addr);
+void lapic_send_ipi(uint32_t apicid, uint32_t vector);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+void lapic_timer_oneshot(uint32_t count);
+uint32_t lapic_error(void);
+
+#endif /* !__KERN_DRIVER_LAPIC_H__ */
+
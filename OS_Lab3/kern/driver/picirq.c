@@ -1,5 +1,10 @@
 #include <defs.h>
 #include <x86.h>
+#include <stdio.h>
+#include <trap.h>
+#include <lapic.h>
+#include <ioapic.h>
+#include <irq.h>
 #include <picirq.h>
 
 // I/O Addresses of the two programmable interrupt controllers
@@ -12,6 +17,8 @@
 // Initial IRQ mask has interrupt 2 enabled (for slave 8259A).
 static uint16_t irq_mask = 0xFFFF & ~(1 << IRQ_SLAVE);
 static bool did_init = 0;
+// set once ioapic_init has taken the IRQs over, the 8259A stays masked
+static bool use_ioapic = 0;
 
 static void
 pic_setmask(uint16_t mask) {
@@ -24,9 +31,96 @@ pic_setmask(uint16_t mask) {
 
 void
 pic_enable(unsigned int irq) {
+    if (use_ioapic) {
+        irq_mask &= ~(1 << irq);
+        ioapic_enable(irq, lapic_id());
+        return;
+    }
     pic_setmask(irq_mask & ~(1 << irq));
 }
 
+void
+pic_disable(unsigned int irq) {
+    if (use_ioapic) {
+        irq_mask |= (1 << irq);
+        ioapic_disable(irq);
+        return;
+    }
+    pic_setmask(irq_mask | (1 << irq));
+}
+
+/* *
+ * pic_eoi - acknowledge @irq from its handler. The 8259A runs in automatic
+ * EOI mode and needs nothing; IRQs routed by the IOAPIC are acknowledged
+ * with the memory-mapped EOI register of the local APIC.
+ * */
+void
+pic_eoi(unsigned int irq) {
+    if (use_ioapic) {
+        lapic_eoi();
+    }
+}
+
+// the irq_chip of the ISA irqs, see kern/trap/irq.c
+struct irq_chip pic_chip = {
+    .name = "8259A",
+    .enable = pic_enable,
+    .disable = pic_disable,
+    .ack = pic_eoi,
+};
+
+#define BENCH_ROUNDS        16
+
+/* *
+ * pic_bench - print the cheapest of BENCH_ROUNDS mask updates and EOIs on
+ * either controller, in cycles. Both are paid for every interrupt, the
+ * 8259A with port i/o and the IOAPIC/LAPIC with uncached loads/stores.
+ * Called with interrupts disabled and nothing in service, which makes the
+ * EOIs no-ops and the masked entries stay masked.
+ * */
+static void
+pic_bench(void) {
+    uint64_t t, best[4] = {~0ULL, ~0ULL, ~0ULL, ~0ULL};
+    int i;
+    for (i = 0; i < BENCH_ROUNDS; i ++) {
+        t = rdtsc();
+        outb(IO_PIC1 + 1, irq_mask);
+        outb(IO_PIC2 + 1, irq_mask >> 8);
+        t = rdtsc() - t, best[0] = (t < best[0]) ? t : best[0];
+        t = rdtsc();
+        outb(IO_PIC1, 0x20);                // non-specific EOI
+        t = rdtsc() - t, best[1] = (t < best[1]) ? t : best[1];
+        t = rdtsc();
+        ioapic_disable(IRQ_TIMER);
+        t = rdtsc() - t, best[2] = (t < best[2]) ? t : best[2];
+        t = rdtsc();
+        lapic_eoi();
+        t = rdtsc() - t, best[3] = (t < best[3]) ? t : best[3];
+    }
+    cprintf("irq: mask 8259A %u / ioapic %u cycles, eoi 8259A %u / lapic %u cycles\n",
+            (uint32_t)best[0], (uint32_t)best[2], (uint32_t)best[1], (uint32_t)best[3]);
+}
+
+/* *
+ * pic_route_ioapic - called by ioapic_init: mask the 8259A and enable the
+ * IRQs that were enabled on it on the IOAPIC instead. From now on
+ * pic_enable programs the IOAPIC.
+ * */
+void
+pic_route_ioapic(void) {
+    int irq;
+    pic_bench();
+    outb(IO_PIC1 + 1, 0xFF);
+    outb(IO_PIC2 + 1, 0xFF);
+    use_ioapic = 1;
+    pic_chip.name = "ioapic";
+    for (irq = 0; irq < 16; irq ++) {
+        if (irq != IRQ_SLAVE && !(irq_mask & (1 << irq))) {
+            ioapic_enable(irq, lapic_id());
+        }
+    }
+}
+
 /* pic_init - initialize the 8259A interrupt controllers */
 void
 pic_init(void) {
@@ -1,8 +1,15 @@
 #ifndef __KERN_DRIVER_PICIRQ_H__
 #define __KERN_DRIVER_PICIRQ_H__
 
+struct irq_chip;
+
+extern struct irq_chip pic_chip;
+
 void pic_init(void);
 void pic_enable(unsigned int irq);
+void pic_disable(unsigned int irq);
+void pic_eoi(unsigned int irq);
+void pic_route_ioapic(void);
 
 #define IRQ_OFFSET      32
 
@@ -0,0 +1,251 @@
+#include <defs.h>
+#include <x86.h>
+#include <atomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <trap.h>
+#include <pmm.h>
+#include <fpu.h>
+#include <clock.h>
+#include <acpi.h>
+#include <lapic.h>
+#include <irq.h>
+#include <spinlock.h>
+#include <smp.h>
+
+/* *
+ * Multiprocessor bring-up.
+ *
+ * The processors are the enabled local APICs of the ACPI MADT. The boot
+ * cpu is cpus[0]; smp_init starts the others one at a time with
+ * INIT-SIPI-SIPI at the real mode trampoline kern/init/mpentry.S, which
+ * enters mp_main on the stack left in mpentry_kstack. An application
+ * processor loads its own GDT, TSS and %gs, the shared IDT and its local
+ * APIC, then idles with interrupts enabled. Device irqs, the tick and the
+ * softirqs stay on the boot cpu, the others only take the IPI vector.
+ *
+ * smp_call_function runs a function on every other online cpu, optionally
+ * waiting for all of them; it is how page table changes are shot down
+ * from the TLBs of the other cpus.
+ * */
+
+#define STARTUP_TIMEOUT_MS      100
+
+struct cpu cpus[NCPU];
+int ncpu = 1;
+
+static uint8_t percpu_kstack[NCPU - 1][KSTACKSIZE] __attribute__((aligned(PGSIZE)));
+
+// handed to mpentry.S and mp_main for the cpu being started
+uintptr_t mpentry_kstack;
+uintptr_t mpentry_pgdir;
+static struct cpu * volatile mpentry_cpu;
+
+// the pending cross-cpu call, one at a time
+static struct lockstat call_lockstat = LOCKSTAT_INIT("smp_call");
+static spinlock_t call_lock = SPINLOCK_INIT_STAT("smp_call", &call_lockstat);
+static struct {
+    void (* volatile func)(void *);
+    void * volatile arg;
+    volatile bool wait;                 // pending is cleared after func returns
+    volatile uint32_t pending;          // bit i: cpus[i] has not run it yet
+} call;
+
+/* smp_call_poll - run the pending call if it is for this cpu */
+static void
+smp_call_poll(void) {
+    struct cpu *c = this_cpu();
+    if (test_bit(c->id, &call.pending)) {
+        void (*func)(void *) = call.func;
+        void *arg = call.arg;
+        c->ipis ++;
+        if (call.wait) {
+            func(arg);
+            clear_bit(c->id, &call.pending);
+        }
+        else {
+            clear_bit(c->id, &call.pending);
+            func(arg);
+        }
+    }
+}
+
+static bool
+smp_call_irq(unsigned int irq, struct trapframe *tf, void *dev) {
+    smp_call_poll();
+    return 1;
+}
+
+/* *
+ * smp_call_function - run @func(@arg) on every other online cpu. With
+ * @wait, return when all of them are done; without, as soon as all of
+ * them have started, @arg must then stay valid until @func is done with
+ * it. May be called with interrupts disabled: a cpu waiting for the call
+ * lock keeps serving calls sent to it.
+ * */
+void
+smp_call_function(void (*func)(void *), void *arg, bool wait) {
+    struct cpu *self = this_cpu();
+    int i;
+    if (ncpu <= 1) {
+        return;
+    }
+    while (!spin_trylock(&call_lock)) {
+        smp_call_poll();
+        pause();
+    }
+    call.func = func;
+    call.arg = arg;
+    call.wait = wait;
+    for (i = 0; i < ncpu; i ++) {
+        if (cpus + i != self && cpus[i].online) {
+            set_bit(i, &call.pending);
+        }
+    }
+    for (i = 0; i < ncpu; i ++) {
+        if (test_bit(i, &call.pending)) {
+            lapic_send_ipi(cpus[i].apicid, IRQ_OFFSET + IRQ_IPI);
+        }
+    }
+    while (call.pending != 0) {
+        pause();
+    }
+    spin_unlock(&call_lock);
+}
+
+struct shootdown {
+    uintptr_t cr3;
+    const uintptr_t *la;
+    int n;
+    pde_t * const *pgdir;               // if not NULL, the page tables of each la instead of cr3
+};
+
+static void
+tlb_shootdown_one(void *arg) {
+    struct shootdown *sd = arg;
+    int i;
+    if (sd->pgdir != NULL) {
+        for (i = 0; i < sd->n; i ++) {
+            tlb_flush_local(PADDR(sd->pgdir[i]), sd->la + i, 1);
+        }
+        return;
+    }
+    tlb_flush_local(sd->cr3, sd->la, sd->n);
+}
+
+/* smp_tlb_shootdown - invalidate @la on the other cpus running on @pgdir */
+void
+smp_tlb_shootdown(pde_t *pgdir, uintptr_t la) {
+    smp_tlb_shootdown_batch(pgdir, &la, 1);
+}
+
+/* *
+ * smp_tlb_shootdown_batch - invalidate the @n addresses @la, or the whole
+ * TLB if @la is NULL, on the other cpus running on @pgdir, in one call
+ * */
+void
+smp_tlb_shootdown_batch(pde_t *pgdir, const uintptr_t *la, int n) {
+    if (ncpu > 1) {
+        struct shootdown sd = {PADDR(pgdir), la, n, NULL};
+        smp_call_function(tlb_shootdown_one, &sd, 1);
+    }
+}
+
+/* *
+ * smp_tlb_shootdown_each - invalidate @la[i] on the other cpus running on
+ * @pgdir[i], for each i < @n, in one call
+ * */
+void
+smp_tlb_shootdown_each(pde_t * const *pgdir, const uintptr_t *la, int n) {
+    if (ncpu > 1) {
+        struct shootdown sd = {0, la, n, pgdir};
+        smp_call_function(tlb_shootdown_one, &sd, 1);
+    }
+}
+
+/* mp_main - entered from mpentry.S on the stack of mpentry_cpu, %gs not valid yet */
+void
+mp_main(void) {
+    struct cpu *c = mpentry_cpu;
+    lcr3(boot_cr3);
+    gdt_init_cpu(c);
+    idt_load();
+    fpu_init_cpu();
+    lapic_init_ap();
+    c->online = 1;
+
+    while (1) {
+        asm volatile ("sti; hlt");
+    }
+}
+
+/* *
+ * smp_init - start the application processors. Runs on the boot cpu with
+ * interrupts disabled, after the local APIC is up.
+ * */
+void
+smp_init(void) {
+    extern char mpentry_start[], mpentry_end[];
+    int i;
+
+    cpus[0].apicid = lapic_present ? lapic_id() : 0;
+    cpus[0].online = 1;
+    if (!lapic_present || !acpi_madt_found || acpi_ncpu <= 1) {
+        cprintf("smp: 1 cpu\n");
+        return;
+    }
+
+    irq_set_chip(IRQ_IPI, &lapic_chip);
+    request_irq(IRQ_IPI, smp_call_irq, 0, "ipi", NULL);
+
+    memmove(KADDR(MPENTRY_PADDR), mpentry_start, mpentry_end - mpentry_start);
+
+    // the boot page tables, plus the low 4M mapped 1:1 for the trampoline
+    struct Page *page = alloc_page();
+    assert(page != NULL);
+    pde_t *pgdir = page2kva(page);
+    memcpy(pgdir, boot_pgdir, PGSIZE);
+    pgdir[0] = boot_pgdir[PDX(KERNBASE)];
+    mpentry_pgdir = page2pa(page);
+
+    bool timeout = 0;
+    for (i = 0; i < acpi_ncpu && ncpu < NCPU; i ++) {
+        uint32_t apicid = acpi_lapic_ids[i];
+        if (apicid == cpus[0].apicid) {
+            continue;
+        }
+        struct cpu *c = cpus + ncpu;
+        c->id = ncpu;
+        c->apicid = apicid;
+        c->kstacktop = (uintptr_t)percpu_kstack[ncpu - 1] + KSTACKSIZE;
+        mpentry_kstack = c->kstacktop;
+        mpentry_cpu = c;
+
+        lapic_startap(apicid, MPENTRY_PADDR);
+        uint64_t deadline = clock_ns() + STARTUP_TIMEOUT_MS * 1000000ULL;
+        while (!c->online && clock_ns() < deadline) {
+            pause();
+        }
+        if (!c->online) {
+            // it may still wake up later, leave it the trampoline and page tables
+            cprintf("smp: cpu with apic id %d does not start\n", apicid);
+            timeout = 1;
+            break;
+        }
+        ncpu ++;
+    }
+    if (!timeout) {
+        free_page(page);
+    }
+    cprintf("smp: %d cpu(s) online\n", ncpu);
+}
+
+void
+smp_print_stats(void) {
+    int i;
+    cprintf("cpu  apic  online       ipis\n");
+    for (i = 0; i < ncpu; i ++) {
+        cprintf("%3d  %4d  %6s %10u\n", i, cpus[i].apicid, cpus[i].online ? "yes" : "no", cpus[i].ipis);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __KERN_DRIVER_SMP_H__
+#define __KERN_DRIVER_SMP_H__
+
+#include <defs.h>
+#include <x86.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <fpu.h>
+#include <acpi.h>
+
+#define NCPU                    ACPI_MAX_CPU
+
+/* *
+ * Per-cpu data. The SEG_PERCPU descriptor of each cpu's GDT has the
+ * address of its struct cpu as base and is kept loaded in %gs, so
+ * this_cpu() is a single load of the self pointer at %gs:0.
+ * */
+struct cpu {
+    struct cpu *self;                   // must stay first, see this_cpu()
+    int id;                             // index in cpus[], 0 is the boot cpu
+    uint32_t apicid;                    // local APIC id
+    volatile bool online;               // set by the cpu once it takes ipis
+    uintptr_t kstacktop;                // top of its boot kernel stack
+    struct segdesc gdt[NSEGS];
+    struct pseudodesc gdt_pd;
+    struct taskstate ts;
+    // outermost local_intr_save region, see sync.h
+    uint64_t irqoff_since;
+    const char *irqoff_file;
+    int irqoff_line;
+    // kernel_fpu_begin nesting, see fpu.c
+    int fpu_depth;
+    bool fpu_intr_flag[FPU_NEST_MAX];
+    struct fxsave_area fpu_save[FPU_NEST_MAX];
+    size_t ipis;                        // cross-cpu calls run by this cpu
+};
+
+extern struct cpu cpus[NCPU];
+extern int ncpu;
+
+static inline struct cpu *
+this_cpu(void) {
+    struct cpu *c;
+    asm volatile ("movl %%gs:0, %0" : "=r" (c));
+    return c;
+}
+
+void smp_init(void);
+void smp_call_function(void (*func)(void *), void *arg, bool wait);
+void smp_tlb_shootdown(pde_t *pgdir, uintptr_t la);
+void smp_tlb_shootdown_batch(pde_t *pgdir, const uintptr_t *la, int n);
+void smp_tlb_shootdown_each(pde_t * const *pgdir, const uintptr_t *la, int n);
+void smp_print_stats(void);
+
+#endif /* !__KERN_DRIVER_SMP_H__ */
+
@@ -0,0 +1,363 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <list.h>
+#include <sync.h>
+#include <pmm.h>
+#include <clock.h>
+#include <softirq.h>
+#include <timer.h>
+
+/* *
+ * Hierarchical timing wheel.
+ *
+ * tv1 has one slot per tick for the next 256 ticks. Each of the four tvn
+ * levels has 64 slots, each covering 64 times the range of a slot of the
+ * level below. A timer is put directly in the slot of its expiry time in
+ * the lowest level that reaches it, so adding and deleting are O(1).
+ * Whenever the tv1 index wraps, the current slot of tvn[0] is cascaded:
+ * its timers are re-added, landing in tv1; when tvn[0] wraps too, tvn[1]
+ * cascades, and so on. 8 + 4 * 6 bits cover the whole 32-bit tick range.
+ *
+ * timer_jiffies is the next tick the wheel has to process. It only moves
+ * forward when timers are run; runs of ticks with nothing to process (no
+ * timer due and no non-empty slot to cascade) are skipped in one step,
+ * using timer_next, a lower bound of the next tick with work to do. The
+ * same bound is what the tickless clock is asked to wake up for.
+ *
+ * Timers are run from TIMER_SOFTIRQ. Expired timers are moved from their
+ * slot to timer_expired first, so a run that stops at its budget leaves
+ * the rest there for the next one.
+ * */
+
+#define TIMER_BUDGET            64
+
+#define TVR_BITS                8
+#define TVN_BITS                6
+#define TVR_SIZE                (1 << TVR_BITS)
+#define TVN_SIZE                (1 << TVN_BITS)
+#define TVR_MASK                (TVR_SIZE - 1)
+#define TVN_MASK                (TVN_SIZE - 1)
+#define TVN_LEVELS              4
+
+// the index of the tvn level @n slot for tick @t
+#define TVN_INDEX(t, n)         (((t) >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+// wrap-safe comparison of ticks
+#define time_before(a, b)       ((int)((a) - (b)) < 0)
+
+// the farthest tick that still compares after timer_jiffies, "never"
+#define TIMER_NEVER             (timer_jiffies + 0x7FFFFFFF)
+
+static list_entry_t tv1[TVR_SIZE];
+static list_entry_t tvn[TVN_LEVELS][TVN_SIZE];
+static list_entry_t timer_expired;
+
+static size_t timer_jiffies;            // next tick to process
+static size_t timer_next;               // no work to do before this tick
+static size_t timer_count;              // # of pending timers, expired ones included
+
+/* *
+ * slot_time - the tick at which slot @slot of level @level (-1 for tv1) is
+ * processed next: when it is due for tv1, when it cascades for tvn
+ * */
+static size_t
+slot_time(int level, size_t slot) {
+    if (level < 0) {
+        return timer_jiffies + ((slot - timer_jiffies) & TVR_MASK);
+    }
+    int shift = TVR_BITS + level * TVN_BITS;
+    size_t t = (timer_jiffies & ~((1U << shift) - 1)) & ~(TVN_MASK << shift);
+    t |= slot << shift;
+    if (time_before(t, timer_jiffies)) {
+        // the top level only comes back after the tick counter wraps
+        t = (shift + TVN_BITS < 32) ? t + (1U << (shift + TVN_BITS)) : TIMER_NEVER;
+    }
+    return t;
+}
+
+/* internal_add - put @timer in its slot, return the tick at which that slot is processed */
+static size_t
+internal_add(struct timer *timer) {
+    size_t expires = timer->expires, idx = expires - timer_jiffies;
+    int level;
+    if ((int)idx < 0) {
+        // already expired, run it with the next tick processed
+        expires = timer_jiffies;
+        idx = 0;
+    }
+    if (idx < TVR_SIZE) {
+        list_add_before(tv1 + (expires & TVR_MASK), &(timer->timer_link));
+        return expires;
+    }
+    for (level = 0; level < TVN_LEVELS - 1; level ++) {
+        if (idx < (1U << (TVR_BITS + (level + 1) * TVN_BITS))) {
+            break;
+        }
+    }
+    list_add_before(tvn[level] + TVN_INDEX(expires, level), &(timer->timer_link));
+    return slot_time(level, TVN_INDEX(expires, level));
+}
+
+/* cascade - re-add the timers of the current slot of level @level, return the slot index */
+static size_t
+cascade(int level) {
+    size_t index = TVN_INDEX(timer_jiffies, level);
+    list_entry_t *head = tvn[level] + index, *le;
+    while ((le = list_next(head)) != head) {
+        list_del(le);
+        internal_add(le2timer(le, timer_link));
+    }
+    return index;
+}
+
+/* timer_next_event - compute the earliest tick with a due timer or a non-empty slot to cascade */
+static size_t
+timer_next_event(void) {
+    size_t next = TIMER_NEVER, t;
+    int i, level;
+    for (i = 0; i < TVR_SIZE; i ++) {
+        if (!list_empty(tv1 + ((timer_jiffies + i) & TVR_MASK))) {
+            next = timer_jiffies + i;
+            break;
+        }
+    }
+    for (level = 0; level < TVN_LEVELS; level ++) {
+        for (i = 0; i < TVN_SIZE; i ++) {
+            if (!list_empty(tvn[level] + i)) {
+                t = slot_time(level, i);
+                if (time_before(t, next)) {
+                    next = t;
+                }
+            }
+        }
+    }
+    return next;
+}
+
+/* *
+ * run_timers - process every tick up to and including @now, running the
+ * callbacks of expired timers with the interrupt state of the caller;
+ * stop after @budget callbacks and return whether expired timers are left
+ * */
+static bool
+run_timers(size_t now, int budget) {
+    bool intr_flag, more = 0;
+    local_intr_save(intr_flag);
+    while (1) {
+        while (!list_empty(&timer_expired)) {
+            if (budget -- == 0) {
+                more = 1;
+                goto out;
+            }
+            struct timer *timer = le2timer(list_next(&timer_expired), timer_link);
+            list_del_init(&(timer->timer_link));
+            timer_count --;
+            local_intr_restore(intr_flag);
+            timer->func(timer->data);
+            local_intr_save(intr_flag);
+        }
+        if (time_before(now, timer_jiffies)) {
+            break;
+        }
+        if (timer_count == 0) {
+            timer_jiffies = now + 1;
+            break;
+        }
+        if (time_before(timer_jiffies, timer_next)) {
+            // nothing due and nothing to cascade in between
+            timer_jiffies = time_before(now, timer_next) ? now + 1 : timer_next;
+            continue;
+        }
+        size_t index = timer_jiffies & TVR_MASK;
+        if (index == 0 && cascade(0) == 0 && cascade(1) == 0 && cascade(2) == 0) {
+            cascade(3);
+        }
+        // move the expired timers out of the wheel
+        if (!list_empty(tv1 + index)) {
+            timer_expired.next = tv1[index].next, timer_expired.prev = tv1[index].prev;
+            timer_expired.next->prev = timer_expired.prev->next = &timer_expired;
+            list_init(tv1 + index);
+        }
+        timer_jiffies ++;
+        timer_next = timer_next_event();
+    }
+out:
+    local_intr_restore(intr_flag);
+    return more;
+}
+
+/* timer_setup - initialize @timer, not pending, to call @func(@data) */
+void
+timer_setup(struct timer *timer, void (*func)(void *data), void *data) {
+    list_init(&(timer->timer_link));
+    timer->expires = 0;
+    timer->func = func;
+    timer->data = data;
+}
+
+/* timer_add - arm @timer, which must not be pending, to fire at tick @expires */
+void
+timer_add(struct timer *timer, size_t expires) {
+    bool intr_flag;
+    assert(!timer_pending(timer));
+    local_intr_save(intr_flag);
+    {
+        if (timer_count == 0 && time_before(timer_jiffies, clock_ticks())) {
+            // nothing was pending, the wheel may have fallen behind
+            timer_jiffies = ticks;
+        }
+        timer->expires = expires;
+        size_t t = internal_add(timer);
+        if (timer_count ++ == 0 || time_before(t, timer_next)) {
+            timer_next = t;
+            clock_request_tick(timer_next);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* timer_del - disarm @timer, return whether it was pending */
+bool
+timer_del(struct timer *timer) {
+    bool intr_flag, ret = 0;
+    local_intr_save(intr_flag);
+    {
+        if (timer_pending(timer)) {
+            list_del_init(&(timer->timer_link));
+            timer_count --;
+            ret = 1;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return ret;
+}
+
+/* timer_mod - (re)arm @timer for tick @expires, return whether it was pending */
+bool
+timer_mod(struct timer *timer, size_t expires) {
+    bool intr_flag, ret;
+    local_intr_save(intr_flag);
+    {
+        ret = timer_del(timer);
+        timer_add(timer, expires);
+    }
+    local_intr_restore(intr_flag);
+    return ret;
+}
+
+/* *
+ * timer_tick - hard irq part, called by the timer interrupt after 'ticks'
+ * is updated: raise TIMER_SOFTIRQ, or ask the clock for the next interrupt
+ * when nothing is due yet
+ * */
+void
+timer_tick(void) {
+    if (timer_count == 0) {
+        return;
+    }
+    if (!time_before(ticks, timer_next)) {
+        raise_softirq(TIMER_SOFTIRQ);
+    }
+    else {
+        clock_request_tick(timer_next);
+    }
+}
+
+/* timer_softirq - run the expired timers, with interrupts enabled */
+static bool
+timer_softirq(int budget) {
+    bool intr_flag, more = run_timers(clock_ticks(), budget);
+    local_intr_save(intr_flag);
+    {
+        if (timer_count != 0) {
+            clock_request_tick(timer_next);
+        }
+    }
+    local_intr_restore(intr_flag);
+    return more;
+}
+
+#define CHECK_NTIMERS           10000
+
+static size_t check_fired;
+
+static void
+check_timer_fire(void *data) {
+    struct timer *timer = data;
+    // called while tick timer_jiffies - 1 is processed
+    assert(timer->expires == timer_jiffies - 1);
+    check_fired ++;
+}
+
+/* *
+ * check_timer - arm CHECK_NTIMERS timers spread over all levels, cancel
+ * and move some, then drive the wheel with a fake clock in random steps
+ * and check every timer fired exactly at its tick
+ * */
+static void
+check_timer(void) {
+    size_t n = ROUNDUP(CHECK_NTIMERS * sizeof(struct timer), PGSIZE) / PGSIZE, expected = 0;
+    struct Page *p = alloc_pages(n);
+    assert(p != NULL);
+    struct timer *timers = page2kva(p);
+    size_t base = timer_jiffies, last = base, now;
+    int i;
+
+    check_fired = 0;
+    for (i = 0; i < CHECK_NTIMERS; i ++) {
+        size_t delta = (i % 100 == 0) ? (rand() % 64 + 1) << 22 : rand() % (1 << 20) + 1;
+        timer_setup(timers + i, check_timer_fire, timers + i);
+        timer_add(timers + i, base + delta);
+        assert(timer_pending(timers + i));
+    }
+    for (i = 0; i < CHECK_NTIMERS; i ++) {
+        if (i % 7 == 0) {
+            assert(timer_del(timers + i) && !timer_pending(timers + i));
+        }
+        else if (i % 11 == 0) {
+            assert(timer_mod(timers + i, base + rand() % 1000 + 1));
+        }
+        if (timer_pending(timers + i)) {
+            expected ++;
+            if (time_before(last, timers[i].expires)) {
+                last = timers[i].expires;
+            }
+        }
+    }
+    assert(timer_count == expected);
+    for (now = base; time_before(now, last); ) {
+        now += rand() % 5000;
+        if (time_before(last, now)) {
+            now = last;
+        }
+        run_timers(now, CHECK_NTIMERS);
+    }
+    assert(check_fired == expected && timer_count == 0);
+    free_pages(p, n);
+    // the fake clock ran ahead, restart the wheel from the real one
+    timer_jiffies = ticks;
+    cprintf("check_timer() succeeded!\n");
+}
+
+/* timer_init - initialize the wheel, check it and hook it to TIMER_SOFTIRQ */
+void
+timer_init(void) {
+    int i, level;
+    for (i = 0; i < TVR_SIZE; i ++) {
+        list_init(tv1 + i);
+    }
+    for (level = 0; level < TVN_LEVELS; level ++) {
+        for (i = 0; i < TVN_SIZE; i ++) {
+            list_init(tvn[level] + i);
+        }
+    }
+    list_init(&timer_expired);
+    timer_jiffies = timer_next = ticks;
+    timer_count = 0;
+    check_timer();
+    open_softirq(TIMER_SOFTIRQ, timer_softirq, TIMER_BUDGET);
+}
+
@@ -0,0 +1,39 @@
+#ifndef __KERN_DRIVER_TIMER_H__
+#define __KERN_DRIVER_TIMER_H__
+
+#include <defs.h>
+#include <list.h>
+
+/* *
+ * Kernel timers, kept in a hierarchical timing wheel (kern/driver/timer.c).
+ *
+ * A timer is owned by its user, who fills it with timer_setup() and then
+ * arms it with timer_add()/timer_mod() for an absolute tick, usually
+ * clock_ticks() + delay. The callback runs once, from TIMER_SOFTIRQ with
+ * interrupts enabled; it may re-arm its own timer.
+ * */
+struct timer {
+    list_entry_t timer_link;            // entry in a wheel slot, empty if not pending
+    size_t expires;                     // tick at which the timer fires
+    void (*func)(void *data);           // callback
+    void *data;                         // argument of the callback
+};
+
+#define le2timer(le, member)                \
+    to_struct((le), struct timer, member)
+
+void timer_setup(struct timer *timer, void (*func)(void *data), void *data);
+void timer_add(struct timer *timer, size_t expires);
+bool timer_del(struct timer *timer);
+bool timer_mod(struct timer *timer, size_t expires);
+
+static inline bool
+timer_pending(struct timer *timer) {
+    return !list_empty(&(timer->timer_link));
+}
+
+void timer_init(void);
+void timer_tick(void);
+
+#endif /* !__KERN_DRIVER_TIMER_H__ */
+
@@ -1,16 +1,23 @@
 #include <defs.h>
 #include <stdio.h>
 #include <string.h>
+#include <check_string.h>
 #include <console.h>
 #include <kdebug.h>
 #include <picirq.h>
 #include <trap.h>
 #include <clock.h>
+#include <timer.h>
 #include <intr.h>
 #include <pmm.h>
 #include <vmm.h>
 #include <ide.h>
 #include <swap.h>
+#include <fpu.h>
+#include <lapic.h>
+#include <acpi.h>
+#include <ioapic.h>
+#include <smp.h>
 
 int kern_init(void) __attribute__((noreturn));
 
@@ -20,6 +27,8 @@ int
 kern_init(void) {
     extern char edata[], end[];
     memset(edata, 0, end - edata);
+    //加载启动CPU的GDT/TSS, %gs指向per-cpu数据
+    gdt_init();                 // load the boot cpu's gdt, tss and per-cpu %gs
     //初始化控制台(控制显卡交互)
     cons_init();                // init the console
 
@@ -29,8 +38,14 @@ kern_init(void) {
     print_kerninfo();
 
     grade_backtrace();
+    // 初始化FPU/SSE(页清零、页拷贝会用到)
+    fpu_init();                 // init fpu state and detect sse2
+    // 用PIT校准TSC, 提供纳秒级时钟
+    tsc_init();                 // calibrate the tsc clocksource
     // 初始化物理内存管理器
     pmm_init();                 // init physical memory management
+    // 校验字符串库(按字读取的实现)的正确性
+    check_string();             // check the word-at-a-time string functions
     // 初始化中断控制器
     pic_init();                 // init interrupt controller
     // 初始化中段描述符表
@@ -43,8 +58,18 @@ kern_init(void) {
         //初始化虚拟内存页面磁盘置换调度器
     swap_init();                // init swap
     // 改进部分
+        //解析ACPI MADT表(处理器与IOAPIC)
+    acpi_init();                // find the cpus and the ioapic in the acpi madt
+        //初始化local APIC(单次定时器)
+    lapic_init();               // init local apic and calibrate its timer
+        //通过IOAPIC路由外设中断, 取代8259A
+    ioapic_init();              // route device irqs through the ioapic
+        //初始化内核定时器时间轮
+    timer_init();               // init kernel timers
         //初始化定时芯片
     clock_init();               // init clock interrupt
+        //启动其余处理器(AP)
+    smp_init();                 // start the application processors
         //开中断
     intr_enable();              // enable irq interrupt
 
@@ -53,8 +78,8 @@ kern_init(void) {
     //lab1_switch_test();
 
     /* do nothing */
-    //防止内核程序退出，通过监听中断事件进行服务
-    while (1);
+    //防止内核程序退出，通过监听中断事件进行服务(hlt空闲, 等待中断)
+    cpu_idle();
 }
 
 void __attribute__((noinline))
@@ -0,0 +1,180 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <mmu.h>
+#include <pmm.h>
+#include <check_string.h>
+
+/* *
+ * check_string - fuzz the word-at-a-time functions in libs/string.c against
+ * the plain byte loops they replaced, and print their throughput.
+ *
+ * The test strings live at the very end of a page mapped at STRCHECK_VA,
+ * with the next page left unmapped: a scanner that reads past the page
+ * holding the terminator takes an unhandled page fault.
+ * */
+
+#define STRCHECK_VA             PGSIZE
+#define STRCHECK_ROUNDS         20000
+#define STRCHECK_BENCH          16
+
+static size_t
+ref_strlen(const char *s) {
+    size_t cnt = 0;
+    while (*s ++ != '\0') {
+        cnt ++;
+    }
+    return cnt;
+}
+
+static size_t
+ref_strnlen(const char *s, size_t len) {
+    size_t cnt = 0;
+    while (cnt < len && *s ++ != '\0') {
+        cnt ++;
+    }
+    return cnt;
+}
+
+static char *
+ref_strchr(const char *s, char c) {
+    while (*s != '\0') {
+        if (*s == c) {
+            return (char *)s;
+        }
+        s ++;
+    }
+    return NULL;
+}
+
+static int
+ref_memcmp(const void *v1, const void *v2, size_t n) {
+    const char *s1 = (const char *)v1;
+    const char *s2 = (const char *)v2;
+    while (n -- > 0) {
+        if (*s1 != *s2) {
+            return (int)((unsigned char)*s1 - (unsigned char)*s2);
+        }
+        s1 ++, s2 ++;
+    }
+    return 0;
+}
+
+static int
+sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static void
+fuzz_string(char *page) {
+    int i, j;
+    for (i = 0; i < STRCHECK_ROUNDS; i ++) {
+        // a short string of few distinct chars, often ending right at the page end
+        size_t len = rand() % 200, slack = (rand() % 3 == 0) ? 0 : rand() % 300;
+        char *s = page + PGSIZE - 1 - len - (slack < PGSIZE - 1 - len ? slack : 0);
+        for (j = 0; j < len; j ++) {
+            s[j] = 1 + rand() % 4;
+        }
+        s[len] = '\0';
+
+        assert(strlen(s) == ref_strlen(s));
+        size_t max = rand() % 250, room = page + PGSIZE - s;
+        if (max > room) {
+            max = room;
+        }
+        assert(strnlen(s, max) == ref_strnlen(s, max));
+        char c = 1 + rand() % 5;
+        assert(strchr(s, c) == ref_strchr(s, c));
+
+        // two copies at independent alignments, maybe with one flipped bit
+        size_t n = rand() % 300;
+        char *x = page + rand() % (PGSIZE / 2 - n), *y = page + PGSIZE / 2 + rand() % (PGSIZE / 2 - n);
+        for (j = 0; j < n; j ++) {
+            y[j] = x[j];
+        }
+        if (n > 0 && (rand() & 1)) {
+            y[rand() % n] ^= 1 << (rand() % 8);
+        }
+        assert(sign(memcmp(x, y, n)) == sign(ref_memcmp(x, y, n)));
+    }
+}
+
+static uint32_t
+bench_cycles(uint64_t start) {
+    return (uint32_t)(rdtsc() - start) / STRCHECK_BENCH;
+}
+
+static void
+bench_string(char *p1, char *p2) {
+    int i;
+    uint64_t t;
+    uint32_t ref, cur, sse;
+    volatile size_t sink = 0;
+
+    memset(p1, 'a', PGSIZE - 1), p1[PGSIZE - 1] = '\0';
+    memcpy(p2, p1, PGSIZE);
+
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += ref_memcmp(p1, p2, PGSIZE);
+    ref = bench_cycles(t);
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += memcmp(p1, p2, PGSIZE);
+    cur = bench_cycles(t);
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += memcmp_page(p1, p2);
+    sse = bench_cycles(t);
+    cprintf("  memcmp 4KB: byte %d, word %d, memcmp_page %d cycles\n", ref, cur, sse);
+
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += ref_strlen(p1);
+    ref = bench_cycles(t);
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += strlen(p1);
+    cur = bench_cycles(t);
+    cprintf("  strlen 4KB: byte %d, word %d cycles\n", ref, cur);
+
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += (size_t)ref_strchr(p1, 'b');
+    ref = bench_cycles(t);
+    t = rdtsc();
+    for (i = 0; i < STRCHECK_BENCH; i ++) sink += (size_t)strchr(p1, 'b');
+    cur = bench_cycles(t);
+    cprintf("  strchr 4KB: byte %d, word %d cycles\n", ref, cur);
+}
+
+void
+check_string(void) {
+    struct Page *guard, *p1, *p2;
+    assert(boot_pgdir[0] == 0);
+    assert((guard = alloc_page()) != NULL);
+    assert(page_insert(boot_pgdir, guard, STRCHECK_VA, PTE_W) == 0);
+    assert(get_pte(boot_pgdir, STRCHECK_VA + PGSIZE, 0) != NULL);
+    assert((*get_pte(boot_pgdir, STRCHECK_VA + PGSIZE, 0) & PTE_P) == 0);
+
+    fuzz_string((char *)STRCHECK_VA);
+
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+    memset(page2kva(p1), 0x5a, PGSIZE);
+    memset(page2kva(p2), 0x5a, PGSIZE);
+    assert(memcmp_page(page2kva(p1), page2kva(p2)) == 0);
+    ((char *)page2kva(p2))[PGSIZE - 1] = 0x5b;
+    assert(memcmp_page(page2kva(p1), page2kva(p2)) < 0);
+    ((char *)page2kva(p1))[100] = 0x7f;
+    assert(memcmp_page(page2kva(p1), page2kva(p2)) > 0);
+
+    cprintf("string ops throughput:\n");
+    bench_string(page2kva(p1), page2kva(p2));
+
+    free_page(p1);
+    free_page(p2);
+    page_remove(boot_pgdir, STRCHECK_VA);
+    free_page(pde2page(boot_pgdir[0]));
+    boot_pgdir[0] = 0;
+
+    cprintf("check_string() succeeded!\n");
+}
+
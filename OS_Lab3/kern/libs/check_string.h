@@ -0,0 +1,6 @@
+#ifndef __KERN_LIBS_CHECK_STRING_H__
+#define __KERN_LIBS_CHECK_STRING_H__
+
+void check_string(void);
+
+#endif /* !__KERN_LIBS_CHECK_STRING_H__ */
@@ -1,5 +1,6 @@
 #include <defs.h>
 #include <stdio.h>
+#include <string.h>
 #include <console.h>
 
 /* HIGH level console I/O */
@@ -14,6 +15,16 @@ cputch(int c, int *cnt) {
     (*cnt) ++;
 }
 
+/* *
+ * cputstr - writes @n characters of @str to stdout in one go, and
+ * adds @n to the counter pointed by @cnt.
+ * */
+static void
+cputstr(const char *str, size_t n, int *cnt) {
+    cons_puts(str, n);
+    (*cnt) += n;
+}
+
 /* *
  * vcprintf - format a string and writes it to stdout
  *
@@ -26,7 +37,7 @@ cputch(int c, int *cnt) {
 int
 vcprintf(const char *fmt, va_list ap) {
     int cnt = 0;
-    vprintfmt((void*)cputch, &cnt, fmt, ap);
+    vprintfmt_bulk((void*)cputch, (void*)cputstr, &cnt, fmt, ap);
     return cnt;
 }
 
@@ -59,10 +70,7 @@ cputchar(int c) {
 int
 cputs(const char *str) {
     int cnt = 0;
-    char c;
-    while ((c = *str ++) != '\0') {
-        cputch(c, &cnt);
-    }
+    cputstr(str, strlen(str), &cnt);
     cputch('\n', &cnt);
     return cnt;
 }
@@ -0,0 +1,225 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <rmap.h>
+#include <clock.h>
+#include <trace.h>
+
+/* *
+ * Copy-on-write benchmark, run from the kmonitor with `cowbench`.
+ *
+ * An mm with one writable vma of the given size, every page present, is
+ * duplicated twice: eagerly, allocating and copying every page the way a
+ * fork without copy-on-write would, and with mm_dup, which only copies
+ * page tables. Then every page of the mm_dup copy is written once, through
+ * do_pgfault, to show what the copying costs when it does happen. Last,
+ * with swap, up to COWBENCH_SWAP_MAX pages shared by a fresh mm_dup copy
+ * are written out, each with both of its mappings taken down through the
+ * reverse map. None of the mms ever runs, the pages are filled and checked
+ * through their kernel addresses.
+ * */
+
+#define COWBENCH_BASE           0x10000000
+// pages left free beside the two copies, for page tables and the kernel
+#define COWBENCH_RESERVE        256
+// shared pages written out at most, the swap disk is small
+#define COWBENCH_SWAP_MAX       256
+
+// the word each page starts with
+#define COWBENCH_MAGIC(la)      ((la) ^ 0x5A5A5A5A)
+
+static struct mm_struct *
+bench_mm_create(size_t size) {
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    if (mm_setup_pgdir(mm) != 0) {
+        mm_destroy(mm);
+        return NULL;
+    }
+    struct vma_struct *vma = vma_create(COWBENCH_BASE, COWBENCH_BASE + size, VM_READ | VM_WRITE);
+    assert(vma != NULL);
+    insert_vma_struct(mm, vma);
+    return mm;
+}
+
+static void
+bench_mm_destroy(struct mm_struct *mm) {
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+}
+
+/* bench_map - map a new page at @la of @mm, a copy of @from if there is one */
+static int
+bench_map(struct mm_struct *mm, uintptr_t la, struct Page *from) {
+    struct Page *page = alloc_page();
+    if (page == NULL) {
+        return -1;
+    }
+    if (from != NULL) {
+        memcpy(page2kva(page), page2kva(from), PGSIZE);
+    }
+    else {
+        clear_page(page2kva(page));
+        *(uintptr_t *)page2kva(page) = COWBENCH_MAGIC(la);
+    }
+    if (page_insert(mm->pgdir, page, la, PTE_U | PTE_W) != 0) {
+        free_page(page);
+        return -1;
+    }
+    rmap_add(page, mm, la);
+    if (swap_init_ok) {
+        swap_map_swappable(mm, la, page, 0);
+        page->pra_vaddr = la;
+    }
+    return 0;
+}
+
+/* bench_page - the page @mm maps at @la, which must be present */
+static struct Page *
+bench_page(struct mm_struct *mm, uintptr_t la) {
+    pte_t *ptep = get_pte(mm->pgdir, la, 0);
+    assert(ptep != NULL && (*ptep & PTE_P));
+    return pte2page(*ptep);
+}
+
+/* eager_dup - duplicate @oldmm by copying all of its pages */
+static struct mm_struct *
+eager_dup(struct mm_struct *oldmm, size_t size) {
+    struct mm_struct *mm = bench_mm_create(size);
+    uintptr_t la;
+    if (mm == NULL) {
+        return NULL;
+    }
+    for (la = COWBENCH_BASE; la < COWBENCH_BASE + size; la += PGSIZE) {
+        if (bench_map(mm, la, bench_page(oldmm, la)) != 0) {
+            bench_mm_destroy(mm);
+            return NULL;
+        }
+    }
+    return mm;
+}
+
+static void
+bench_check(struct mm_struct *mm, size_t size) {
+    uintptr_t la;
+    for (la = COWBENCH_BASE; la < COWBENCH_BASE + size; la += PGSIZE) {
+        assert(*(uintptr_t *)page2kva(bench_page(mm, la)) == COWBENCH_MAGIC(la));
+    }
+}
+
+static void
+bench_print(const char *what, uint64_t cycles, size_t npage) {
+    uint64_t us = cycles_to_ns(cycles), per_page = cycles;
+    do_div(us, 1000);
+    do_div(per_page, npage);
+    cprintf("%-22s %12llu %10llu %10u\n", what, cycles, us, (uint32_t)per_page);
+}
+
+/* *
+ * bench_swap_out - write out pages of @mm while an mm_dup copy shares
+ * them; the reverse map takes down the mappings of both, which must then
+ * hold the same swap entry
+ * */
+static void
+bench_swap_out(struct mm_struct *mm, size_t size) {
+    struct mm_struct *copy = mm_dup(mm);
+    uintptr_t la;
+    if (copy == NULL) {
+        cprintf("cowbench: out of memory\n");
+        return;
+    }
+    int n = (size / PGSIZE < COWBENCH_SWAP_MAX) ? size / PGSIZE : COWBENCH_SWAP_MAX;
+    size_t shared = vmm_stats.rmap_shared_out;
+    uint32_t echo = trace_events[TRACE_swap_out].flags;
+    trace_events[TRACE_swap_out].flags &= ~TRACE_ECHO;
+    spin_lock(&(mm->mm_lock));
+    uint64_t start = rdtsc();
+    int done = swap_out(mm, n, 0);
+    uint64_t cycles = rdtsc() - start;
+    spin_unlock(&(mm->mm_lock));
+    trace_events[TRACE_swap_out].flags = echo;
+    if (done > 0) {
+        bench_print("swap out shared", cycles, done);
+    }
+    cprintf("cowbench: %d pages written out, %u of them shared\n", done, vmm_stats.rmap_shared_out - shared);
+
+    for (la = COWBENCH_BASE; la < COWBENCH_BASE + size; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0), *cptep = get_pte(copy->pgdir, la, 0);
+        assert(ptep != NULL && cptep != NULL && *ptep == *cptep);
+    }
+    bench_mm_destroy(copy);
+}
+
+/* cow_bench - time mm_dup against an eager copy of an mm of @mb megabytes */
+void
+cow_bench(size_t mb) {
+    if (mb == 0) {
+        return;
+    }
+    size_t nr_free = nr_free_pages();
+    size_t max_mb = (nr_free > COWBENCH_RESERVE) ? (nr_free - COWBENCH_RESERVE) / (2 * (1024 * 1024 / PGSIZE) + 1) : 0;
+    if (max_mb == 0) {
+        cprintf("cowbench: not enough free memory\n");
+        return;
+    }
+    if (mb > max_mb) {
+        cprintf("cowbench: %u MB do not fit twice in free memory, using %u MB\n", mb, max_mb);
+        mb = max_mb;
+    }
+    size_t size = mb * 1024 * 1024, npage = size / PGSIZE;
+    uintptr_t la;
+    uint64_t start;
+
+    struct mm_struct *mm = bench_mm_create(size), *copy;
+    assert(mm != NULL);
+    for (la = COWBENCH_BASE; la < COWBENCH_BASE + size; la += PGSIZE) {
+        if (bench_map(mm, la, NULL) != 0) {
+            cprintf("cowbench: out of memory\n");
+            bench_mm_destroy(mm);
+            return;
+        }
+    }
+    cprintf("cowbench: %u MB, %u pages\n", mb, npage);
+    cprintf("                             cycles         us  cycles/pg\n");
+
+    start = rdtsc();
+    copy = eager_dup(mm, size);
+    bench_print("eager copy", rdtsc() - start, npage);
+    if (copy != NULL) {
+        bench_check(copy, size);
+        bench_mm_destroy(copy);
+    }
+
+    start = rdtsc();
+    copy = mm_dup(mm);
+    bench_print("mm_dup", rdtsc() - start, npage);
+    if (copy != NULL) {
+        assert(page_ref(bench_page(copy, COWBENCH_BASE)) == 2);
+        start = rdtsc();
+        for (la = COWBENCH_BASE; la < COWBENCH_BASE + size; la += PGSIZE) {
+            if (do_pgfault(copy, 3, la) != 0) {
+                break;
+            }
+        }
+        bench_print("write faults after it", rdtsc() - start, npage);
+        if (la == COWBENCH_BASE + size) {
+            bench_check(copy, size);
+            assert(bench_page(copy, COWBENCH_BASE) != bench_page(mm, COWBENCH_BASE));
+            assert(page_ref(bench_page(mm, COWBENCH_BASE)) == 1);
+        }
+        bench_mm_destroy(copy);
+    }
+    bench_check(mm, size);
+    if (swap_init_ok) {
+        bench_swap_out(mm, size);
+    }
+    bench_mm_destroy(mm);
+}
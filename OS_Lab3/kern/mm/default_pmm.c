@@ -117,6 +117,9 @@ default_init_memmap(struct Page *base, size_t n) {
         p->flags = p->property = 0;
         // 初始化的Page，被引用次数为0
         set_page_ref(p, 0);
+        // 也没有被任何mm映射
+        p->rmap_mm = NULL;
+        p->rmap_chain = NULL;
     }
     // 头Page base的property=n，代表包括当前页在内的空闲块共有n个连续的物理空闲页
     base->property = n;
@@ -9,6 +9,8 @@
 #define SEG_UTEXT   3
 #define SEG_UDATA   4
 #define SEG_TSS     5
+#define SEG_PERCPU  6
+#define NSEGS       7
 
 /* global descrptor numbers */
 #define GD_KTEXT    ((SEG_KTEXT) << 3)      // kernel text
@@ -16,6 +18,7 @@
 #define GD_UTEXT    ((SEG_UTEXT) << 3)      // user text
 #define GD_UDATA    ((SEG_UDATA) << 3)      // user data
 #define GD_TSS      ((SEG_TSS) << 3)        // task segment selector
+#define GD_PERCPU   ((SEG_PERCPU) << 3)     // per-cpu data, loaded in %gs
 
 #define DPL_KERNEL  (0)
 #define DPL_USER    (3)
@@ -33,7 +36,9 @@
  *                            |                                 |
  *                            |         Empty Memory (*)        |
  *                            |                                 |
- *                            +---------------------------------+ 0xFB000000
+ *     MMIOLIM -------------> +---------------------------------+ 0xFB400000
+ *                            |   Memory-mapped I/O (Kern, RW)  | RW/-- PTSIZE
+ *     MMIOBASE ------------> +---------------------------------+ 0xFB000000
  *                            |   Cur. Page Table (Kern, RW)    | RW/-- PTSIZE
  *     VPT -----------------> +---------------------------------+ 0xFAC00000
  *                            |        Invalid Memory (*)       | --/--
@@ -65,9 +70,16 @@
  * */
 #define VPT                 0xFAC00000
 
+/* device registers above physical memory (local APIC, ...) are mapped here */
+#define MMIOBASE            0xFB000000
+#define MMIOLIM             0xFB400000
+
 #define KSTACKPAGE          2                           // # of pages in kernel stack
 #define KSTACKSIZE          (KSTACKPAGE * PGSIZE)       // sizeof kernel stack
 
+/* the application processors start in real mode at this physical address, see kern/init/mpentry.S */
+#define MPENTRY_PADDR       0x7000
+
 #ifndef __ASSEMBLER__
 
 #include <defs.h>
@@ -92,6 +104,9 @@ struct e820map {
     } __attribute__((packed)) map[E820MAX];
 };
 
+struct mm_struct;
+struct rmap_item;
+
 /* *
  * struct Page - Page descriptor structures. Each Page describes one
  * physical page. In kern/mm/pmm.h, you can find lots of useful functions
@@ -115,11 +130,17 @@ struct Page {
     
     //用来记录物理页对应的虚拟页起始地址
     uintptr_t pra_vaddr;            // used for pra (page replace algorithm)
+
+    // 反向映射: 映射该物理页的(mm, 虚拟地址)，第一个就存放在Page中，其余的挂在rmap_chain上，见rmap.c
+    struct mm_struct *rmap_mm;      // the first mm mapping this page, NULL if none
+    uintptr_t rmap_va;              // and where
+    struct rmap_item *rmap_chain;   // the other mappings
 };
 
 /* Flags describing the status of a page frame */
 #define PG_reserved                 0       // the page descriptor is reserved for kernel or unusable
 #define PG_property                 1       // the member 'property' is valid
+#define PG_swap                     2       // on a swap manager queue, linked by pra_page_link
 
 #define SetPageReserved(page)       set_bit(PG_reserved, &((page)->flags))
 #define ClearPageReserved(page)     clear_bit(PG_reserved, &((page)->flags))
@@ -127,6 +148,9 @@ struct Page {
 #define SetPageProperty(page)       set_bit(PG_property, &((page)->flags))
 #define ClearPageProperty(page)     clear_bit(PG_property, &((page)->flags))
 #define PageProperty(page)          test_bit(PG_property, &((page)->flags))
+#define SetPageSwap(page)           set_bit(PG_swap, &((page)->flags))
+#define ClearPageSwap(page)         clear_bit(PG_swap, &((page)->flags))
+#define PageSwap(page)              test_bit(PG_swap, &((page)->flags))
 
 // convert list entry to page
 #define le2page(le, member)                 \
@@ -7,9 +7,13 @@
 #include <pmm.h>
 #include <default_pmm.h>
 #include <sync.h>
+#include <spinlock.h>
+#include <smp.h>
 #include <error.h>
 #include <swap.h>
 #include <vmm.h>
+#include <rmap.h>
+#include <fpu.h>
 
 /* *
  * Task State Segment:
@@ -30,8 +34,9 @@
  * contains the new ESP value for CPL = 0. When an interrupt happens in protected
  * mode, the x86 CPU will look in the TSS for SS0 and ESP0 and load their value
  * into SS and ESP respectively.
+ *
+ * Every cpu has its own TSS and GDT in its struct cpu (see smp.h).
  * */
-static struct taskstate ts = {0};
 
 // virtual address of physicall page array
 struct Page *pages;
@@ -46,6 +51,9 @@ uintptr_t boot_cr3;
 
 // physical memory management
 const struct pmm_manager *pmm_manager;
+// guards the pmm_manager's free lists, taken with interrupts disabled
+static struct lockstat pmm_lockstat = LOCKSTAT_INIT("pmm");
+static spinlock_t pmm_lock = SPINLOCK_INIT_STAT("pmm", &pmm_lockstat);
 
 /* *
  * The page directory entry corresponding to the virtual address range
@@ -74,22 +82,23 @@ pde_t * const vpd = (pde_t *)PGADDR(PDX(VPT), PDX(VPT), 0);
  *   - 0x10:  kernel data segment
  *   - 0x18:  user code segment
  *   - 0x20:  user data segment
- *   - 0x28:  defined for tss, initialized in gdt_init
+ *   - 0x28:  defined for tss, initialized in gdt_init_cpu
+ *   - 0x30:  per-cpu data, based at the cpu's struct cpu, kept in %gs
+ *
+ * This is the template each cpu copies into its struct cpu.
  * */
-static struct segdesc gdt[] = {
+static const struct segdesc gdt[NSEGS] = {
     SEG_NULL,
     [SEG_KTEXT] = SEG(STA_X | STA_R, 0x0, 0xFFFFFFFF, DPL_KERNEL),
     [SEG_KDATA] = SEG(STA_W, 0x0, 0xFFFFFFFF, DPL_KERNEL),
     [SEG_UTEXT] = SEG(STA_X | STA_R, 0x0, 0xFFFFFFFF, DPL_USER),
     [SEG_UDATA] = SEG(STA_W, 0x0, 0xFFFFFFFF, DPL_USER),
     [SEG_TSS]   = SEG_NULL,
-};
-
-static struct pseudodesc gdt_pd = {
-    sizeof(gdt) - 1, (uintptr_t)gdt
+    [SEG_PERCPU] = SEG_NULL,
 };
 
 static void check_alloc_page(void);
+static void check_page_ops(void);
 static void check_pgdir(void);
 static void check_boot_pgdir(void);
 
@@ -100,7 +109,7 @@ static void check_boot_pgdir(void);
 static inline void
 lgdt(struct pseudodesc *pd) {
     asm volatile ("lgdt (%0)" :: "r" (pd));
-    asm volatile ("movw %%ax, %%gs" :: "a" (USER_DS));
+    asm volatile ("movw %%ax, %%gs" :: "a" (GD_PERCPU));
     asm volatile ("movw %%ax, %%fs" :: "a" (USER_DS));
     asm volatile ("movw %%ax, %%es" :: "a" (KERNEL_DS));
     asm volatile ("movw %%ax, %%ds" :: "a" (KERNEL_DS));
@@ -116,29 +125,42 @@ lgdt(struct pseudodesc *pd) {
  * */
 void
 load_esp0(uintptr_t esp0) {
-    ts.ts_esp0 = esp0;
+    this_cpu()->ts.ts_esp0 = esp0;
 }
 
-/* gdt_init - initialize the default GDT and TSS */
-static void
-gdt_init(void) {
-    // set boot kernel stack and default SS0
-    load_esp0((uintptr_t)bootstacktop);
-    ts.ts_ss0 = KERNEL_DS;
+/* gdt_init_cpu - load the GDT and TSS of @c on the calling cpu, %gs then points to @c */
+void
+gdt_init_cpu(struct cpu *c) {
+    memcpy(c->gdt, gdt, sizeof(gdt));
+    c->self = c;
 
-    // initialize the TSS filed of the gdt
-    //将生成的TSS结构存入GDT中
-    gdt[SEG_TSS] = SEGTSS(STS_T32A, (uintptr_t)&ts, sizeof(ts), DPL_KERNEL);
+    // set the kernel stack and default SS0
+    c->ts.ts_esp0 = c->kstacktop;
+    c->ts.ts_ss0 = KERNEL_DS;
+
+    // initialize the TSS and per-cpu fields of the gdt
+    c->gdt[SEG_TSS] = SEGTSS(STS_T32A, (uintptr_t)&c->ts, sizeof(c->ts), DPL_KERNEL);
+    c->gdt[SEG_PERCPU] = SEG(STA_W, (uintptr_t)c, 0xFFFFFFFF, DPL_KERNEL);
 
     // reload all segment registers
-    // 重新加载gdt
-    lgdt(&gdt_pd);
+    c->gdt_pd.pd_lim = sizeof(c->gdt) - 1;
+    c->gdt_pd.pd_base = (uintptr_t)c->gdt;
+    lgdt(&c->gdt_pd);
 
     // load the TSS
-    // 设置全局的TSS任务状态段
     ltr(GD_TSS);
 }
 
+/* *
+ * gdt_init - initialize the GDT and TSS of the boot cpu. Runs first in
+ * kern_init, this_cpu() (and so local_intr_save) needs %gs.
+ * */
+void
+gdt_init(void) {
+    cpus[0].kstacktop = (uintptr_t)bootstacktop;
+    gdt_init_cpu(&cpus[0]);
+}
+
 //init_pmm_manager - initialize a pmm_manager instance
 static void
 init_pmm_manager(void) {
@@ -164,27 +186,37 @@ alloc_pages(size_t n) {
     while (1)
     {   
         //关闭中断，避免分配内存时，物理内存管理器内部的数据结构变动时被中断打断
-        local_intr_save(intr_flag);
+        spin_lock_irqsave(&pmm_lock, intr_flag);
         {
             //分配N个物理页
             page = pmm_manager->alloc_pages(n);
         }
         //恢复中断
-        local_intr_restore(intr_flag);
+        spin_unlock_irqrestore(&pmm_lock, intr_flag);
 
         // 满足下面之中的一个条件，就跳出while循环
         // page != null 表示分配成功
         // 如果n > 1 说明不是发生缺页异常来申请的(否则n=1)
         // 如果swap_init_ok == 0 说明没有开启分页模式
-         
-        if (page != NULL || n > 1 || swap_init_ok == 0) break;
+        // 如果check_mm_struct == NULL 说明没有可供换出的mm，只有check_swap和基准测试运行时才会设置它
          
         extern struct mm_struct *check_mm_struct;
+        if (page != NULL || n > 1 || swap_init_ok == 0 || check_mm_struct == NULL) break;
+         
         //cprintf("page %x, call swap_out in alloc_pages %d\n",page, n);
          
+        //swap_out要求持有mm锁：缺页处理do_pgfault已经持有；否则只尝试加锁，调用者可能持有别的mm锁
+        bool locked = 0;
+        if (!spin_holding(&(check_mm_struct->mm_lock))) {
+            if (!spin_trylock(&(check_mm_struct->mm_lock))) break;
+            locked = 1;
+        }
         //将某以物理页置换到swap磁盘交换扇区 --- 以腾出物理内存空间
         //交换成功，则下一次循环时，pmm_manager->alloc_pages(1)可分配物理页
         swap_out(check_mm_struct, n, 0);
+        if (locked) {
+            spin_unlock(&(check_mm_struct->mm_lock));
+        }
     }
     //cprintf("n %d,get page %x, No %d in alloc_pages\n",n,page,(page-pages));
     return page;
@@ -194,11 +226,16 @@ alloc_pages(size_t n) {
 void
 free_pages(struct Page *base, size_t n) {
     bool intr_flag;
-    local_intr_save(intr_flag);
+    size_t i;
+    //释放前映射都应已拆除，遗漏的反向映射在这里报出(rmap锁在pmm锁之前)
+    for (i = 0; i < n; i ++) {
+        rmap_free_page(base + i);
+    }
+    spin_lock_irqsave(&pmm_lock, intr_flag);
     {
         pmm_manager->free_pages(base, n);
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&pmm_lock, intr_flag);
 }
 
 //nr_free_pages - call pmm->nr_free_pages to get the size (nr*PAGESIZE) 
@@ -207,11 +244,11 @@ size_t
 nr_free_pages(void) {
     size_t ret;
     bool intr_flag;
-    local_intr_save(intr_flag);
+    spin_lock_irqsave(&pmm_lock, intr_flag);
     {
         ret = pmm_manager->nr_free_pages();
     }
-    local_intr_restore(intr_flag);
+    spin_unlock_irqrestore(&pmm_lock, intr_flag);
     return ret;
 }
 
@@ -316,6 +353,24 @@ boot_map_segment(pde_t *pgdir, uintptr_t la, size_t size, uintptr_t pa, uint32_t
     }
 }
 
+/* *
+ * mmio_map_region - map @size bytes of device registers at physical address
+ * @pa into the next free part of [MMIOBASE, MMIOLIM), uncached, and return
+ * the virtual address of @pa. Mappings are never torn down.
+ * */
+void *
+mmio_map_region(uintptr_t pa, size_t size) {
+    static uintptr_t mmio_next = MMIOBASE;
+    uintptr_t la = mmio_next + PGOFF(pa);
+    size = ROUNDUP(size + PGOFF(pa), PGSIZE);
+    if (mmio_next + size > MMIOLIM) {
+        panic("mmio_map_region: out of MMIO space mapping 0x%08x.\n", pa);
+    }
+    boot_map_segment(boot_pgdir, mmio_next, size, ROUNDDOWN(pa, PGSIZE), PTE_W | PTE_PCD | PTE_PWT);
+    mmio_next += size;
+    return (void *)la;
+}
+
 //boot_alloc_page - allocate one page using pmm->alloc_pages(1) 
 // return value: the kernel virtual address of this allocated page
 //note: this function is used to get the memory for PDT(Page Directory Table)&PT(Page Table)
@@ -354,6 +409,8 @@ pmm_init(void) {
     //use pmm->check to verify the correctness of the alloc/free function in a pmm
     check_alloc_page();
 
+    check_page_ops();
+
     check_pgdir();
 
     static_assert(KERNBASE % PTSIZE == 0 && KERNTOP % PTSIZE == 0);
@@ -370,13 +427,6 @@ pmm_init(void) {
     // (映射关系(虚实映射): 内核起始虚拟地址(KERNBASE)~内核截止虚拟地址(KERNBASE+KMEMSIZE) =  内核起始物理地址(0)~内核截止物理地址(KMEMSIZE))
     boot_map_segment(boot_pgdir, KERNBASE, KMEMSIZE, 0, PTE_W);
 
-    // Since we are using bootloader's GDT,
-    // we should reload gdt (second time, the last time) to get user segments and the TSS
-    // map virtual_addr 0 ~ 4G = linear_addr 0 ~ 4G
-    // then set kernel stack (ss:esp) in TSS, setup TSS in gdt, load TSS
-    // 重新设置GDT
-    gdt_init();
-
     //now the basic virtual memory map(see memalyout.h) is established.
     //check the correctness of the basic virtual memory map.
     check_boot_pgdir();
@@ -385,6 +435,200 @@ pmm_init(void) {
 
 }
 
+/* *
+ * Page-sized clear and copy.
+ *
+ * These are pure memory bandwidth work, so with SSE2 they move 64 bytes per
+ * loop iteration through the xmm registers. The plain versions use movdqa,
+ * leaving the page in the cache for a caller that is about to touch it (a
+ * new page table, a page being mapped for the faulting access). The _nocache
+ * versions use movntdq, which writes around the cache and does not evict the
+ * working set, for pages that won't be touched soon (swap, prefetch). Without
+ * SSE2 all of them fall back to rep stosl/movsl.
+ * */
+#define PAGE_OPS_NLOOP          (PGSIZE / 64)
+
+static inline void
+sse2_clear_page(void *page, bool nocache) {
+    int cnt = PAGE_OPS_NLOOP;
+    asm volatile ("pxor %%xmm0, %%xmm0" ::: "memory");
+    if (nocache) {
+        asm volatile (
+            "1: movntdq %%xmm0, (%0);"
+            "movntdq %%xmm0, 16(%0);"
+            "movntdq %%xmm0, 32(%0);"
+            "movntdq %%xmm0, 48(%0);"
+            "addl $64, %0;"
+            "decl %1;"
+            "jnz 1b;"
+            "sfence;"
+            : "+r" (page), "+r" (cnt) :: "memory", "cc");
+    }
+    else {
+        asm volatile (
+            "1: movdqa %%xmm0, (%0);"
+            "movdqa %%xmm0, 16(%0);"
+            "movdqa %%xmm0, 32(%0);"
+            "movdqa %%xmm0, 48(%0);"
+            "addl $64, %0;"
+            "decl %1;"
+            "jnz 1b;"
+            : "+r" (page), "+r" (cnt) :: "memory", "cc");
+    }
+}
+
+static inline void
+sse2_copy_page(void *to, const void *from, bool nocache) {
+    int cnt = PAGE_OPS_NLOOP;
+    if (nocache) {
+        asm volatile (
+            "1: prefetchnta 256(%1);"
+            "movdqa (%1), %%xmm0;"
+            "movdqa 16(%1), %%xmm1;"
+            "movdqa 32(%1), %%xmm2;"
+            "movdqa 48(%1), %%xmm3;"
+            "movntdq %%xmm0, (%0);"
+            "movntdq %%xmm1, 16(%0);"
+            "movntdq %%xmm2, 32(%0);"
+            "movntdq %%xmm3, 48(%0);"
+            "addl $64, %1;"
+            "addl $64, %0;"
+            "decl %2;"
+            "jnz 1b;"
+            "sfence;"
+            : "+r" (to), "+r" (from), "+r" (cnt) :: "memory", "cc");
+    }
+    else {
+        asm volatile (
+            "1: movdqa (%1), %%xmm0;"
+            "movdqa 16(%1), %%xmm1;"
+            "movdqa 32(%1), %%xmm2;"
+            "movdqa 48(%1), %%xmm3;"
+            "movdqa %%xmm0, (%0);"
+            "movdqa %%xmm1, 16(%0);"
+            "movdqa %%xmm2, 32(%0);"
+            "movdqa %%xmm3, 48(%0);"
+            "addl $64, %1;"
+            "addl $64, %0;"
+            "decl %2;"
+            "jnz 1b;"
+            : "+r" (to), "+r" (from), "+r" (cnt) :: "memory", "cc");
+    }
+}
+
+static inline void
+scalar_clear_page(void *page) {
+    int d0, d1;
+    asm volatile (
+        "cld;"
+        "rep; stosl;"
+        : "=&c" (d0), "=&D" (d1)
+        : "0" (PGSIZE / 4), "1" (page), "a" (0)
+        : "memory");
+}
+
+static inline void
+scalar_copy_page(void *to, const void *from) {
+    int d0, d1, d2;
+    asm volatile (
+        "cld;"
+        "rep; movsl;"
+        : "=&c" (d0), "=&D" (d1), "=&S" (d2)
+        : "0" (PGSIZE / 4), "1" (to), "2" (from)
+        : "memory");
+}
+
+//clear_page - zero the page at kernel virtual address @page (must be page aligned)
+void
+clear_page(void *page) {
+    if (cpu_has_sse2) {
+        kernel_fpu_begin();
+        sse2_clear_page(page, 0);
+        kernel_fpu_end();
+    }
+    else {
+        scalar_clear_page(page);
+    }
+}
+
+//clear_page_nocache - like clear_page, but don't pull the page into the cache
+void
+clear_page_nocache(void *page) {
+    if (cpu_has_sse2) {
+        kernel_fpu_begin();
+        sse2_clear_page(page, 1);
+        kernel_fpu_end();
+    }
+    else {
+        scalar_clear_page(page);
+    }
+}
+
+//copy_page - copy the page at kernel virtual address @from to @to (both page aligned)
+void
+copy_page(void *to, const void *from) {
+    if (cpu_has_sse2) {
+        kernel_fpu_begin();
+        sse2_copy_page(to, from, 0);
+        kernel_fpu_end();
+    }
+    else {
+        scalar_copy_page(to, from);
+    }
+}
+
+//copy_page_nocache - like copy_page, but stream the destination around the cache
+void
+copy_page_nocache(void *to, const void *from) {
+    if (cpu_has_sse2) {
+        kernel_fpu_begin();
+        sse2_copy_page(to, from, 1);
+        kernel_fpu_end();
+    }
+    else {
+        scalar_copy_page(to, from);
+    }
+}
+
+//memcmp_page - compare two page-aligned pages, same return value as memcmp(p1, p2, PGSIZE)
+int
+memcmp_page(const void *p1, const void *p2) {
+    if (!cpu_has_sse2) {
+        return memcmp(p1, p2, PGSIZE);
+    }
+    // find the first 64-byte block holding a difference, 16 byte compares at a time
+    size_t off = 0;
+    uint32_t mask;
+    kernel_fpu_begin();
+    asm volatile (
+        "1: movdqa (%2,%0), %%xmm0;"
+        "movdqa 16(%2,%0), %%xmm1;"
+        "movdqa 32(%2,%0), %%xmm2;"
+        "movdqa 48(%2,%0), %%xmm3;"
+        "pcmpeqb (%3,%0), %%xmm0;"
+        "pcmpeqb 16(%3,%0), %%xmm1;"
+        "pcmpeqb 32(%3,%0), %%xmm2;"
+        "pcmpeqb 48(%3,%0), %%xmm3;"
+        "pand %%xmm1, %%xmm0;"
+        "pand %%xmm3, %%xmm2;"
+        "pand %%xmm2, %%xmm0;"
+        "pmovmskb %%xmm0, %1;"
+        "cmpl $0xffff, %1;"
+        "jne 2f;"
+        "addl $64, %0;"
+        "cmpl %4, %0;"
+        "jb 1b;"
+        "2:"
+        : "+r" (off), "=&r" (mask)
+        : "r" (p1), "r" (p2), "i" (PGSIZE)
+        : "memory", "cc");
+    kernel_fpu_end();
+    if (off >= PGSIZE) {
+        return 0;
+    }
+    return memcmp((const char *)p1 + off, (const char *)p2 + off, 64);
+}
+
 //get_pte - get pte and return the kernel virtual address of this pte for la
 //        - if the PT contians this pte didn't exist, alloc a page for PT
 //        通过线性地址(linear address)得到一个页表项(二级页表项)(Page Table Entry)，并返回该页表项结构的内核虚拟地址
@@ -447,7 +691,7 @@ get_pte(pde_t *pgdir, uintptr_t la, bool create) {
         // 获得page变量的物理地址
         uintptr_t pa = page2pa(page);
         // 将整个page所在的物理页格式胡，全部填满0
-        memset(KADDR(pa), 0, PGSIZE);
+        clear_page(KADDR(pa));
         // la对应的一级页目录项进行赋值，使其指向新创建的二级页表(页表中的数据被MMU直接处理，为了映射效率存放的都是物理地址)
         // 或PTE_U/PTE_W/PET_P 标识当前页目录项是用户级别的、可写的、已存在的
         *pdep = pa | PTE_U | PTE_W | PTE_P;
@@ -506,9 +750,14 @@ page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
         // 如果对应的二级页表项存在
     	// 获得*ptep对应的Page结构
         struct Page *page = pte2page(*ptep);
+        // 忘记这一反向映射
+        rmap_remove(page, pgdir, la);
         // 关联的page引用数自减1
         if (page_ref_dec(page) == 0) {
-            // 如果自减1后，引用数为0，需要free释放掉该物理页
+            // 如果自减1后，引用数为0，需要free释放掉该物理页 (先将其从swap置换队列中移除)
+            if (PageSwap(page)) {
+                swap_page_unqueue(page);
+            }
             free_page(page);
         }
         // 清空当前二级页表项(整体设置为0)
@@ -568,12 +817,51 @@ page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
 }
 
 // invalidate a TLB entry, but only if the page tables being
-// edited are the ones currently in use by the processor.
+// edited are the ones currently in use by the processor; the
+// other cpus using them are sent a shootdown.
 void
 tlb_invalidate(pde_t *pgdir, uintptr_t la) {
     if (rcr3() == PADDR(pgdir)) {
         invlpg((void *)la);
     }
+    smp_tlb_shootdown(pgdir, la);
+}
+
+/* *
+ * tlb_flush_local - if this cpu runs on the page tables at @cr3, invalidate
+ * the @n addresses @la, or reload %cr3 to drop all non-global entries if
+ * @la is NULL. invlpg drops the cached page directory entries as well.
+ * */
+void
+tlb_flush_local(uintptr_t cr3, const uintptr_t *la, int n) {
+    int i;
+    if (rcr3() != cr3) {
+        return;
+    }
+    if (la == NULL) {
+        lcr3(cr3);
+        return;
+    }
+    for (i = 0; i < n; i ++) {
+        invlpg((void *)la[i]);
+    }
+}
+
+// tlb_invalidate_batch - tlb_flush_local on every cpu running on @pgdir, with one cross-cpu call
+void
+tlb_invalidate_batch(pde_t *pgdir, const uintptr_t *la, int n) {
+    tlb_flush_local(PADDR(pgdir), la, n);
+    smp_tlb_shootdown_batch(pgdir, la, n);
+}
+
+// tlb_invalidate_each - invalidate @la[i] in the page tables @pgdir[i], i < @n, on every cpu, with one cross-cpu call
+void
+tlb_invalidate_each(pde_t * const *pgdir, const uintptr_t *la, int n) {
+    int i;
+    for (i = 0; i < n; i ++) {
+        tlb_flush_local(PADDR(pgdir[i]), la + i, 1);
+    }
+    smp_tlb_shootdown_each(pgdir, la, n);
 }
 // 建立映射虚实关系
 // pgdir_alloc_page - call alloc_page & page_insert functions to 
@@ -592,17 +880,9 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
             free_page(page);
             return NULL;
         }
-        //启用swap交换分区成功
-        if (swap_init_ok){
-            //将新映射的page物理页设置为可交换的，并纳入全局swap交换管理器中管理
-            swap_map_swappable(check_mm_struct, la, page, 0);
-            //设置物理页关联的虚拟内存
-            page->pra_vaddr=la;
-            //校验新分配出来的物理页page引用次数是否为1
-            assert(page_ref(page) == 1);
-            //cprintf("get No. %d  page: pra_vaddr %x, pra_link.prev %x, pra_link_next %x in pgdir_alloc_page\n", (page-pages), page->pra_vaddr,page->pra_page_link.prev, page->pra_page_link.next);
-        }
-
+        //校验新分配出来的物理页page引用次数是否为1
+        assert(page_ref(page) == 1);
+        //反向映射和swap置换队列属于映射它的mm，由调用者处理，见do_pgfault
     }
 
     return page;
@@ -614,6 +894,51 @@ check_alloc_page(void) {
     cprintf("check_alloc_page() succeeded!\n");
 }
 
+static void
+check_page_ops(void) {
+    struct Page *p1, *p2;
+    assert((p1 = alloc_page()) != NULL);
+    assert((p2 = alloc_page()) != NULL);
+    uint32_t *v1 = page2kva(p1), *v2 = page2kva(p2);
+    int i;
+
+    for (i = 0; i < PGSIZE / 4; i ++) {
+        v1[i] = i * 0x9E3779B9;
+    }
+    copy_page(v2, v1);
+    assert(memcmp(v1, v2, PGSIZE) == 0);
+    clear_page(v2);
+    for (i = 0; i < PGSIZE / 4; i ++) {
+        assert(v2[i] == 0);
+    }
+    copy_page_nocache(v2, v1);
+    assert(memcmp(v1, v2, PGSIZE) == 0);
+    clear_page_nocache(v1);
+    for (i = 0; i < PGSIZE / 4; i ++) {
+        assert(v1[i] == 0);
+    }
+
+    uint64_t t0 = rdtsc();
+    for (i = 0; i < 64; i ++) {
+        memset(v1, 0, PGSIZE);
+    }
+    uint64_t t1 = rdtsc();
+    for (i = 0; i < 64; i ++) {
+        clear_page(v1);
+    }
+    uint64_t t2 = rdtsc();
+    for (i = 0; i < 64; i ++) {
+        copy_page(v2, v1);
+    }
+    uint64_t t3 = rdtsc();
+    cprintf("page ops: memset %d, clear_page %d, copy_page %d cycles/page\n",
+            (uint32_t)(t1 - t0) / 64, (uint32_t)(t2 - t1) / 64, (uint32_t)(t3 - t2) / 64);
+
+    free_page(p1);
+    free_page(p2);
+    cprintf("check_page_ops() succeeded!\n");
+}
+
 static void
 check_pgdir(void) {
     assert(npage <= KMEMSIZE / PGSIZE);
@@ -40,12 +40,26 @@ struct Page *get_page(pde_t *pgdir, uintptr_t la, pte_t **ptep_store);
 void page_remove(pde_t *pgdir, uintptr_t la);
 int page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm);
 
+struct cpu;
+
+void gdt_init(void);
+void gdt_init_cpu(struct cpu *c);
 void load_esp0(uintptr_t esp0);
 void tlb_invalidate(pde_t *pgdir, uintptr_t la);
+void tlb_flush_local(uintptr_t cr3, const uintptr_t *la, int n);
+void tlb_invalidate_batch(pde_t *pgdir, const uintptr_t *la, int n);
+void tlb_invalidate_each(pde_t * const *pgdir, const uintptr_t *la, int n);
 struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
+void *mmio_map_region(uintptr_t pa, size_t size);
 
 void print_pgdir(void);
 
+void clear_page(void *page);
+void clear_page_nocache(void *page);
+void copy_page(void *to, const void *from);
+void copy_page_nocache(void *to, const void *from);
+int memcmp_page(const void *p1, const void *p2);
+
 /* *
  * PADDR - takes a kernel virtual address (an address that points above KERNBASE),
  * where the machine's maximum 256MB of physical memory is mapped and returns the
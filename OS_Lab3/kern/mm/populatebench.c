@@ -0,0 +1,92 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sync.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <clock.h>
+#include <trace.h>
+
+/* *
+ * Eager population benchmark, run from the kmonitor with `populatebench`.
+ *
+ * A writable region is mapped with mm_map and every page of it written
+ * once, from the page tables of the mm with check_mm_struct pointing to it,
+ * so that faults go through the trap path like any other. It runs with
+ * demand faulting, with demand faulting and fault-around, and with
+ * VM_POPULATE, and prints the faults taken and the cycles from mm_map to
+ * the last write. The page fault echo is off meanwhile.
+ * */
+
+#define POPBENCH_BASE           0x10000000
+// pages left free beside the region, for page tables and the kernel
+#define POPBENCH_RESERVE        256
+
+static void
+populate_bench_run(const char *what, size_t size, uint32_t vm_flags, int fault_around_max) {
+    struct mm_struct *mm = mm_create();
+    uintptr_t la;
+    bool intr_flag;
+    assert(mm != NULL);
+    if (mm_setup_pgdir(mm) != 0) {
+        mm_destroy(mm);
+        cprintf("populatebench: out of memory\n");
+        return;
+    }
+    mm->fault_around_max = fault_around_max;
+
+    unsigned int faults = pgfault_num;
+    local_intr_save(intr_flag);
+    uint64_t start = rdtsc();
+    assert(mm_map(mm, POPBENCH_BASE, size, vm_flags, NULL) == 0);
+    assert(check_mm_struct == NULL);
+    check_mm_struct = mm;
+    lcr3(PADDR(mm->pgdir));
+    for (la = POPBENCH_BASE; la < POPBENCH_BASE + size; la += PGSIZE) {
+        *(volatile uintptr_t *)la = la;
+    }
+    lcr3(boot_cr3);
+    check_mm_struct = NULL;
+    uint64_t cycles = rdtsc() - start;
+    local_intr_restore(intr_flag);
+    faults = pgfault_num - faults;
+
+    uint64_t us = cycles_to_ns(cycles);
+    do_div(us, 1000);
+    cprintf("%-22s %8u %12llu %10llu\n", what, faults, cycles, us);
+
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+}
+
+/* populate_bench - compare demand faulting and VM_POPULATE on a region of @mb megabytes */
+void
+populate_bench(size_t mb) {
+    if (mb == 0) {
+        return;
+    }
+    size_t nr_free = nr_free_pages();
+    size_t max_mb = (nr_free > POPBENCH_RESERVE) ? (nr_free - POPBENCH_RESERVE) / (1024 * 1024 / PGSIZE + 1) : 0;
+    if (max_mb == 0) {
+        cprintf("populatebench: not enough free memory\n");
+        return;
+    }
+    if (mb > max_mb) {
+        cprintf("populatebench: %u MB do not fit in free memory, using %u MB\n", mb, max_mb);
+        mb = max_mb;
+    }
+    size_t size = mb * 1024 * 1024;
+    cprintf("populatebench: %u MB, %u pages\n", mb, size / PGSIZE);
+    cprintf("                         faults       cycles         us\n");
+
+    uint32_t echo = trace_events[TRACE_pgfault].flags;
+    trace_events[TRACE_pgfault].flags &= ~TRACE_ECHO;
+    populate_bench_run("demand faults", size, VM_READ | VM_WRITE, 0);
+    populate_bench_run("demand + fault-around", size, VM_READ | VM_WRITE, FAULT_AROUND_MAX);
+    populate_bench_run("VM_POPULATE", size, VM_READ | VM_WRITE | VM_POPULATE, 0);
+    trace_events[TRACE_pgfault].flags = echo;
+}
@@ -0,0 +1,379 @@
+#include <defs.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sync.h>
+#include <error.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <spinlock.h>
+#include <softirq.h>
+#include <prefetch.h>
+
+/* *
+ * Stride prefetcher for swapped-out pages.
+ *
+ * Every vma remembers the page of its last fault and the distance, in
+ * pages, to the one before. When the same stride has been seen
+ * PREFETCH_CONFIDENCE times in a row, prefetch_fault queues the next
+ * pf_depth pages along it whose PTEs hold swap entries, and the prefetch
+ * softirq reads them in after the fault returns, maps them and puts them on
+ * the swap queue, the same as swap_in would. The softirq only trylocks the
+ * mm and swap locks and leaves PREFETCH_MIN_FREE pages free, a request it
+ * can not serve is dropped.
+ *
+ * At the next fault of the vma the pages read in since the last one are
+ * checked for the accessed bit: mostly unused halves pf_depth, all used
+ * doubles it up to PREFETCH_DEPTH_MAX. At 0 the vma is throttled until the
+ * stride has held for PREFETCH_RETRY faults, then it starts again at 1.
+ * Pages along the stride that are present do not fault, so a fault a whole
+ * number of strides further, up to PREFETCH_DEPTH_MAX + 1, still counts.
+ *
+ * A MADV_SEQUENTIAL vma prefetches the next PREFETCH_DEPTH_MAX pages at
+ * every fault without waiting for confidence, a MADV_RANDOM one never;
+ * prefetch_range reads a whole range in for MADV_WILLNEED.
+ * */
+
+#define PREFETCH_CONFIDENCE     2
+#define PREFETCH_RETRY          16
+#define PREFETCH_MIN_FREE       64
+#define PREFETCH_QUEUE_SIZE     32              // a power of 2
+#define PREFETCH_BUDGET         8
+
+static struct {
+    struct mm_struct *mm;
+    uintptr_t addr;
+} prefetch_queue[PREFETCH_QUEUE_SIZE];
+static unsigned int prefetch_rpos, prefetch_wpos;
+static spinlock_t prefetch_lock = SPINLOCK_INIT("prefetch");
+
+// set once check_swap is done, so that its fault sequence is not disturbed
+bool prefetch_enabled = 0;
+
+void
+prefetch_vma_init(struct vma_struct *vma) {
+    vma->pf_last = 0;
+    vma->pf_stride = 0;
+    vma->pf_confidence = 0;
+    vma->pf_depth = 1;
+    vma->pf_nr = 0;
+}
+
+/* prefetch_account - count the pages read in for @vma since its last fault, and adapt pf_depth */
+static void
+prefetch_account(struct mm_struct *mm, struct vma_struct *vma) {
+    int i, used = 0;
+    for (i = 0; i < vma->pf_nr; i ++) {
+        pte_t *ptep = get_pte(mm->pgdir, vma->pf_addr[i], 0);
+        if (ptep != NULL && (*ptep & (PTE_P | PTE_A)) == (PTE_P | PTE_A)) {
+            used ++;
+        }
+    }
+    vmm_stats.pf_used += used;
+    vmm_stats.pf_unused += vma->pf_nr - used;
+    if (vma->pf_nr - used > used) {
+        if ((vma->pf_depth /= 2) == 0) {
+            // keep the stride, but see it hold again before retrying
+            vma->pf_confidence = 1;
+            vmm_stats.pf_throttled ++;
+        }
+    }
+    else if (used == vma->pf_nr && vma->pf_depth < PREFETCH_DEPTH_MAX) {
+        vma->pf_depth *= 2;
+    }
+    vma->pf_nr = 0;
+}
+
+/* prefetch_stride - whether a fault @delta pages from the last one follows the stride of @vma */
+static bool
+prefetch_stride(struct vma_struct *vma, int delta) {
+    int stride = vma->pf_stride;
+    if (stride == 0 || delta % stride != 0) {
+        return 0;
+    }
+    int n = delta / stride;
+    return n >= 1 && n <= PREFETCH_DEPTH_MAX + 1;
+}
+
+/* prefetch_queue_add - queue @addr of @mm for the softirq, false if the queue is full */
+static bool
+prefetch_queue_add(struct mm_struct *mm, uintptr_t addr) {
+    bool intr_flag, ok = 0;
+    spin_lock_irqsave(&prefetch_lock, intr_flag);
+    if (prefetch_wpos - prefetch_rpos < PREFETCH_QUEUE_SIZE) {
+        prefetch_queue[prefetch_wpos % PREFETCH_QUEUE_SIZE].mm = mm;
+        prefetch_queue[prefetch_wpos % PREFETCH_QUEUE_SIZE].addr = addr;
+        prefetch_wpos ++;
+        ok = 1;
+    }
+    spin_unlock_irqrestore(&prefetch_lock, intr_flag);
+    return ok;
+}
+
+/* *
+ * prefetch_fault - record a fault of @mm at page @addr of @vma and queue the
+ * swapped-out pages predicted to fault next. Called by do_pgfault with the
+ * mm lock held, after the fault has been handled.
+ * */
+void
+prefetch_fault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr) {
+    if (!prefetch_enabled) {
+        return;
+    }
+    if (vma->pf_nr > 0) {
+        prefetch_account(mm, vma);
+    }
+    if (vma->pf_confidence > 0 && addr == vma->pf_last) {
+        // the write after a read fault of the same page
+        return;
+    }
+    int delta = (int)(addr - vma->pf_last) / PGSIZE;
+    if (vma->pf_confidence > 0 && prefetch_stride(vma, delta)) {
+        if (vma->pf_confidence < PREFETCH_RETRY) {
+            vma->pf_confidence ++;
+        }
+    }
+    else {
+        vma->pf_stride = delta;
+        vma->pf_confidence = 1;
+    }
+    vma->pf_last = addr;
+
+    int stride = vma->pf_stride, depth = vma->pf_depth;
+    if (vma->vm_advice == MADV_SEQUENTIAL) {
+        // told, not learnt: the next pages, as many as possible
+        stride = 1;
+        depth = PREFETCH_DEPTH_MAX;
+    }
+    else {
+        if (depth == 0) {
+            if (vma->pf_confidence < PREFETCH_RETRY) {
+                return;
+            }
+            depth = vma->pf_depth = 1;
+        }
+        if (vma->pf_confidence < PREFETCH_CONFIDENCE) {
+            return;
+        }
+    }
+
+    int i, queued = 0;
+    for (i = 1; i <= depth; i ++) {
+        uintptr_t la = addr + i * stride * PGSIZE;
+        if (la < vma->vm_start || la >= vma->vm_end) {
+            break;
+        }
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL || *ptep == 0 || (*ptep & PTE_P)) {
+            continue;
+        }
+        if (!prefetch_queue_add(mm, la)) {
+            vmm_stats.pf_dropped ++;
+            break;
+        }
+        queued ++;
+    }
+    if (queued > 0) {
+        vmm_stats.pf_queued += queued;
+        raise_softirq(PREFETCH_SOFTIRQ);
+    }
+}
+
+/* prefetch_page - read in the swapped-out page of @vma at @addr, whose PTE is @ptep, mm lock held */
+static int
+prefetch_page(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, pte_t *ptep) {
+    struct Page *page;
+    if (nr_free_pages() <= PREFETCH_MIN_FREE || (page = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    uint32_t perm = PTE_U;
+    if (vma->vm_flags & VM_WRITE) {
+        perm |= PTE_W;
+    }
+    int ret = swap_prefetch(mm, addr, ptep, page, perm);
+    if (ret != 0) {
+        free_page(page);
+    }
+    return ret;
+}
+
+/* prefetch_one - read in the page of @mm at @addr, if it is still swapped out */
+static int
+prefetch_one(struct mm_struct *mm, uintptr_t addr) {
+    if (!spin_trylock(&(mm->mm_lock))) {
+        return -E_BUSY;
+    }
+    int ret = 0;
+    struct vma_struct *vma = find_vma(mm, addr);
+    pte_t *ptep;
+    if (vma == NULL || vma->vm_start > addr ||
+        (ptep = get_pte(mm->pgdir, addr, 0)) == NULL || *ptep == 0 || (*ptep & PTE_P)) {
+        // unmapped or faulted in meanwhile
+        goto out;
+    }
+    if ((ret = prefetch_page(mm, vma, addr, ptep)) != 0) {
+        goto out;
+    }
+    if (vma->pf_nr < PREFETCH_DEPTH_MAX) {
+        vma->pf_addr[vma->pf_nr ++] = addr;
+    }
+    vmm_stats.pf_read ++;
+out:
+    spin_unlock(&(mm->mm_lock));
+    return ret;
+}
+
+/* *
+ * prefetch_range - read in the swapped-out pages of @vma in [@start, @end)
+ * right away, for MADV_WILLNEED, until free memory runs short. Returns how
+ * many were read. mm lock held.
+ * */
+int
+prefetch_range(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    uintptr_t la;
+    int n = 0;
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL) {
+            la = ROUNDDOWN(la, PTSIZE) + PTSIZE - PGSIZE;
+            continue;
+        }
+        if (*ptep == 0 || (*ptep & PTE_P)) {
+            continue;
+        }
+        if (prefetch_page(mm, vma, la, ptep) != 0) {
+            break;
+        }
+        n ++;
+    }
+    return n;
+}
+
+static bool
+prefetch_softirq(int budget) {
+    bool intr_flag;
+    while (1) {
+        struct mm_struct *mm = NULL;
+        uintptr_t addr;
+        bool empty;
+        spin_lock_irqsave(&prefetch_lock, intr_flag);
+        if (!(empty = (prefetch_rpos == prefetch_wpos))) {
+            mm = prefetch_queue[prefetch_rpos % PREFETCH_QUEUE_SIZE].mm;
+            addr = prefetch_queue[prefetch_rpos % PREFETCH_QUEUE_SIZE].addr;
+            prefetch_rpos ++;
+        }
+        spin_unlock_irqrestore(&prefetch_lock, intr_flag);
+        if (empty) {
+            return 0;
+        }
+        if (mm != NULL && prefetch_one(mm, addr) != 0) {
+            vmm_stats.pf_dropped ++;
+        }
+        if (-- budget == 0) {
+            return prefetch_rpos != prefetch_wpos;
+        }
+    }
+}
+
+/* prefetch_cancel - drop the queued requests of @mm, before it is freed */
+void
+prefetch_cancel(struct mm_struct *mm) {
+    bool intr_flag;
+    unsigned int i;
+    spin_lock_irqsave(&prefetch_lock, intr_flag);
+    for (i = prefetch_rpos; i != prefetch_wpos; i ++) {
+        if (prefetch_queue[i % PREFETCH_QUEUE_SIZE].mm == mm) {
+            // a NULL mm is skipped by the softirq
+            prefetch_queue[i % PREFETCH_QUEUE_SIZE].mm = NULL;
+        }
+    }
+    spin_unlock_irqrestore(&prefetch_lock, intr_flag);
+}
+
+void
+prefetch_init(void) {
+    open_softirq(PREFETCH_SOFTIRQ, prefetch_softirq, PREFETCH_BUDGET);
+    prefetch_enabled = 1;
+}
+
+#define CHECK_PF_BASE           0x10000000
+#define CHECK_PF_NPAGE          64
+// a made-up swap entry: not present, never read, the softirq does not run before the mm is gone
+#define CHECK_PF_ENTRY          (1 << 8)
+
+/* check_pf_fault - a fault of @mm at page @n of the check vma, as do_pgfault reports it */
+static void
+check_pf_fault(struct mm_struct *mm, struct vma_struct *vma, int n) {
+    spin_lock(&(mm->mm_lock));
+    prefetch_fault(mm, vma, CHECK_PF_BASE + n * PGSIZE);
+    spin_unlock(&(mm->mm_lock));
+}
+
+/* *
+ * check_prefetch - the confidence threshold, the throttling and its retry,
+ * and prefetch_cancel from mm_destroy. Runs before the swap disk is set up:
+ * every PTE of the vma holds CHECK_PF_ENTRY, and what the softirq would
+ * read in is only simulated.
+ * */
+void
+check_prefetch(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    size_t throttled = vmm_stats.pf_throttled, dropped = vmm_stats.pf_dropped, read = vmm_stats.pf_read;
+    bool enabled = prefetch_enabled;
+    struct mm_struct *mm = mm_create();
+    struct vma_struct *vma;
+    uintptr_t la;
+    int n;
+    assert(mm != NULL && mm_setup_pgdir(mm) == 0);
+    assert(prefetch_rpos == prefetch_wpos);
+    vma = insert_vma_struct(mm, vma_create(CHECK_PF_BASE, CHECK_PF_BASE + CHECK_PF_NPAGE * PGSIZE, VM_READ | VM_WRITE));
+    for (la = CHECK_PF_BASE; la < vma->vm_end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 1);
+        assert(ptep != NULL);
+        *ptep = CHECK_PF_ENTRY;
+    }
+    prefetch_enabled = 1;
+
+    // a stride of 2 pages is trusted at its second fault
+    check_pf_fault(mm, vma, 0);
+    check_pf_fault(mm, vma, 2);
+    assert(vma->pf_stride == 2 && vma->pf_confidence == 1 && prefetch_wpos == prefetch_rpos);
+    check_pf_fault(mm, vma, 4);
+    assert(vma->pf_confidence == PREFETCH_CONFIDENCE && prefetch_wpos - prefetch_rpos == 1);
+    assert(prefetch_queue[prefetch_rpos % PREFETCH_QUEUE_SIZE].mm == mm);
+    assert(prefetch_queue[prefetch_rpos % PREFETCH_QUEUE_SIZE].addr == CHECK_PF_BASE + 6 * PGSIZE);
+
+    // the page read in is not used by the next fault, two strides on: throttled
+    vma->pf_addr[0] = CHECK_PF_BASE + 6 * PGSIZE;
+    vma->pf_nr = 1;
+    check_pf_fault(mm, vma, 8);
+    assert(vma->pf_depth == 0 && vmm_stats.pf_throttled == throttled + 1);
+    assert(vma->pf_stride == 2 && prefetch_wpos - prefetch_rpos == 1);
+
+    // and retried at depth 1 once the stride has held for PREFETCH_RETRY faults
+    for (n = 10; vma->pf_confidence < PREFETCH_RETRY - 1; n += 2) {
+        check_pf_fault(mm, vma, n);
+        assert(vma->pf_depth == 0 && prefetch_wpos - prefetch_rpos == 1);
+    }
+    check_pf_fault(mm, vma, n);
+    assert(vma->pf_depth == 1 && prefetch_wpos - prefetch_rpos == 2);
+    assert(prefetch_queue[(prefetch_wpos - 1) % PREFETCH_QUEUE_SIZE].addr == CHECK_PF_BASE + (n + 2) * PGSIZE);
+
+    prefetch_enabled = enabled;
+    for (la = CHECK_PF_BASE; la < vma->vm_end; la += PGSIZE) {
+        *get_pte(mm->pgdir, la, 0) = 0;
+    }
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    // mm_destroy cancels the requests, the softirq then passes over them
+    mm_destroy(mm);
+    assert(prefetch_queue[prefetch_rpos % PREFETCH_QUEUE_SIZE].mm == NULL);
+    assert(prefetch_queue[(prefetch_rpos + 1) % PREFETCH_QUEUE_SIZE].mm == NULL);
+    assert(!prefetch_softirq(PREFETCH_BUDGET) && prefetch_rpos == prefetch_wpos);
+    assert(vmm_stats.pf_dropped == dropped && vmm_stats.pf_read == read);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_prefetch() succeeded!\n");
+}
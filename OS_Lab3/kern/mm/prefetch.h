@@ -0,0 +1,17 @@
+#ifndef __KERN_MM_PREFETCH_H__
+#define __KERN_MM_PREFETCH_H__
+
+#include <defs.h>
+#include <vmm.h>
+
+void prefetch_init(void);
+void prefetch_vma_init(struct vma_struct *vma);
+void prefetch_fault(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr);
+void prefetch_cancel(struct mm_struct *mm);
+int prefetch_range(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end);
+void prefetch_bench(int npage, int stride);
+void check_prefetch(void);
+
+extern bool prefetch_enabled;
+
+#endif /* !__KERN_MM_PREFETCH_H__ */
@@ -0,0 +1,129 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sync.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <swap.h>
+#include <clock.h>
+#include <trace.h>
+#include <prefetch.h>
+
+/* *
+ * Strided swap-in benchmark, run from the kmonitor with `prefetchbench`.
+ *
+ * Every page of a region is written once and then all of them are swapped
+ * out. Then every @stride-th page is read back, with interrupts enabled so
+ * that the prefetch softirq runs when a fault returns: with the prefetcher
+ * off, on, on but the region advised MADV_RANDOM, and after MADV_WILLNEED
+ * on the region, which is timed with the pass. It prints the faults taken,
+ * the pages read in ahead by the prefetcher or MADV_WILLNEED and the cycles
+ * of the strided pass. The page fault and swap echo is off meanwhile.
+ * */
+
+#define PFBENCH_BASE            0x10000000
+// pages left free beside the region, for page tables and the kernel
+#define PFBENCH_RESERVE         256
+
+static void
+prefetch_bench_run(const char *what, int npage, int stride, bool on, int advice) {
+    struct mm_struct *mm = mm_create();
+    uintptr_t la, end = PFBENCH_BASE + npage * PGSIZE;
+    bool intr_flag;
+    assert(mm != NULL);
+    if (mm_setup_pgdir(mm) != 0) {
+        mm_destroy(mm);
+        cprintf("prefetchbench: out of memory\n");
+        return;
+    }
+    mm->fault_around_max = 0;
+    assert(mm_map(mm, PFBENCH_BASE, npage * PGSIZE, VM_READ | VM_WRITE, NULL) == 0);
+
+    local_intr_save(intr_flag);
+    assert(check_mm_struct == NULL);
+    check_mm_struct = mm;
+    lcr3(PADDR(mm->pgdir));
+    for (la = PFBENCH_BASE; la < end; la += PGSIZE) {
+        *(volatile uintptr_t *)la = la;
+    }
+    spin_lock(&(mm->mm_lock));
+    int nr_out = swap_out(mm, npage, 0);
+    spin_unlock(&(mm->mm_lock));
+    if (advice == MADV_RANDOM) {
+        assert(mm_advise(mm, PFBENCH_BASE, npage * PGSIZE, advice) == 0);
+    }
+
+    bool enabled = prefetch_enabled;
+    prefetch_enabled = on;
+    unsigned int faults = pgfault_num;
+    size_t read = vmm_stats.pf_read + vmm_stats.advice_willneed;
+    uint64_t start = rdtsc();
+    if (advice == MADV_WILLNEED) {
+        assert(mm_advise(mm, PFBENCH_BASE, npage * PGSIZE, advice) == 0);
+    }
+    intr_enable();
+    for (la = PFBENCH_BASE; la < end; la += stride * PGSIZE) {
+        assert(*(volatile uintptr_t *)la == la);
+    }
+    intr_disable();
+    uint64_t cycles = rdtsc() - start;
+    faults = pgfault_num - faults;
+    read = vmm_stats.pf_read + vmm_stats.advice_willneed - read;
+    prefetch_enabled = enabled;
+
+    lcr3(boot_cr3);
+    check_mm_struct = NULL;
+    local_intr_restore(intr_flag);
+
+    uint64_t us = cycles_to_ns(cycles);
+    do_div(us, 1000);
+    cprintf("%-14s %8d %8u %8u %12llu %10llu\n", what, nr_out, faults, read, cycles, us);
+
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+}
+
+/* prefetch_bench - read back every @stride-th page of @npage swapped-out pages */
+void
+prefetch_bench(int npage, int stride) {
+    if (npage <= 0 || stride <= 0) {
+        return;
+    }
+    if (!swap_init_ok) {
+        cprintf("prefetchbench: no swap\n");
+        return;
+    }
+    size_t nr_free = nr_free_pages();
+    int max = (nr_free > PFBENCH_RESERVE) ? nr_free - PFBENCH_RESERVE : 0;
+    if (max > max_swap_offset / 2) {
+        max = max_swap_offset / 2;
+    }
+    if (max == 0) {
+        cprintf("prefetchbench: not enough free memory\n");
+        return;
+    }
+    if (npage > max) {
+        cprintf("prefetchbench: %d pages do not fit in memory or swap, using %d\n", npage, max);
+        npage = max;
+    }
+    cprintf("prefetchbench: %d pages, every %d-th read back\n", npage, stride);
+    cprintf("                swapped   faults  prefetched       cycles         us\n");
+
+    uint32_t echo[3] = {
+        trace_events[TRACE_pgfault].flags, trace_events[TRACE_swap_out].flags, trace_events[TRACE_swap_in].flags,
+    };
+    trace_events[TRACE_pgfault].flags &= ~TRACE_ECHO;
+    trace_events[TRACE_swap_out].flags &= ~TRACE_ECHO;
+    trace_events[TRACE_swap_in].flags &= ~TRACE_ECHO;
+    prefetch_bench_run("no prefetch", npage, stride, 0, MADV_NORMAL);
+    prefetch_bench_run("stride prefetch", npage, stride, 1, MADV_NORMAL);
+    prefetch_bench_run("MADV_RANDOM", npage, stride, 1, MADV_RANDOM);
+    prefetch_bench_run("MADV_WILLNEED", npage, stride, 1, MADV_WILLNEED);
+    trace_events[TRACE_pgfault].flags = echo[0];
+    trace_events[TRACE_swap_out].flags = echo[1];
+    trace_events[TRACE_swap_in].flags = echo[2];
+}
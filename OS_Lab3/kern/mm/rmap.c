@@ -0,0 +1,331 @@
+#include <defs.h>
+#include <list.h>
+#include <sync.h>
+#include <assert.h>
+#include <error.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <spinlock.h>
+#include <rmap.h>
+
+/* *
+ * Reverse mapping: from a frame to every (mm, virtual address) whose PTE
+ * maps it, so that swap_out can write out a page shared by mm_dup and
+ * take down all of its mappings, not only the one at pra_vaddr.
+ *
+ * Most pages are mapped once, that mapping is kept in the Page itself,
+ * rmap_mm and rmap_va, and costs no allocation. Each further one is an
+ * rmap_item on the rmap_chain of the page. The items come from whole
+ * pages, an rmap_slab header followed by the items; a slab with a free
+ * item is on rmap_slabs and an empty one goes back to the pmm at once.
+ * The zero page is never reclaimed and not recorded, nor are the kernel's
+ * own mappings.
+ *
+ * A mapping that could not be recorded for lack of memory only keeps its
+ * page in memory: swap_out writes out a page only when its reference count
+ * equals the mappings found, and a page mapped by a path that records
+ * nothing is still written out if pra_vaddr in the mm of its swap queue
+ * is its only mapping, as before.
+ *
+ * The rmap lock is taken after an mm lock and the swap lock, and before
+ * the pmm lock; the prefetch softirq takes it too. rmap_unmap_prepare only
+ * tries the mm locks of the other mms mapping a page, the page is passed
+ * over if one is busy.
+ * */
+
+struct rmap_item {
+    struct mm_struct *mm;
+    uintptr_t va;
+    struct rmap_item *next;         // on the rmap_chain of the page, or the free list of the slab
+};
+
+struct rmap_slab {
+    list_entry_t slab_link;         // on rmap_slabs while it has a free item
+    struct rmap_item *free;
+    int inuse;
+};
+
+#define RMAP_SLAB_ITEMS         ((PGSIZE - sizeof(struct rmap_slab)) / sizeof(struct rmap_item))
+
+#define le2slab(le)             to_struct((le), struct rmap_slab, slab_link)
+
+static list_entry_t rmap_slabs = {&rmap_slabs, &rmap_slabs};
+
+static struct lockstat rmap_lockstat = LOCKSTAT_INIT("rmap");
+static spinlock_t rmap_lock = SPINLOCK_INIT_STAT("rmap", &rmap_lockstat);
+
+// rmap_slab_init - carve @page into rmap_items; rmap lock held
+static void
+rmap_slab_init(struct Page *page) {
+    struct rmap_slab *slab = page2kva(page);
+    struct rmap_item *item = (struct rmap_item *)(slab + 1);
+    int i;
+    slab->free = NULL;
+    for (i = 0; i < RMAP_SLAB_ITEMS; i ++, item ++) {
+        item->next = slab->free;
+        slab->free = item;
+    }
+    slab->inuse = 0;
+    list_add(&rmap_slabs, &(slab->slab_link));
+}
+
+// rmap_item_alloc - a free rmap_item, NULL if no slab has one; rmap lock held
+static struct rmap_item *
+rmap_item_alloc(void) {
+    if (list_empty(&rmap_slabs)) {
+        return NULL;
+    }
+    struct rmap_slab *slab = le2slab(list_next(&rmap_slabs));
+    struct rmap_item *item = slab->free;
+    slab->free = item->next;
+    if (++ slab->inuse == RMAP_SLAB_ITEMS) {
+        list_del(&(slab->slab_link));
+    }
+    vmm_stats.rmap_items ++;
+    return item;
+}
+
+// rmap_item_free - give @item back to its slab, and the slab to the pmm if it is empty; rmap lock held
+static void
+rmap_item_free(struct rmap_item *item) {
+    struct rmap_slab *slab = (struct rmap_slab *)ROUNDDOWN((uintptr_t)item, PGSIZE);
+    if (slab->inuse == RMAP_SLAB_ITEMS) {
+        list_add(&rmap_slabs, &(slab->slab_link));
+    }
+    item->next = slab->free;
+    slab->free = item;
+    vmm_stats.rmap_items --;
+    if (-- slab->inuse == 0) {
+        list_del(&(slab->slab_link));
+        free_page(kva2page(slab));
+    }
+}
+
+// rmap_mapped - whether the mapping of @page by @mm at @va is recorded; rmap lock held
+static bool
+rmap_mapped(struct Page *page, struct mm_struct *mm, uintptr_t va) {
+    struct rmap_item *item;
+    if (page->rmap_mm == mm && page->rmap_va == va) {
+        return 1;
+    }
+    for (item = page->rmap_chain; item != NULL; item = item->next) {
+        if (item->mm == mm && item->va == va) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* *
+ * rmap_add - record that @mm maps @page at @va, after the PTE is set and
+ * the reference taken. Recording it again does nothing. Only a page mapped
+ * more than once needs memory for it: then this may allocate a page, and
+ * must not be called with the swap lock held.
+ * */
+void
+rmap_add(struct Page *page, struct mm_struct *mm, uintptr_t va) {
+    struct Page *slab = NULL;
+    struct rmap_item *item;
+    bool intr_flag;
+    spin_lock_irqsave(&rmap_lock, intr_flag);
+    while (!rmap_mapped(page, mm, va)) {
+        if (page->rmap_mm == NULL) {
+            page->rmap_mm = mm;
+            page->rmap_va = va;
+            break;
+        }
+        if ((item = rmap_item_alloc()) == NULL && slab != NULL) {
+            rmap_slab_init(slab);
+            slab = NULL;
+            item = rmap_item_alloc();
+        }
+        if (item != NULL) {
+            item->mm = mm;
+            item->va = va;
+            item->next = page->rmap_chain;
+            page->rmap_chain = item;
+            break;
+        }
+        // alloc_page may write pages out, which takes the rmap lock
+        spin_unlock_irqrestore(&rmap_lock, intr_flag);
+        slab = alloc_page();
+        spin_lock_irqsave(&rmap_lock, intr_flag);
+        if (slab == NULL) {
+            vmm_stats.rmap_nomem ++;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&rmap_lock, intr_flag);
+    if (slab != NULL) {
+        free_page(slab);
+    }
+}
+
+/* *
+ * rmap_remove - forget the mapping of @page at @va in the page tables
+ * @pgdir, before its PTE is cleared; nothing if it was not recorded
+ * */
+void
+rmap_remove(struct Page *page, pde_t *pgdir, uintptr_t va) {
+    struct rmap_item *item, **itemp;
+    bool intr_flag;
+    spin_lock_irqsave(&rmap_lock, intr_flag);
+    if (page->rmap_mm != NULL && page->rmap_mm->pgdir == pgdir && page->rmap_va == va) {
+        // the first of the chain takes its place
+        if ((item = page->rmap_chain) != NULL) {
+            page->rmap_mm = item->mm;
+            page->rmap_va = item->va;
+            page->rmap_chain = item->next;
+            rmap_item_free(item);
+        }
+        else {
+            page->rmap_mm = NULL;
+        }
+    }
+    else {
+        for (itemp = &(page->rmap_chain); (item = *itemp) != NULL; itemp = &(item->next)) {
+            if (item->mm->pgdir == pgdir && item->va == va) {
+                *itemp = item->next;
+                rmap_item_free(item);
+                break;
+            }
+        }
+    }
+    spin_unlock_irqrestore(&rmap_lock, intr_flag);
+}
+
+static void
+rmap_unmap_unlock(struct rmap_unmap *ru) {
+    int i;
+    for (i = 0; i < ru->nr_locked; i ++) {
+        spin_unlock(&(ru->locked[i]->mm_lock));
+    }
+    ru->nr_locked = 0;
+}
+
+/* *
+ * rmap_unmap_one - add the mapping of @page by @m at @va to @ru, locking @m
+ * unless it is @mm, whose lock the caller of swap_out holds. -E_BUSY if @m
+ * is locked or @ru full, -E_INVAL if the PTE does not map @page. The mm
+ * lock comes before the rmap lock, held here, it is only tried.
+ * */
+static int
+rmap_unmap_one(struct rmap_unmap *ru, struct mm_struct *mm, struct mm_struct *m, struct Page *page, uintptr_t va) {
+    int i;
+    if (ru->nr == RMAP_UNMAP_MAX) {
+        return -E_BUSY;
+    }
+    if (m != mm) {
+        for (i = 0; i < ru->nr_locked && ru->locked[i] != m; i ++) {
+            /* empty */ ;
+        }
+        if (i == ru->nr_locked) {
+            if (!spin_trylock(&(m->mm_lock))) {
+                return -E_BUSY;
+            }
+            ru->locked[ru->nr_locked ++] = m;
+        }
+    }
+    pte_t *ptep = get_pte(m->pgdir, va, 0);
+    if (ptep == NULL || !(*ptep & PTE_P) || pte2page(*ptep) != page) {
+        return -E_INVAL;
+    }
+    ru->pgdir[ru->nr] = m->pgdir;
+    ru->va[ru->nr] = va;
+    ru->ptep[ru->nr] = ptep;
+    ru->nr ++;
+    return 0;
+}
+
+/* *
+ * rmap_unmap_prepare - find every mapping of @page, a swap victim taken
+ * off the queue of @mm, and lock the other mms mapping it, so that
+ * rmap_unmap_commit can take all of them down. Returns -E_BUSY if one of
+ * those mms is busy or a mapping is not recorded, the page can be tried
+ * again later; -E_INVAL if a mapping recorded, or pra_vaddr in @mm for a
+ * page with none, no longer maps it. Swap lock held.
+ * */
+int
+rmap_unmap_prepare(struct Page *page, struct mm_struct *mm, struct rmap_unmap *ru) {
+    struct rmap_item *item;
+    bool intr_flag;
+    int ret;
+    ru->nr = ru->nr_locked = 0;
+    spin_lock_irqsave(&rmap_lock, intr_flag);
+    if (page->rmap_mm == NULL) {
+        // mapped by a path that records nothing, see above
+        ret = rmap_unmap_one(ru, mm, mm, page, page->pra_vaddr);
+    }
+    else {
+        ret = rmap_unmap_one(ru, mm, page->rmap_mm, page, page->rmap_va);
+        for (item = page->rmap_chain; ret == 0 && item != NULL; item = item->next) {
+            ret = rmap_unmap_one(ru, mm, item->mm, page, item->va);
+        }
+    }
+    spin_unlock_irqrestore(&rmap_lock, intr_flag);
+    if (ret == 0 && ru->nr != page_ref(page)) {
+        ret = -E_BUSY;
+    }
+    if (ret != 0) {
+        rmap_unmap_unlock(ru);
+    }
+    return ret;
+}
+
+/* *
+ * rmap_unmap_commit - set every PTE found by rmap_unmap_prepare to @pte,
+ * the swap entry @page was written to, with one TLB flush for all of them,
+ * and forget the mappings. The references they held are still to be
+ * dropped by the caller.
+ * */
+void
+rmap_unmap_commit(struct Page *page, struct rmap_unmap *ru, pte_t pte) {
+    struct rmap_item *item;
+    bool intr_flag;
+    int i;
+    for (i = 0; i < ru->nr; i ++) {
+        *(ru->ptep[i]) = pte;
+    }
+    tlb_invalidate_each(ru->pgdir, ru->va, ru->nr);
+    spin_lock_irqsave(&rmap_lock, intr_flag);
+    page->rmap_mm = NULL;
+    while ((item = page->rmap_chain) != NULL) {
+        page->rmap_chain = item->next;
+        rmap_item_free(item);
+    }
+    spin_unlock_irqrestore(&rmap_lock, intr_flag);
+    rmap_unmap_unlock(ru);
+}
+
+/* *
+ * rmap_free_page - @page is about to be freed, every mapping of it should
+ * have been forgotten by now. Warn about any left, a missed rmap_remove,
+ * and give their rmap_items back. Not with the pmm lock held.
+ * */
+void
+rmap_free_page(struct Page *page) {
+    struct rmap_item *item;
+    bool intr_flag;
+    if (page->rmap_mm == NULL && page->rmap_chain == NULL) {
+        return;
+    }
+    spin_lock_irqsave(&rmap_lock, intr_flag);
+    if (page->rmap_mm != NULL) {
+        warn("rmap: page %08x freed while mapped at %08x\n", page2pa(page), page->rmap_va);
+        page->rmap_mm = NULL;
+    }
+    while ((item = page->rmap_chain) != NULL) {
+        warn("rmap: page %08x freed while mapped at %08x\n", page2pa(page), item->va);
+        page->rmap_chain = item->next;
+        rmap_item_free(item);
+    }
+    spin_unlock_irqrestore(&rmap_lock, intr_flag);
+}
+
+// rmap_unmap_abort - the page is not written out after all, unlock what rmap_unmap_prepare locked
+void
+rmap_unmap_abort(struct rmap_unmap *ru) {
+    rmap_unmap_unlock(ru);
+}
@@ -0,0 +1,32 @@
+#ifndef __KERN_MM_RMAP_H__
+#define __KERN_MM_RMAP_H__
+
+#include <defs.h>
+#include <mmu.h>
+#include <memlayout.h>
+#include <vmm.h>
+
+// the most mappings rmap_unmap_prepare takes down at once
+#define RMAP_UNMAP_MAX          16
+
+/* *
+ * rmap_unmap - the mappings of a page being written out, from
+ * rmap_unmap_prepare to rmap_unmap_commit or rmap_unmap_abort
+ * */
+struct rmap_unmap {
+    int nr;
+    pde_t *pgdir[RMAP_UNMAP_MAX];
+    uintptr_t va[RMAP_UNMAP_MAX];
+    pte_t *ptep[RMAP_UNMAP_MAX];
+    int nr_locked;
+    struct mm_struct *locked[RMAP_UNMAP_MAX];   // mm locks taken by prepare
+};
+
+void rmap_add(struct Page *page, struct mm_struct *mm, uintptr_t va);
+void rmap_remove(struct Page *page, pde_t *pgdir, uintptr_t va);
+int rmap_unmap_prepare(struct Page *page, struct mm_struct *mm, struct rmap_unmap *ru);
+void rmap_unmap_commit(struct Page *page, struct rmap_unmap *ru, pte_t pte);
+void rmap_unmap_abort(struct rmap_unmap *ru);
+void rmap_free_page(struct Page *page);
+
+#endif /* !__KERN_MM_RMAP_H__ */
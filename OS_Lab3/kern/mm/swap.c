@@ -6,6 +6,11 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <mmu.h>
+#include <trace.h>
+#include <spinlock.h>
+#include <error.h>
+#include <prefetch.h>
+#include <rmap.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
 #define CHECK_VALID_VIR_PAGE_NUM 5
@@ -19,6 +24,26 @@
 static struct swap_manager *sm;
 size_t max_swap_offset;
 
+// guards the swap manager's queues and the swap disk; taken after an
+// mm_lock and before the rmap and pmm locks
+static struct lockstat swap_lockstat = LOCKSTAT_INIT("swap");
+static spinlock_t swap_lock = SPINLOCK_INIT_STAT("swap", &swap_lockstat);
+
+/* *
+ * Swap slots are allocated next-fit from swap_map, which counts the swap
+ * entries in PTEs that refer to each slot: mm_dup makes several PTEs share
+ * one. Slot 0 is never used, an all-zero PTE means no mapping. Guarded by
+ * the swap lock.
+ * */
+#define SWAP_MAP_MAX            (1 << 15)
+
+static uint16_t *swap_map;
+static size_t swap_nr_slots;
+static size_t swap_next_slot = 1;
+
+// swap_out gives up after this many victims that can not be written out
+#define SWAP_OUT_MAX_SKIP       64
+
 volatile int swap_init_ok = 0;
 
 unsigned int swap_page[CHECK_VALID_VIR_PAGE_NUM];
@@ -38,6 +63,10 @@ swap_init(void)
      }
      
 
+     swap_nr_slots = (max_swap_offset < SWAP_MAP_MAX) ? max_swap_offset : SWAP_MAP_MAX;
+     swap_map = kmalloc(swap_nr_slots * sizeof(uint16_t));
+     memset(swap_map, 0, swap_nr_slots * sizeof(uint16_t));
+
      sm = &swap_manager_fifo;
      int r = sm->init();
      
@@ -46,6 +75,8 @@ swap_init(void)
           swap_init_ok = 1;
           cprintf("SWAP: manager = %s\n", sm->name);
           check_swap();
+          check_advise_swap();
+          prefetch_init();
      }
 
      return r;
@@ -57,29 +88,227 @@ swap_init_mm(struct mm_struct *mm)
      return sm->init_mm(mm);
 }
 
+/* *
+ * swap_exit_mm - take all pages off the queue of @mm, before it is freed.
+ * They may still be mapped elsewhere, but are not reclaimed any more.
+ * */
+void
+swap_exit_mm(struct mm_struct *mm)
+{
+     struct Page *page;
+     spin_lock(&swap_lock);
+     while (sm->swap_out_victim(mm, &page, 0) == 0) {
+          ClearPageSwap(page);
+     }
+     spin_unlock(&swap_lock);
+}
+
 int
 swap_tick_event(struct mm_struct *mm)
 {
-     return sm->tick_event(mm);
+     spin_lock(&swap_lock);
+     int r = sm->tick_event(mm);
+     spin_unlock(&swap_lock);
+     return r;
 }
 
 int
 swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
-     return sm->map_swappable(mm, addr, page, swap_in);
+     spin_lock(&swap_lock);
+     int r = sm->map_swappable(mm, addr, page, swap_in);
+     if (r == 0) {
+          SetPageSwap(page);
+     }
+     spin_unlock(&swap_lock);
+     return r;
+}
+
+/* *
+ * swap_map_swappable_batch - swap_map_swappable for the @n @pages, each
+ * at its pra_vaddr, taking the swap lock once
+ * */
+int
+swap_map_swappable_batch(struct mm_struct *mm, struct Page **pages, int n)
+{
+     int i, r = 0;
+     spin_lock(&swap_lock);
+     for (i = 0; i < n && r == 0; i ++) {
+          if ((r = sm->map_swappable(mm, pages[i]->pra_vaddr, pages[i], 0)) == 0) {
+               SetPageSwap(pages[i]);
+          }
+     }
+     spin_unlock(&swap_lock);
+     return r;
+}
+
+/* *
+ * swap_deactivate_batch - have the swap manager reclaim the @n @pages of
+ * @mm before its other pages, taking the swap lock once. Pages not on a
+ * queue are left alone.
+ * */
+void
+swap_deactivate_batch(struct mm_struct *mm, struct Page **pages, int n)
+{
+     int i;
+     spin_lock(&swap_lock);
+     for (i = 0; i < n; i ++) {
+          if (PageSwap(pages[i])) {
+               sm->deactivate(mm, pages[i]);
+          }
+     }
+     spin_unlock(&swap_lock);
+}
+
+/* *
+ * swap_page_unqueue - take @page off the queue it is on, if any; called
+ * when its last mapping goes away. The managers link their pages by
+ * pra_page_link, which can be unlinked without knowing the queue.
+ * */
+void
+swap_page_unqueue(struct Page *page)
+{
+     spin_lock(&swap_lock);
+     if (PageSwap(page)) {
+          list_del(&(page->pra_page_link));
+          ClearPageSwap(page);
+     }
+     spin_unlock(&swap_lock);
+}
+
+/* swap_entry_alloc - a free slot as a swap entry, 0 if the disk is full; swap lock held */
+static swap_entry_t
+swap_entry_alloc(void)
+{
+     size_t i, offset = swap_next_slot;
+     for (i = 1; i < swap_nr_slots; i ++, offset ++) {
+          if (offset >= swap_nr_slots) {
+               offset = 1;
+          }
+          if (swap_map[offset] == 0) {
+               swap_map[offset] = 1;
+               swap_next_slot = offset + 1;
+               return offset << 8;
+          }
+     }
+     return 0;
+}
+
+static void
+__swap_entry_free(swap_entry_t entry)
+{
+     size_t offset = swap_offset(entry);
+     assert(offset < swap_nr_slots && swap_map[offset] > 0);
+     swap_map[offset] --;
+}
+
+/* *
+ * swap_prefetch - read the page of @mm at @addr, whose PTE @ptep holds a
+ * swap entry, into @page and map it with @perm, for the prefetcher. It
+ * runs in softirq context and fails with -E_BUSY instead of waiting for
+ * the swap lock. The mapping was not present, no TLB holds it. mm lock held.
+ * */
+int
+swap_prefetch(struct mm_struct *mm, uintptr_t addr, pte_t *ptep, struct Page *page, uint32_t perm)
+{
+     if (!spin_trylock(&swap_lock)) {
+          return -E_BUSY;
+     }
+     swap_entry_t entry = *ptep;
+     int r = swapfs_read(entry, page);
+     if (r == 0) {
+          trace_swap_in(entry >> 8, addr);
+          __swap_entry_free(entry);
+          set_page_ref(page, 1);
+          *ptep = page2pa(page) | PTE_P | perm;
+          // its first mapping, rmap_add does not allocate
+          rmap_add(page, mm, addr);
+          page->pra_vaddr = addr;
+          if (sm->map_swappable(mm, addr, page, 1) == 0) {
+               SetPageSwap(page);
+          }
+     }
+     spin_unlock(&swap_lock);
+     return r;
+}
+
+/* swap_entry_dup - one more PTE refers to the slot of @entry */
+void
+swap_entry_dup(swap_entry_t entry)
+{
+     size_t offset = swap_offset(entry);
+     spin_lock(&swap_lock);
+     assert(offset < swap_nr_slots && swap_map[offset] > 0 && swap_map[offset] < 0xFFFF);
+     swap_map[offset] ++;
+     spin_unlock(&swap_lock);
+}
+
+/* swap_entry_free - a PTE no longer refers to the slot of @entry, free it with the last one */
+void
+swap_entry_free(swap_entry_t entry)
+{
+     spin_lock(&swap_lock);
+     __swap_entry_free(entry);
+     spin_unlock(&swap_lock);
+}
+
+/* swap_entry_count - how many PTEs refer to the slot of @entry, 0 once it is free */
+int
+swap_entry_count(swap_entry_t entry)
+{
+     size_t offset = swap_offset(entry);
+     assert(offset < swap_nr_slots);
+     return swap_map[offset];
 }
 
 int
 swap_set_unswappable(struct mm_struct *mm, uintptr_t addr)
 {
-     return sm->set_unswappable(mm, addr);
+     spin_lock(&swap_lock);
+     int r = sm->set_unswappable(mm, addr);
+     spin_unlock(&swap_lock);
+     return r;
 }
 
 volatile unsigned int swap_out_num=0;
 
+/* *
+ * swap_out_pick - the next victim of @mm that can be written out, with
+ * all of its mappings found by the reverse map, see rmap_unmap_prepare;
+ * a page shared with other mms is written out too, once they are all
+ * locked. A page whose mms are busy, or with a mapping not recorded,
+ * goes back on the queue; a page no longer mapped where it was recorded
+ * is dropped from it. Swap lock held.
+ * */
+static int
+swap_out_pick(struct mm_struct *mm, struct Page **ptr_page, struct rmap_unmap *ru, int in_tick)
+{
+     int skip;
+     for (skip = 0; skip < SWAP_OUT_MAX_SKIP; skip ++) {
+          struct Page *page;
+          int r = sm->swap_out_victim(mm, &page, in_tick);
+          if (r != 0) {
+               return r;
+          }
+          ClearPageSwap(page);
+          if ((r = rmap_unmap_prepare(page, mm, ru)) == -E_INVAL) {
+               continue;
+          }
+          if (r != 0) {
+               if (sm->map_swappable(mm, page->pra_vaddr, page, 0) == 0) {
+                    SetPageSwap(page);
+               }
+               vmm_stats.rmap_busy ++;
+               continue;
+          }
+          *ptr_page = page;
+          return 0;
+     }
+     return -E_NO_MEM;
+}
 
 /**
- * 参数mm，指定对应的内存管理器
+ * 参数mm，指定对应的内存管理器，调用者须持有mm->mm_lock(反向映射只对其余的mm加锁)
  * 参数n，指定需要换出到swap扇区的物理页个数
  * 参数in_tick，可以用于发生时钟中断时，定时进行主动的换出操作，腾出更多的物理空闲页
  * */
@@ -88,55 +317,58 @@ int
 swap_out(struct mm_struct *mm, int n, int in_tick)
 {
      int i;
+     assert(spin_holding(&(mm->mm_lock)));
+     spin_lock(&swap_lock);
      for (i = 0; i != n; ++ i)
      {
           uintptr_t v;
-          //struct Page **ptr_page=NULL;
           struct Page *page;
-          // cprintf("i %d, SWAP: call swap_out_victim\n",i);
+          struct rmap_unmap ru;
           // 由swap置换管理器，选出需要被(被置换到swap磁盘扇区)的page，令page指针变量指向其指针
-          int r = sm->swap_out_victim(mm, &page, in_tick);
+          int r = swap_out_pick(mm, &page, &ru, in_tick);
           if (r != 0) {
                //挑选page失败
                cprintf("i %d, swap_out: call swap_out_victim failed\n",i);
                break;
           }          
-          //assert(!PageReserved(page));
-
-          //cprintf("SWAP: choose victim page 0x%08x\n", page);
-          
           //获得挑选出的物理页对应的虚拟地址
           v=page->pra_vaddr; 
-          //获得page->pra_vaddr线性地址对应的二级页表项
-          pte_t *ptep = get_pte(mm->pgdir, v, 0);
-          assert((*ptep & PTE_P) != 0);
 
+          // 分配一个空闲的swap扇区槽位，构成swap_entry_t (高24位为槽位号，0号槽位保留，用于区别未映射的页表项)
+          swap_entry_t entry = swap_entry_alloc();
+          if (entry == 0) {
+                    cprintf("SWAP: no free slot\n");
+                    rmap_unmap_abort(&ru);
+                    sm->map_swappable(mm, v, page, 0);
+                    SetPageSwap(page);
+                    break;
+          }
           // 将其写入swap磁盘
-          // page->pra_vaddr/PGSIZE = 虚拟地址对应的二级页表项索引(前20位)；
-          // (page->pra_vaddr/PGSIZE) + 1 （+1为了在页表项中区别 0 和 swap 分区的映射）
-          // ((page->pra_vaddr/PGSIZE) + 1) << 8，为了构成swap_entry_t的高24位
-          // 举个例子：
-          // 假设page->pra_vaddr = 0x0000100,则page->pra_vaddr/PGSIZE = 0x00000001
-          // page->pra_vaddr/PGSIZE + 1 = 0x00000002
-          // 对应的swap_entry_t = 0x00000002 << 8 = 0x00000200,高24位为0x000002
-
-          if (swapfs_write( (page->pra_vaddr/PGSIZE+1)<<8, page) != 0) {
+          if (swapfs_write(entry, page) != 0) {
                     cprintf("SWAP: failed to save\n");
+                    __swap_entry_free(entry);
+                    rmap_unmap_abort(&ru);
                     //当前物理页写入swap，交换失败，重新加入swap管理器
                     sm->map_swappable(mm, v, page, 0);
+                    SetPageSwap(page);
                     continue;
           }
           else {
                     //交换成功
-                    cprintf("swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", i, v, page->pra_vaddr/PGSIZE+1);
-                    //设置ptep二级页表项的值
-                    *ptep = (page->pra_vaddr/PGSIZE+1)<<8;
-                    //释放、归还
+                    trace_swap_out(i, v, entry >> 8);
+                    //映射该页的每一个二级页表项都引用这个swap槽位
+                    swap_map[swap_offset(entry)] += ru.nr - 1;
+                    if (ru.nr > 1) {
+                         vmm_stats.rmap_shared_out ++;
+                    }
+                    //设置这些二级页表项的值，并一次性刷新它们的TLB快表
+                    rmap_unmap_commit(page, &ru, entry);
+                    //释放、归还(每个映射持有的引用一并放掉)
+                    set_page_ref(page, 0);
                     free_page(page);
           }
-          // 由于对应二级页表项出现了变化，刷新TLB快表
-          tlb_invalidate(mm->pgdir, v);
      }
+     spin_unlock(&swap_lock);
      return i;
 }
 
@@ -152,11 +384,16 @@ swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result)
     
      int r;
      // 将磁盘中读入的一整个物理页数据，写入result(此时的ptep二级页表项中存放的是swap_entry_t结构的数据)
-     if ((r = swapfs_read((*ptep), result)) != 0)
+     spin_lock(&swap_lock);
+     r = swapfs_read((*ptep), result);
+     spin_unlock(&swap_lock);
+     if (r != 0)
      {
         assert(r!=0);
      }
-     cprintf("swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", (*ptep)>>8, addr);
+     trace_swap_in((*ptep)>>8, addr);
+     // 此页表项不再引用该swap槽位(mm_dup共享的槽位，在最后一个引用者换入后才释放)
+     swap_entry_free(*ptep);
      // 令参数ptr_result指向已被换入内存中的result Page结构
      *ptr_result=result;
      return 0;
@@ -221,6 +458,8 @@ check_swap(void)
 
      extern struct mm_struct *check_mm_struct;
      assert(check_mm_struct == NULL);
+     // the fifo checks expect one page per fault
+     mm->fault_around_max = 0;
 
      check_mm_struct = mm;
 
@@ -282,13 +521,14 @@ check_swap(void)
      assert(ret==0);
      
      //restore kernel mem env
-     for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
-         free_pages(check_rp[i],1);
-     } 
-
-     //free_page(pte2page(*temp_ptep));
+     //拆除映射：释放物理页(连同反向映射)、swap槽位和页表
+     spin_lock(&(mm->mm_lock));
+     unmap_range(mm, BEING_CHECK_VALID_VADDR, CHECK_VALID_VADDR);
+     spin_unlock(&(mm->mm_lock));
+     assert(pgdir[0] == 0);
      
      mm_destroy(mm);
+     check_mm_struct = NULL;
          
      nr_free = nr_free_store;
      free_list = free_list_store;
@@ -53,6 +53,9 @@ struct swap_manager
      /* Try to swap out a page, return then victim */
      // 当试图换出一个物理页时，返回被选中的页面(被牺牲的页面)
      int (*swap_out_victim) (struct mm_struct *mm, struct Page **ptr_page, int in_tick);
+     /* Move a queued page of the mm to where victims are taken from */
+     // 将mm队列中的页面移到最先被换出的位置
+     int (*deactivate)      (struct mm_struct *mm, struct Page *page);
      /* check the page relpacement algorithm */
      int (*check_swap)(void);        
 };
@@ -60,11 +63,19 @@ struct swap_manager
 extern volatile int swap_init_ok;
 int swap_init(void);
 int swap_init_mm(struct mm_struct *mm);
+void swap_exit_mm(struct mm_struct *mm);
 int swap_tick_event(struct mm_struct *mm);
 int swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in);
+int swap_map_swappable_batch(struct mm_struct *mm, struct Page **pages, int n);
 int swap_set_unswappable(struct mm_struct *mm, uintptr_t addr);
+void swap_deactivate_batch(struct mm_struct *mm, struct Page **pages, int n);
+void swap_page_unqueue(struct Page *page);
+void swap_entry_dup(swap_entry_t entry);
+void swap_entry_free(swap_entry_t entry);
+int swap_entry_count(swap_entry_t entry);
 int swap_out(struct mm_struct *mm, int n, int in_tick);
 int swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result);
+int swap_prefetch(struct mm_struct *mm, uintptr_t addr, pte_t *ptep, struct Page *page, uint32_t perm);
 
 //#define MEMBER_OFFSET(m,t) ((int)(&((t *)0)->m))
 //#define FROM_MEMBER(m,t,a) ((t *)((char *)(a) - MEMBER_OFFSET(m,t)))
@@ -2,9 +2,11 @@
 #include <x86.h>
 #include <stdio.h>
 #include <string.h>
+#include <pmm.h>
 #include <swap.h>
 #include <swap_fifo.h>
 #include <list.h>
+#include <error.h>
 
 /* [wikipedia]The simplest Page Replacement Algorithm(PRA) is a FIFO algorithm. The first-in, first-out
  * page replacement algorithm is a low-overhead algorithm that requires little book-keeping on
@@ -17,7 +19,7 @@
  *
  * Details of FIFO PRA
  * (1) Prepare: In order to implement FIFO PRA, we should manage all swappable pages, so we can
- *              link these pages into pra_list_head according the time order. At first you should
+ *              link these pages into mm->swap_list according the time order. At first you should
  *              be familiar to the struct list in list.h. struct list is a simple doubly linked list
  *              implementation. You should know howto USE: list_init, list_add(list_add_after),
  *              list_add_before, list_del, list_next, list_prev. Another tricky method is to transform
@@ -25,22 +27,22 @@
  *              le2page (in memlayout.h), (in future labs: le2vma (in vmm.h), le2proc (in proc.h),etc.
  */
 
-list_entry_t pra_list_head;
 /*
- * (2) _fifo_init_mm: init pra_list_head and let  mm->sm_priv point to the addr of pra_list_head.
- *              Now, From the memory control struct mm_struct, we can access FIFO PRA
+ * (2) _fifo_init_mm: init the queue head mm->swap_list and let mm->sm_priv point to it.
+ *              Now, From the memory control struct mm_struct, we can access FIFO PRA.
+ *              Every mm has a queue of its own, so the victims of an mm are its pages.
  */
 static int
 _fifo_init_mm(struct mm_struct *mm)
 {     
     //初始化先进先出链表队列
-    list_init(&pra_list_head);
-    mm->sm_priv = &pra_list_head;
+    list_init(&(mm->swap_list));
+    mm->sm_priv = &(mm->swap_list);
     //cprintf(" mm->sm_priv %x in fifo_init_mm\n",mm->sm_priv);
     return 0;
 }
 /*
- * (3)_fifo_map_swappable: According FIFO PRA, we should link the most recent arrival page at the back of pra_list_head qeueue
+ * (3)_fifo_map_swappable: According FIFO PRA, we should link the most recent arrival page at the back of mm->swap_list qeueue
  */
 static int
 _fifo_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
@@ -53,13 +55,13 @@ _fifo_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int
     assert(entry != NULL && head != NULL);
     //record the page access situlation
     /*LAB3 EXERCISE 2: YOUR CODE*/ 
-    //(1)link the most recent arrival page at the back of the pra_list_head qeueue.
+    //(1)link the most recent arrival page at the back of the mm->swap_list qeueue.
     // 将其加入队列的头部(先进先出，最新的page页被挂载在最头上)
     list_add(head, entry);
     return 0;
 }
 /*
- *  (4)_fifo_swap_out_victim: According FIFO PRA, we should unlink the  earliest arrival page in front of pra_list_head qeueue,
+ *  (4)_fifo_swap_out_victim: According FIFO PRA, we should unlink the  earliest arrival page in front of mm->swap_list qeueue,
  *                            then assign the value of *ptr_page to the addr of this page.
  */
 static int
@@ -71,12 +73,16 @@ _fifo_swap_out_victim(struct mm_struct *mm, struct Page ** ptr_page, int in_tick
     assert(in_tick==0);
     /* Select the victim */
     /*LAB3 EXERCISE 2: YOUR CODE*/ 
-    //(1)  unlink the  earliest arrival page in front of pra_list_head qeueue
+    //(1)  unlink the  earliest arrival page in front of mm->swap_list qeueue
     //(2)  assign the value of *ptr_page to the addr of this page
     /* Select the tail */
     // 找到头节点的前一个(双向循环链表 head的前一个节点=队列的最尾部节点)
     list_entry_t *le = head->prev;
-    assert(head!=le);
+    // 队列为空
+    if (le == head) {
+        *ptr_page = NULL;
+        return -E_NO_MEM;
+    }
     // 获得尾节点对应的page结构
     struct Page *p = le2page(le, pra_page_link);
     //将le节点从先进先出队列中删除
@@ -130,15 +136,44 @@ _fifo_check_swap(void) {
 }
 
 
+/*
+ * (5)_fifo_deactivate: move the queued @page to the front of mm->swap_list, where
+ *                        _fifo_swap_out_victim takes the next victim. It may still be
+ *                        on the queue of another mm that mapped it, and changes queue.
+ */
+static int
+_fifo_deactivate(struct mm_struct *mm, struct Page *page)
+{
+    list_entry_t *head=(list_entry_t*) mm->sm_priv;
+    list_entry_t *entry=&(page->pra_page_link);
+    assert(head != NULL);
+    list_del(entry);
+    list_add_before(head, entry);
+    return 0;
+}
+
 static int
 _fifo_init(void)
 {
     return 0;
 }
 
+/*
+ * (6)_fifo_set_unswappable: take the page @mm maps at @addr off the queue it is on, so that it
+ *                           is never a victim; map_swappable puts it back.
+ */
 static int
 _fifo_set_unswappable(struct mm_struct *mm, uintptr_t addr)
 {
+    pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+    if (ptep == NULL || !(*ptep & PTE_P)) {
+        return -E_INVAL;
+    }
+    struct Page *page = pte2page(*ptep);
+    if (PageSwap(page)) {
+        list_del(&(page->pra_page_link));
+        ClearPageSwap(page);
+    }
     return 0;
 }
 
@@ -156,5 +191,6 @@ struct swap_manager swap_manager_fifo =
      .map_swappable   = &_fifo_map_swappable,
      .set_unswappable = &_fifo_set_unswappable,
      .swap_out_victim = &_fifo_swap_out_victim,
+     .deactivate      = &_fifo_deactivate,
      .check_swap      = &_fifo_check_swap,
 };
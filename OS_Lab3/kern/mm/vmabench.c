@@ -0,0 +1,68 @@
+#include <defs.h>
+#include <stdio.h>
+#include <assert.h>
+#include <mmu.h>
+#include <pmm.h>
+#include <vmm.h>
+
+/* *
+ * Fragmented mapping workload, run from the kmonitor with `vmabench`.
+ *
+ * @n one-page vmas with the same flags are inserted out of order, even
+ * pages up then odd pages down, the way many small mappings end up next
+ * to each other, and then looked up at pseudo-random pages. It runs once
+ * without and once with vma merging and prints the vma count and the list
+ * steps per find_vma. Only vmas are created, no page is mapped.
+ * */
+
+#define VMABENCH_BASE           0x10000000
+#define VMABENCH_LOOKUPS        4
+
+static void
+vma_bench_run(int n, bool merge) {
+    struct mm_struct *mm = mm_create();
+    int i;
+    assert(mm != NULL);
+    mm->merge_vma = merge;
+    for (i = 0; i < n; i += 2) {
+        uintptr_t la = VMABENCH_BASE + i * PGSIZE;
+        insert_vma_struct(mm, vma_create(la, la + PGSIZE, VM_READ | VM_WRITE));
+    }
+    for (i = ((n - 1) | 1); i > 0; i -= 2) {
+        if (i < n) {
+            uintptr_t la = VMABENCH_BASE + i * PGSIZE;
+            insert_vma_struct(mm, vma_create(la, la + PGSIZE, VM_READ | VM_WRITE));
+        }
+    }
+
+    size_t lookups = vmm_stats.find_vma, misses = vmm_stats.find_vma_miss, steps = vmm_stats.find_vma_steps;
+    uint32_t seed = 12345;
+    for (i = 0; i < n * VMABENCH_LOOKUPS; i ++) {
+        seed = seed * 1103515245 + 12345;
+        uintptr_t la = VMABENCH_BASE + ((seed >> 16) % n) * PGSIZE;
+        assert(find_vma(mm, la) != NULL);
+    }
+    lookups = vmm_stats.find_vma - lookups;
+    misses = vmm_stats.find_vma_miss - misses;
+    steps = vmm_stats.find_vma_steps - steps;
+    cprintf("%-8s %8d %10u %10u %7u.%02u\n", merge ? "merge" : "no merge", mm->map_count,
+            lookups, misses, steps / lookups, (steps % lookups) * 100 / lookups);
+    mm_destroy(mm);
+}
+
+/* vma_bench - run the workload with @n one-page vmas */
+void
+vma_bench(int n) {
+    if (n <= 0) {
+        return;
+    }
+    // a vma takes a page of kmalloc
+    if (n > nr_free_pages() / 2) {
+        n = nr_free_pages() / 2;
+        cprintf("vmabench: not enough free memory, using %d vmas\n", n);
+    }
+    cprintf("vmabench: %d one-page vmas, %d lookups\n", n, n * VMABENCH_LOOKUPS);
+    cprintf("             vmas    lookups     misses  steps/lookup\n");
+    vma_bench_run(n, 0);
+    vma_bench_run(n, 1);
+}
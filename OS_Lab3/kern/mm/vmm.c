@@ -7,6 +7,10 @@
 #include <pmm.h>
 #include <x86.h>
 #include <swap.h>
+#include <trace.h>
+#include <atomic.h>
+#include <prefetch.h>
+#include <rmap.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
@@ -18,25 +22,81 @@
    golbal functions
      struct mm_struct * mm_create(void)
      void mm_destroy(struct mm_struct *mm)
+     int mm_setup_pgdir(struct mm_struct *mm)
+     void mm_put_pgdir(struct mm_struct *mm)
+     struct mm_struct *mm_dup(struct mm_struct *oldmm)
+     void exit_mmap(struct mm_struct *mm)
+     void unmap_range(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     void protect_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t perm)
      int do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr)
+   local functions
+     int dup_range(struct mm_struct *to, pde_t *from, uintptr_t start, uintptr_t end, bool locked, struct tlb_gather *tlb)
+     void tlb_gather_flush(struct tlb_gather *tlb)
+     void fault_around_update(struct mm_struct *mm, uintptr_t addr)
+     int fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm, struct Page *zero, int window)
+     void seq_reclaim_behind(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr)
+     struct Page *zero_page_get(void)
+     void page_add_rmap(struct Page *page, struct mm_struct *mm, uintptr_t la)
 --------------
   vma related functions:
    global functions
      struct vma_struct * vma_create (uintptr_t vm_start, uintptr_t vm_end,...)
-     void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
+     struct vma_struct *insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma)
      struct vma_struct * find_vma(struct mm_struct *mm, uintptr_t addr)
+     int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len)
+     int mm_protect(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags)
+     int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags, struct vma_struct **vma_store)
+     int mm_advise(struct mm_struct *mm, uintptr_t addr, size_t len, int advice)
+     int mm_mlock(struct mm_struct *mm, uintptr_t addr, size_t len)
+     int mm_munlock(struct mm_struct *mm, uintptr_t addr, size_t len)
    local functions
      inline void check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
+     void vma_remove(struct mm_struct *mm, struct vma_struct *vma)
+     struct vma_struct *vma_merge(struct mm_struct *mm, struct vma_struct *vma)
+     struct vma_struct *vma_split(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr)
+     int vma_range_split(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     bool vma_overlap(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     int populate_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t vm_flags)
+     void __mm_unmap(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     int __mm_mlock(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     int __mm_munlock(struct mm_struct *mm, uintptr_t start, uintptr_t end)
+     int lock_range(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end)
+     void unlock_range(struct mm_struct *mm, uintptr_t start, uintptr_t end)
 ---------------
    check correctness functions
      void check_vmm(void);
      void check_vma_struct(void);
+     void check_vma_merge(void);
+     void check_mlock(void);
+     void check_rmap(void);
+     void check_advise(void);
      void check_pgfault(void);
+     void check_advise_swap(void);
 */
 
 static void check_vmm(void);
 static void check_vma_struct(void);
+static void check_vma_merge(void);
+static void check_mlock(void);
+static void check_rmap(void);
+static void check_advise(void);
 static void check_pgfault(void);
+static void __mm_unmap(struct mm_struct *mm, uintptr_t start, uintptr_t end);
+static int populate_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t vm_flags);
+static int __mm_mlock(struct mm_struct *mm, uintptr_t start, uintptr_t end);
+static void mlock_uncharge(struct mm_struct *mm, size_t n);
+static void page_add_rmap(struct Page *page, struct mm_struct *mm, uintptr_t la);
+static struct Page * volatile zero_page;
+
+/* *
+ * Locked memory. The pages of a VM_LOCKED vma are all present and on no
+ * swap queue, so swap_out never picks them; faults in it do not queue the
+ * pages they map. The pages in locked vmas of all mms are bounded by
+ * mlock_limit, a 1/MLOCK_LIMIT_DIV of the memory free at boot by default.
+ * */
+size_t mlock_limit;
+static size_t mlock_pages;              // # of pages in VM_LOCKED vmas of all mms
+static spinlock_t mlock_lock = SPINLOCK_INIT("mlock");
 
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
@@ -50,6 +110,12 @@ mm_create(void) {
         mm->mmap_cache = NULL;
         mm->pgdir = NULL;
         mm->map_count = 0;
+        spin_lock_init(&(mm->mm_lock), "mm");
+        mm->fault_last = 0;
+        mm->fault_ahead = mm->fault_window = 0;
+        mm->fault_around_max = FAULT_AROUND_MAX;
+        mm->merge_vma = 1;
+        mm->locked_vm = 0;
         // 将mm设置进全局虚拟内存页替换管理器swap_manager   
         if (swap_init_ok) swap_init_mm(mm);
         else mm->sm_priv = NULL;
@@ -68,6 +134,9 @@ vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
         vma->vm_start = vm_start;
         vma->vm_end = vm_end;
         vma->vm_flags = vm_flags;
+        vma->vm_advice = MADV_NORMAL;
+        vma->vm_scan = vm_start;
+        prefetch_vma_init(vma);
     }
     return vma;
 }
@@ -81,12 +150,15 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     if (mm != NULL) {
         // 先从mmap_cache缓存中尝试查询
         vma = mm->mmap_cache;
+        vmm_stats.find_vma ++;
         //cache中的vma块不匹配
         if (!(vma != NULL && vma->vm_start <= addr && vma->vm_end > addr)) {
                 bool found = 0;
                 list_entry_t *list = &(mm->mmap_list), *le = list;
+                vmm_stats.find_vma_miss ++;
                 // 迭代mm->mmap_list中的每个节点
                 while ((le = list_next(le)) != list) {
+                    vmm_stats.find_vma_steps ++;
                     // 将vma链表节点转为vma
                     vma = le2vma(le, list_link);
                     // 判断addr是否在当前vma的映射范围内
@@ -119,10 +191,87 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next) {
 }
 
 
-// insert_vma_struct -insert vma in mm's list link
-// 将@vma按照指定规则插入进@mm的mm->mmap_list中
-void
-insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
+// vma_remove - take @vma off the list of @mm and free it, mm lock held
+static void
+vma_remove(struct mm_struct *mm, struct vma_struct *vma) {
+    list_del(&(vma->list_link));
+    mm->map_count --;
+    if (mm->mmap_cache == vma) {
+        mm->mmap_cache = NULL;
+    }
+    kfree(vma, sizeof(struct vma_struct));
+}
+
+/* *
+ * vma_merge - merge @vma with the neighbours it touches that have the same
+ * flags and advice. Returns the vma covering the range of @vma afterwards, which may
+ * be its previous neighbour; @vma itself is freed then. mm lock held.
+ * */
+static struct vma_struct *
+vma_merge(struct mm_struct *mm, struct vma_struct *vma) {
+    list_entry_t *list = &(mm->mmap_list), *le;
+    if ((le = list_prev(&(vma->list_link))) != list) {
+        struct vma_struct *prev = le2vma(le, list_link);
+        if (prev->vm_end == vma->vm_start && prev->vm_flags == vma->vm_flags &&
+            prev->vm_advice == vma->vm_advice) {
+            prev->vm_end = vma->vm_end;
+            vma_remove(mm, vma);
+            vma = prev;
+            vmm_stats.vma_merged ++;
+        }
+    }
+    if ((le = list_next(&(vma->list_link))) != list) {
+        struct vma_struct *next = le2vma(le, list_link);
+        if (vma->vm_end == next->vm_start && vma->vm_flags == next->vm_flags &&
+            vma->vm_advice == next->vm_advice) {
+            vma->vm_end = next->vm_end;
+            vma_remove(mm, next);
+            vmm_stats.vma_merged ++;
+        }
+    }
+    return vma;
+}
+
+/* *
+ * vma_split - split @vma at @addr, strictly inside it. @vma keeps the
+ * part below @addr, the new vma returned covers the rest. mm lock held.
+ * */
+static struct vma_struct *
+vma_split(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr) {
+    assert(vma->vm_start < addr && addr < vma->vm_end);
+    struct vma_struct *nvma = vma_create(addr, vma->vm_end, vma->vm_flags);
+    if (nvma != NULL) {
+        nvma->vm_mm = mm;
+        nvma->vm_advice = vma->vm_advice;
+        nvma->vm_scan = (vma->vm_scan > addr) ? vma->vm_scan : addr;
+        vma->vm_end = addr;
+        list_add_after(&(vma->list_link), &(nvma->list_link));
+        mm->map_count ++;
+        vmm_stats.vma_split ++;
+    }
+    return nvma;
+}
+
+// vma_range_split - split the vmas of @mm that cross @start or @end, mm lock held
+static int
+vma_range_split(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct vma_struct *vma;
+    if ((vma = find_vma(mm, start)) != NULL && vma->vm_start < start) {
+        if (vma_split(mm, vma, start) == NULL) {
+            return -E_NO_MEM;
+        }
+    }
+    if ((vma = find_vma(mm, end)) != NULL && vma->vm_start < end) {
+        if (vma_split(mm, vma, end) == NULL) {
+            return -E_NO_MEM;
+        }
+    }
+    return 0;
+}
+
+// __insert_vma_struct - insert_vma_struct with the mm lock held
+static struct vma_struct *
+__insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     assert(vma->vm_start < vma->vm_end);
     list_entry_t *list = &(mm->mmap_list);
     list_entry_t *le_prev = list, *le_next;
@@ -156,17 +305,262 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     list_add_after(le_prev, &(vma->list_link));
     // mm包含的vma块数量自增1
     mm->map_count ++;
+    if (mm->merge_vma) {
+        vma = vma_merge(mm, vma);
+    }
+    return vma;
+}
+
+// insert_vma_struct -insert vma in mm's list link
+// 将@vma按照指定规则插入进@mm的mm->mmap_list中
+// With mm->merge_vma, @vma is merged with the neighbours it touches that
+// have the same flags and may be freed: use the vma returned instead.
+struct vma_struct *
+insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
+    spin_lock(&(mm->mm_lock));
+    vma = __insert_vma_struct(mm, vma);
+    spin_unlock(&(mm->mm_lock));
+    return vma;
+}
+
+// vma_overlap - whether a vma of @mm intersects [@start, @end), mm lock held
+static bool
+vma_overlap(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_end > start) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* *
+ * mm_map - map [@addr, @addr + @len), rounded out to pages, in @mm with
+ * @vm_flags, and store the vma covering it in @vma_store if not NULL.
+ * Fails with -E_INVAL if the range is in use. With VM_POPULATE the pages
+ * are mapped right away, see populate_range; if memory runs short the
+ * rest is left to page faults. With VM_LOCKED the range is locked as by
+ * mm_mlock, and nothing is mapped if that fails.
+ * */
+int
+mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags, struct vma_struct **vma_store) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    struct vma_struct *vma;
+    if (!(start < end && end <= KERNBASE)) {
+        return -E_INVAL;
+    }
+    if ((vma = vma_create(start, end, vm_flags & ~(VM_POPULATE | VM_LOCKED))) == NULL) {
+        return -E_NO_MEM;
+    }
+    spin_lock(&(mm->mm_lock));
+    if (vma_overlap(mm, start, end)) {
+        spin_unlock(&(mm->mm_lock));
+        kfree(vma, sizeof(struct vma_struct));
+        return -E_INVAL;
+    }
+    bool merge = mm->merge_vma;
+    if (vm_flags & VM_LOCKED) {
+        // merged once locked, or unmapped alone if that fails
+        mm->merge_vma = 0;
+    }
+    vma = __insert_vma_struct(mm, vma);
+    mm->merge_vma = merge;
+    int ret = 0;
+    if (vm_flags & VM_LOCKED) {
+        if ((ret = __mm_mlock(mm, start, end)) != 0) {
+            __mm_unmap(mm, start, end);
+            vma = NULL;
+        }
+        else {
+            // it may have been merged
+            vma = find_vma(mm, start);
+        }
+    }
+    else if (vm_flags & VM_POPULATE) {
+        populate_range(mm, start, end, vm_flags);
+    }
+    spin_unlock(&(mm->mm_lock));
+    if (vma_store != NULL) {
+        *vma_store = vma;
+    }
+    return ret;
+}
+
+/* *
+ * mm_unmap - remove the mappings of @mm in [@addr, @addr + @len), rounded
+ * out to pages: the vmas crossing the ends are split, the ones inside
+ * freed, and the pages unmapped.
+ * */
+int
+mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!(start < end && end <= KERNBASE)) {
+        return -E_INVAL;
+    }
+    spin_lock(&(mm->mm_lock));
+    int ret = vma_range_split(mm, start, end);
+    if (ret == 0) {
+        __mm_unmap(mm, start, end);
+    }
+    spin_unlock(&(mm->mm_lock));
+    return ret;
+}
+
+// __mm_unmap - mm_unmap of [@start, @end), whose ends split no vma, mm lock held
+static void
+__mm_unmap(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    list_entry_t *list = &(mm->mmap_list), *le = list_next(list);
+    while (le != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        le = list_next(le);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start >= start) {
+            if (vma->vm_flags & VM_LOCKED) {
+                mlock_uncharge(mm, (vma->vm_end - vma->vm_start) / PGSIZE);
+            }
+            vma_remove(mm, vma);
+        }
+    }
+    unmap_range(mm, start, end);
+}
+
+/* *
+ * mm_protect - set the VM_READ, VM_WRITE and VM_EXEC flags of the vmas of
+ * @mm in [@addr, @addr + @len), rounded out to pages, to those of
+ * @vm_flags. The vmas crossing the ends are split first, and the vmas
+ * changed merged with their neighbours after.
+ * */
+int
+mm_protect(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    uint32_t mask = VM_READ | VM_WRITE | VM_EXEC;
+    if (!(start < end && end <= KERNBASE)) {
+        return -E_INVAL;
+    }
+    spin_lock(&(mm->mm_lock));
+    int ret = vma_range_split(mm, start, end);
+    if (ret == 0) {
+        list_entry_t *list = &(mm->mmap_list), *le = list_next(list);
+        while (le != list) {
+            struct vma_struct *vma = le2vma(le, list_link);
+            if (vma->vm_start >= end) {
+                break;
+            }
+            if (vma->vm_start >= start) {
+                vma->vm_flags = (vma->vm_flags & ~mask) | (vm_flags & mask);
+                if (mm->merge_vma) {
+                    vma = vma_merge(mm, vma);
+                }
+            }
+            le = list_next(&(vma->list_link));
+        }
+        protect_range(mm, start, end, PTE_U | ((vm_flags & VM_WRITE) ? PTE_W : 0));
+    }
+    spin_unlock(&(mm->mm_lock));
+    return ret;
+}
+
+/* *
+ * mm_advise - tell how the pages of @mm in [@addr, @addr + @len), rounded
+ * out to pages, will be accessed. MADV_NORMAL, MADV_RANDOM and
+ * MADV_SEQUENTIAL are kept in the vmas, split and merged as for
+ * mm_protect, and change how their faults read ahead and how their pages
+ * are reclaimed. MADV_WILLNEED reads the swapped-out pages in right away,
+ * as far as free memory allows; MADV_DONTNEED unmaps the pages and frees
+ * their swap slots, the vmas stay and fault zero pages in again, but
+ * VM_LOCKED vmas are skipped and -E_INVAL returned. Parts of the range
+ * without a vma are skipped.
+ * */
+int
+mm_advise(struct mm_struct *mm, uintptr_t addr, size_t len, int advice) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!(start < end && end <= KERNBASE) || advice < MADV_NORMAL || advice > MADV_DONTNEED) {
+        return -E_INVAL;
+    }
+    int ret = 0;
+    list_entry_t *list = &(mm->mmap_list), *le;
+    spin_lock(&(mm->mm_lock));
+    switch (advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+        if ((ret = vma_range_split(mm, start, end)) != 0) {
+            break;
+        }
+        le = list_next(list);
+        while (le != list) {
+            struct vma_struct *vma = le2vma(le, list_link);
+            if (vma->vm_start >= end) {
+                break;
+            }
+            if (vma->vm_start >= start) {
+                vma->vm_advice = advice;
+                vma->vm_scan = vma->vm_start;
+                if (mm->merge_vma) {
+                    vma = vma_merge(mm, vma);
+                }
+            }
+            le = list_next(&(vma->list_link));
+        }
+        break;
+    case MADV_WILLNEED:
+    case MADV_DONTNEED:
+        le = list;
+        while ((le = list_next(le)) != list) {
+            struct vma_struct *vma = le2vma(le, list_link);
+            if (vma->vm_start >= end) {
+                break;
+            }
+            if (vma->vm_end <= start) {
+                continue;
+            }
+            uintptr_t from = (vma->vm_start > start) ? vma->vm_start : start;
+            uintptr_t to = (vma->vm_end < end) ? vma->vm_end : end;
+            if (advice == MADV_DONTNEED && (vma->vm_flags & VM_LOCKED)) {
+                // locked pages stay, munlock them first
+                ret = -E_INVAL;
+                continue;
+            }
+            if (advice == MADV_WILLNEED) {
+                vmm_stats.advice_willneed += prefetch_range(mm, vma, from, to);
+            }
+            else {
+                unmap_range(mm, from, to);
+                vma->pf_nr = 0;
+            }
+        }
+        break;
+    }
+    spin_unlock(&(mm->mm_lock));
+    return ret;
 }
 
 // mm_destroy - free mm and mm internal fields
 void
 mm_destroy(struct mm_struct *mm) {
+    // the prefetch softirq must not find it any more, swap queue or not
+    prefetch_cancel(mm);
+    // 将mm的页面从swap置换队列中移除
+    if (mm->sm_priv != NULL) {
+        swap_exit_mm(mm);
+    }
 
     list_entry_t *list = &(mm->mmap_list), *le;
     // 遍历mm->mmap_list中的每一个节点
     while ((le = list_next(list)) != list) {
         // 将其从mm->mmap_list中移除
         list_del(le);
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_flags & VM_LOCKED) {
+            mlock_uncharge(mm, (vma->vm_end - vma->vm_start) / PGSIZE);
+        }
         // 并释放vma所占用的物理内存空间
         kfree(le2vma(le, list_link),sizeof(struct vma_struct));  //kfree vma        
     }
@@ -176,10 +570,229 @@ mm_destroy(struct mm_struct *mm) {
     mm=NULL;
 }
 
+/* *
+ * A tlb_gather collects the addresses whose PTEs a range operation changed
+ * and the frames it dropped the last reference to. Nothing is invalidated
+ * or freed until tlb_gather_flush: one flush, and one cross-cpu call, per
+ * batch, and past TLB_FLUSH_ALL_MIN addresses a %cr3 reload instead of an
+ * invlpg each. A frame is freed only after the flush, so no cpu can still
+ * reach it through a stale TLB entry.
+ * */
+#define TLB_FLUSH_ALL_MIN       32
+#define TLB_GATHER_PAGES        64
+
+struct tlb_gather {
+    pde_t *pgdir;
+    int nr_la;                              // > TLB_FLUSH_ALL_MIN: flush all
+    uintptr_t la[TLB_FLUSH_ALL_MIN];
+    int nr_page;
+    struct Page *pages[TLB_GATHER_PAGES];   // freed after the flush
+};
+
+static void
+tlb_gather_init(struct tlb_gather *tlb, pde_t *pgdir) {
+    tlb->pgdir = pgdir;
+    tlb->nr_la = tlb->nr_page = 0;
+}
+
+static void
+tlb_gather_flush(struct tlb_gather *tlb) {
+    int i;
+    if (tlb->nr_la > TLB_FLUSH_ALL_MIN) {
+        tlb_invalidate_batch(tlb->pgdir, NULL, 0);
+        vmm_stats.tlb_flush_all ++;
+    }
+    else if (tlb->nr_la > 0) {
+        tlb_invalidate_batch(tlb->pgdir, tlb->la, tlb->nr_la);
+        vmm_stats.tlb_flush ++;
+        vmm_stats.tlb_flush_pages += tlb->nr_la;
+    }
+    for (i = 0; i < tlb->nr_page; i ++) {
+        free_page(tlb->pages[i]);
+    }
+    tlb->nr_la = tlb->nr_page = 0;
+}
+
+// tlb_gather_la - the PTE of @la changed
+static inline void
+tlb_gather_la(struct tlb_gather *tlb, uintptr_t la) {
+    if (tlb->nr_la < TLB_FLUSH_ALL_MIN) {
+        tlb->la[tlb->nr_la] = la;
+    }
+    tlb->nr_la ++;
+}
+
+// tlb_gather_page - free @page, which nothing maps any more, after the flush
+static void
+tlb_gather_page(struct tlb_gather *tlb, struct Page *page) {
+    if (PageSwap(page)) {
+        swap_page_unqueue(page);
+    }
+    if (tlb->nr_page == TLB_GATHER_PAGES) {
+        tlb_gather_flush(tlb);
+    }
+    tlb->pages[tlb->nr_page ++] = page;
+}
+
+// mm_setup_pgdir - give @mm a page directory of its own, sharing the kernel part of boot_pgdir
+int
+mm_setup_pgdir(struct mm_struct *mm) {
+    struct Page *page;
+    if ((page = alloc_page()) == NULL) {
+        return -E_NO_MEM;
+    }
+    pde_t *pgdir = page2kva(page);
+    memcpy(pgdir, boot_pgdir, PGSIZE);
+    memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+    pgdir[PDX(VPT)] = PADDR(pgdir) | PTE_P | PTE_W;
+    mm->pgdir = pgdir;
+    return 0;
+}
+
+// mm_put_pgdir - free the page directory of @mm, after exit_mmap
+void
+mm_put_pgdir(struct mm_struct *mm) {
+    free_page(kva2page(mm->pgdir));
+    mm->pgdir = NULL;
+}
+
+/* *
+ * exit_mmap - unmap every vma of @mm and free its page tables. @mm must
+ * have a page directory of its own, see mm_setup_pgdir.
+ * */
+void
+exit_mmap(struct mm_struct *mm) {
+    pde_t *pgdir = mm->pgdir;
+    assert(pgdir != NULL && pgdir != boot_pgdir);
+    spin_lock(&(mm->mm_lock));
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        unmap_range(mm, ROUNDDOWN(vma->vm_start, PGSIZE), ROUNDUP(vma->vm_end, PGSIZE));
+    }
+    // unmap_range frees the page tables it empties, none should be left
+    size_t i;
+    for (i = 0; i < PDX(KERNBASE); i ++) {
+        if (pgdir[i] & PTE_P) {
+            free_page(pde2page(pgdir[i]));
+            pgdir[i] = 0;
+        }
+    }
+    spin_unlock(&(mm->mm_lock));
+}
+
+/* *
+ * dup_range - share the pages @from maps in [@start, @end) with @to: a
+ * present page is write-protected in both and gains a reference and a
+ * reverse mapping, a swapped out one a reference on its swap slot. The
+ * first write fault of either side copies the page, see do_pgfault.
+ * In a @locked range the pages are on no swap queue, and one left shared
+ * would be on none once the other side copied it: @to gets copies of
+ * them now, queued on its own queue, and @from keeps its pages writable.
+ * */
+static int
+dup_range(struct mm_struct *to, pde_t *from, uintptr_t start, uintptr_t end, bool locked, struct tlb_gather *tlb) {
+    uintptr_t la;
+    for (la = ROUNDDOWN(start, PGSIZE); la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(from, la, 0), *nptep;
+        if (ptep == NULL) {
+            la = ROUNDDOWN(la, PTSIZE) + PTSIZE - PGSIZE;
+            continue;
+        }
+        if (*ptep == 0) {
+            continue;
+        }
+        if ((nptep = get_pte(to->pgdir, la, 1)) == NULL) {
+            return -E_NO_MEM;
+        }
+        if ((*ptep & PTE_P) && locked && pte2page(*ptep) != zero_page) {
+            struct Page *page = alloc_page();
+            if (page == NULL) {
+                return -E_NO_MEM;
+            }
+            copy_page(page2kva(page), page2kva(pte2page(*ptep)));
+            set_page_ref(page, 1);
+            *nptep = page2pa(page) | (*ptep & PTE_USER);
+            page_add_rmap(page, to, la);
+            if (swap_init_ok) {
+                swap_map_swappable(to, la, page, 0);
+                page->pra_vaddr = la;
+            }
+        }
+        else if (*ptep & PTE_P) {
+            struct Page *page = pte2page(*ptep);
+            if (*ptep & PTE_W) {
+                *ptep &= ~PTE_W;
+                tlb_gather_la(tlb, la);
+            }
+            page_ref_inc(page);
+            *nptep = *ptep;
+            page_add_rmap(page, to, la);
+        }
+        else {
+            swap_entry_dup(*ptep);
+            *nptep = *ptep;
+        }
+    }
+    return 0;
+}
+
+/* *
+ * mm_dup - a copy-on-write duplicate of @oldmm, in a page directory of its
+ * own: the vmas are copied, the pages shared read-only. The shared pages
+ * stay on the swap queue of @oldmm, writing one out takes down the
+ * mappings of both mms; a page copied or taken over by a write fault is
+ * queued on the mm that faulted. The pages of locked vmas are copied at
+ * once, see dup_range. Returns NULL if memory runs out.
+ * */
+struct mm_struct *
+mm_dup(struct mm_struct *oldmm) {
+    struct mm_struct *mm;
+    if ((mm = mm_create()) == NULL) {
+        return NULL;
+    }
+    if (mm_setup_pgdir(mm) != 0) {
+        mm_destroy(mm);
+        return NULL;
+    }
+    mm->fault_around_max = oldmm->fault_around_max;
+
+    int ret = 0;
+    struct tlb_gather tlb;
+    tlb_gather_init(&tlb, oldmm->pgdir);
+    spin_lock(&(oldmm->mm_lock));
+    list_entry_t *list = &(oldmm->mmap_list), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct vma_struct *vma = le2vma(le, list_link), *nvma;
+        // locks are not inherited
+        if ((nvma = vma_create(vma->vm_start, vma->vm_end, vma->vm_flags & ~VM_LOCKED)) == NULL) {
+            ret = -E_NO_MEM;
+            break;
+        }
+        nvma->vm_advice = vma->vm_advice;
+        insert_vma_struct(mm, nvma);
+        if ((ret = dup_range(mm, oldmm->pgdir, vma->vm_start, vma->vm_end, vma->vm_flags & VM_LOCKED, &tlb)) != 0) {
+            break;
+        }
+    }
+    // write-protect @oldmm on all cpus before it runs again
+    tlb_gather_flush(&tlb);
+    spin_unlock(&(oldmm->mm_lock));
+
+    if (ret != 0) {
+        exit_mmap(mm);
+        mm_put_pgdir(mm);
+        mm_destroy(mm);
+        return NULL;
+    }
+    return mm;
+}
+
 // vmm_init - initialize virtual memory management
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    mlock_limit = nr_free_pages() / MLOCK_LIMIT_DIV;
     check_vmm();
 }
 
@@ -189,6 +802,11 @@ check_vmm(void) {
     size_t nr_free_pages_store = nr_free_pages();
     
     check_vma_struct();
+    check_vma_merge();
+    check_mlock();
+    check_rmap();
+    check_prefetch();
+    check_advise();
     check_pgfault();
 
     assert(nr_free_pages_store == nr_free_pages());
@@ -265,6 +883,176 @@ check_vma_struct(void) {
     cprintf("check_vma_struct() succeeded!\n");
 }
 
+// check_vma_merge - check merging on insert and splitting by mm_protect and mm_unmap
+static void
+check_vma_merge(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    // no page is mapped, the range ops find no page table
+    mm->pgdir = boot_pgdir;
+    assert(boot_pgdir[0] == 0);
+
+    struct vma_struct *vma;
+    insert_vma_struct(mm, vma_create(0x1000, 0x2000, VM_READ | VM_WRITE));
+    insert_vma_struct(mm, vma_create(0x3000, 0x4000, VM_READ | VM_WRITE));
+    assert(mm->map_count == 2);
+    vma = insert_vma_struct(mm, vma_create(0x2000, 0x3000, VM_READ | VM_WRITE));
+    assert(mm->map_count == 1 && vma->vm_start == 0x1000 && vma->vm_end == 0x4000);
+    insert_vma_struct(mm, vma_create(0x4000, 0x5000, VM_READ));
+    assert(mm->map_count == 2);
+
+    // [1,2) rw, [2,3) r, [3,4) rw, [4,5) r
+    assert(mm_protect(mm, 0x2000, PGSIZE, VM_READ) == 0);
+    assert(mm->map_count == 4);
+    // [1,2) rw, [2,5) r
+    assert(mm_protect(mm, 0x3000, PGSIZE, VM_READ) == 0);
+    assert(mm->map_count == 2);
+    vma = find_vma(mm, 0x3000);
+    assert(vma->vm_start == 0x2000 && vma->vm_end == 0x5000 && vma->vm_flags == VM_READ);
+    // [3,5) r
+    assert(mm_unmap(mm, 0x1000, 0x2000) == 0);
+    assert(mm->map_count == 1);
+    assert(find_vma(mm, 0x1000) == NULL && find_vma(mm, 0x2fff) == NULL);
+    vma = find_vma(mm, 0x3000);
+    assert(vma->vm_start == 0x3000 && vma->vm_end == 0x5000);
+
+    assert(boot_pgdir[0] == 0);
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_vma_merge() succeeded!\n");
+}
+
+// check_mlock - check mm_mlock and mm_munlock, and the accounting of locked pages
+static void
+check_mlock(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    size_t limit = mlock_limit, locked = mlock_pages;
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL && mm_setup_pgdir(mm) == 0);
+    uintptr_t la;
+
+    assert(mm_map(mm, 0x1000, 4 * PGSIZE, VM_READ | VM_WRITE, NULL) == 0);
+    // [1,2) rw, [2,4) rw locked, [4,5) rw
+    assert(mm_mlock(mm, 0x2000, 2 * PGSIZE) == 0);
+    assert(mm->map_count == 3 && mm->locked_vm == 2 && mlock_pages == locked + 2);
+    for (la = 0x1000; la < 0x5000; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        bool in = (la >= 0x2000 && la < 0x4000);
+        assert(ptep != NULL && ((*ptep & PTE_P) != 0) == in);
+        assert(find_vma(mm, la)->vm_flags == (VM_READ | VM_WRITE | (in ? VM_LOCKED : 0)));
+    }
+    // past the limit, or not mapped
+    mlock_limit = mlock_pages + 1;
+    assert(mm_mlock(mm, 0x1000, 4 * PGSIZE) == -E_NO_MEM);
+    mlock_limit = limit;
+    assert(mm_mlock(mm, 0x4000, 2 * PGSIZE) == -E_INVAL);
+    assert(mm->locked_vm == 2);
+    assert(mm_advise(mm, 0x2000, PGSIZE, MADV_DONTNEED) == -E_INVAL);
+    // [1,5) rw locked
+    assert(mm_mlock(mm, 0x1000, 4 * PGSIZE) == 0);
+    assert(mm->map_count == 1 && mm->locked_vm == 4);
+    // [1,3) rw, [3,5) rw locked
+    assert(mm_munlock(mm, 0x1000, 2 * PGSIZE) == 0);
+    assert(mm->map_count == 2 && mm->locked_vm == 2);
+    assert((*get_pte(mm->pgdir, 0x1000, 0) & PTE_P) != 0);
+    // [1,3) rw, [4,5) rw locked
+    assert(mm_unmap(mm, 0x3000, PGSIZE) == 0);
+    assert(mm->locked_vm == 1 && mlock_pages == locked + 1);
+
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+    assert(mlock_pages == locked);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_mlock() succeeded!\n");
+}
+
+// check_rmap - the reverse map of a page shared by mm_dup, as swap_out finds it
+static void
+check_rmap(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    struct mm_struct *mm = mm_create(), *copy;
+    struct rmap_unmap ru;
+    assert(mm != NULL && mm_setup_pgdir(mm) == 0);
+
+    assert(mm_map(mm, 0x1000, 2 * PGSIZE, VM_READ | VM_WRITE | VM_POPULATE, NULL) == 0);
+    struct Page *page = pte2page(*get_pte(mm->pgdir, 0x1000, 0));
+    assert(page->rmap_mm == mm && page->rmap_va == 0x1000 && page->rmap_chain == NULL);
+    assert(rmap_unmap_prepare(page, mm, &ru) == 0 && ru.nr == 1 && ru.nr_locked == 0);
+    rmap_unmap_abort(&ru);
+
+    // shared: both mappings found, the other mm locked meanwhile
+    assert((copy = mm_dup(mm)) != NULL);
+    assert(page_ref(page) == 2 && page->rmap_chain != NULL);
+    assert(rmap_unmap_prepare(page, mm, &ru) == 0 && ru.nr == 2 && ru.nr_locked == 1);
+    assert(ru.pgdir[0] != ru.pgdir[1] && ru.va[0] == 0x1000 && ru.va[1] == 0x1000);
+    assert(!spin_trylock(&(copy->mm_lock)));
+    rmap_unmap_abort(&ru);
+    spin_lock(&(copy->mm_lock));
+    assert(rmap_unmap_prepare(page, mm, &ru) == -E_BUSY);
+    spin_unlock(&(copy->mm_lock));
+
+    // the copy's write fault gives it a page of its own
+    assert(do_pgfault(copy, 3, 0x1000) == 0);
+    assert(page_ref(page) == 1 && page->rmap_mm == mm && page->rmap_chain == NULL);
+    assert(rmap_unmap_prepare(page, mm, &ru) == 0 && ru.nr == 1);
+    rmap_unmap_abort(&ru);
+
+    exit_mmap(copy);
+    mm_put_pgdir(copy);
+    mm_destroy(copy);
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_rmap() succeeded!\n");
+}
+
+// check_advise - check splitting and merging by advice; the swap side is in check_advise_swap
+static void
+check_advise(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    // no page is mapped, the range ops find no page table
+    mm->pgdir = boot_pgdir;
+    assert(boot_pgdir[0] == 0);
+
+    struct vma_struct *vma;
+    insert_vma_struct(mm, vma_create(0x1000, 0x5000, VM_READ | VM_WRITE));
+    // [1,2) normal, [2,4) sequential, [4,5) normal
+    assert(mm_advise(mm, 0x2000, 2 * PGSIZE, MADV_SEQUENTIAL) == 0);
+    assert(mm->map_count == 3);
+    vma = find_vma(mm, 0x2000);
+    assert(vma->vm_start == 0x2000 && vma->vm_end == 0x4000);
+    assert(vma->vm_advice == MADV_SEQUENTIAL && vma->vm_scan == 0x2000);
+    // [1,2) normal, [2,3) random, [3,4) sequential, [4,5) normal
+    assert(mm_advise(mm, 0x2000, PGSIZE, MADV_RANDOM) == 0);
+    assert(mm->map_count == 4 && find_vma(mm, 0x2000)->vm_advice == MADV_RANDOM);
+    // willneed and dontneed keep no advice, nothing is split
+    assert(mm_advise(mm, 0x3000, PGSIZE, MADV_WILLNEED) == 0);
+    assert(mm_advise(mm, 0x1800, PGSIZE, MADV_DONTNEED) == 0);
+    assert(mm->map_count == 4 && find_vma(mm, 0x3000)->vm_advice == MADV_SEQUENTIAL);
+    assert(mm_advise(mm, 0x1000, PGSIZE, MADV_DONTNEED + 1) == -E_INVAL);
+    // [1,5) normal
+    assert(mm_advise(mm, 0x1000, 4 * PGSIZE, MADV_NORMAL) == 0);
+    assert(mm->map_count == 1);
+    vma = find_vma(mm, 0x1000);
+    assert(vma->vm_start == 0x1000 && vma->vm_end == 0x5000 && vma->vm_advice == MADV_NORMAL);
+
+    assert(boot_pgdir[0] == 0);
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_advise() succeeded!\n");
+}
+
 struct mm_struct *check_mm_struct;
 
 // check_pgfault - check correctness of pgfault handler
@@ -278,6 +1066,8 @@ check_pgfault(void) {
     assert(check_mm_struct != NULL);
 
     struct mm_struct *mm = check_mm_struct;
+    // the check counts pages exactly, no fault-around
+    mm->fault_around_max = 0;
     // 设置mm的页表为内核页表
     pde_t *pgdir = mm->pgdir = boot_pgdir;
     assert(pgdir[0] == 0);
@@ -318,6 +1108,726 @@ check_pgfault(void) {
 //page fault number
 volatile unsigned int pgfault_num=0;
 
+struct vmm_stats vmm_stats;
+
+/* *
+ * The zero page: read faults on never written anonymous memory map this
+ * single zeroed page read-only, the first write replaces it with a private
+ * page. It holds one reference of its own, so unmapping never frees it.
+ * It is allocated on first use, after the boot checks have counted pages.
+ * */
+static struct Page * volatile zero_page;
+
+static struct Page *
+zero_page_get(void) {
+    if (zero_page == NULL) {
+        struct Page *page = alloc_page();
+        if (page == NULL) {
+            return NULL;
+        }
+        clear_page(page2kva(page));
+        set_page_ref(page, 1);
+        if (cmpxchg((volatile uint32_t *)&zero_page, 0, (uint32_t)page) != 0) {
+            // another cpu was faster
+            set_page_ref(page, 0);
+            free_page(page);
+        }
+    }
+    return zero_page;
+}
+
+// page_add_rmap - rmap_add of a user mapping, the zero page is never reclaimed and not recorded
+static void
+page_add_rmap(struct Page *page, struct mm_struct *mm, uintptr_t la) {
+    if (page != zero_page) {
+        rmap_add(page, mm, la);
+    }
+}
+
+/* *
+ * unmap_range - unmap the pages of @mm in [@start, @end), page aligned:
+ * drop the references to the frames and swap slots mapped and free the
+ * page tables left empty. Each page table is looked up once per 4M it
+ * covers; the TLB flushes and frees are batched, see struct tlb_gather.
+ * Called with the mm lock held.
+ * */
+void
+unmap_range(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct tlb_gather tlb;
+    uintptr_t la = start, next;
+    assert(start % PGSIZE == 0 && end % PGSIZE == 0 && end <= KERNBASE);
+    tlb_gather_init(&tlb, mm->pgdir);
+    for (; la < end; la = next) {
+        next = ROUNDDOWN(la, PTSIZE) + PTSIZE;
+        if (next > end) {
+            next = end;
+        }
+        pde_t *pdep = &(mm->pgdir[PDX(la)]);
+        if (!(*pdep & PTE_P)) {
+            continue;
+        }
+        pte_t *pt = KADDR(PDE_ADDR(*pdep));
+        uintptr_t a;
+        for (a = la; a < next; a += PGSIZE) {
+            pte_t *ptep = &pt[PTX(a)];
+            if (*ptep & PTE_P) {
+                struct Page *page = pte2page(*ptep);
+                rmap_remove(page, mm->pgdir, a);
+                *ptep = 0;
+                tlb_gather_la(&tlb, a);
+                if (page_ref_dec(page) == 0) {
+                    tlb_gather_page(&tlb, page);
+                }
+            }
+            else if (*ptep != 0) {
+                swap_entry_free(*ptep);
+                *ptep = 0;
+            }
+        }
+        // free the page table if that emptied it
+        int i;
+        for (i = 0; i < NPTEENTRY && pt[i] == 0; i ++) {
+            /* empty */ ;
+        }
+        if (i == NPTEENTRY) {
+            *pdep = 0;
+            // drops the cached directory entry, if nothing else did
+            tlb_gather_la(&tlb, la);
+            set_page_ref(kva2page(pt), 0);
+            tlb_gather_page(&tlb, kva2page(pt));
+            vmm_stats.pt_freed ++;
+        }
+    }
+    tlb_gather_flush(&tlb);
+}
+
+/* *
+ * protect_range - set the PTE_W and PTE_U bits of the pages of @mm present
+ * in [@start, @end), page aligned, to those of @perm. Pages shared with
+ * other mms, and the zero page, stay read-only: their first write still
+ * has to copy them. Only PTEs that lose a permission need a TLB flush,
+ * a stale entry with less permission just faults once more. Called with
+ * the mm lock held.
+ * */
+void
+protect_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t perm) {
+    struct tlb_gather tlb;
+    uintptr_t la = start, next;
+    assert(start % PGSIZE == 0 && end % PGSIZE == 0 && end <= KERNBASE);
+    perm &= (PTE_W | PTE_U);
+    tlb_gather_init(&tlb, mm->pgdir);
+    for (; la < end; la = next) {
+        next = ROUNDDOWN(la, PTSIZE) + PTSIZE;
+        if (next > end) {
+            next = end;
+        }
+        pde_t *pdep = &(mm->pgdir[PDX(la)]);
+        if (!(*pdep & PTE_P)) {
+            continue;
+        }
+        pte_t *pt = KADDR(PDE_ADDR(*pdep));
+        uintptr_t a;
+        for (a = la; a < next; a += PGSIZE) {
+            pte_t *ptep = &pt[PTX(a)];
+            if (!(*ptep & PTE_P)) {
+                continue;
+            }
+            pte_t pte = (*ptep & ~(PTE_W | PTE_U)) | perm;
+            struct Page *page = pte2page(*ptep);
+            if ((pte & PTE_W) && (page == zero_page || page_ref(page) > 1)) {
+                pte &= ~PTE_W;
+            }
+            if (pte != *ptep) {
+                if (*ptep & ~pte & (PTE_W | PTE_U)) {
+                    tlb_gather_la(&tlb, a);
+                }
+                *ptep = pte;
+            }
+        }
+    }
+    tlb_gather_flush(&tlb);
+}
+
+// populate_range takes this many frames from the pmm at once
+#define POPULATE_BATCH          64
+
+/* *
+ * populate_range - map every unused page of @mm in [@start, @end), page
+ * aligned, without taking a fault per page: the frames are allocated up
+ * to POPULATE_BATCH at a time, each page table is filled directly and the
+ * pages handed to the swap manager a batch at a time. A range without
+ * VM_WRITE in @vm_flags gets the zero page, as its read faults would,
+ * and with VM_LOCKED the pages are not handed to the swap manager.
+ * The PTEs were empty, no TLB holds them. Returns the # of pages mapped.
+ * mm lock held.
+ * */
+static int
+populate_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t vm_flags) {
+    struct Page *batch[POPULATE_BATCH], *block = NULL, *zero = NULL;
+    size_t block_left = 0;
+    int nr = 0, total = 0;
+    uint32_t perm = PTE_U | ((vm_flags & VM_WRITE) ? PTE_W : 0);
+    uintptr_t la, next;
+    if (!(vm_flags & VM_WRITE) && (zero = zero_page_get()) == NULL) {
+        return 0;
+    }
+    for (la = start; la < end; la = next) {
+        next = ROUNDDOWN(la, PTSIZE) + PTSIZE;
+        if (next > end) {
+            next = end;
+        }
+        pte_t *ptep = get_pte(mm->pgdir, la, 1);
+        if (ptep == NULL) {
+            break;
+        }
+        for (; la < next; la += PGSIZE, ptep ++) {
+            if (*ptep != 0) {
+                continue;
+            }
+            if (zero != NULL) {
+                page_ref_inc(zero);
+                *ptep = page2pa(zero) | PTE_P | perm;
+                total ++;
+                continue;
+            }
+            if (block_left == 0) {
+                // as many frames as are left to map, halving until the pmm has them
+                size_t n = (end - la) / PGSIZE;
+                if (n > POPULATE_BATCH) {
+                    n = POPULATE_BATCH;
+                }
+                while ((block = alloc_pages(n)) == NULL && n > 1) {
+                    n /= 2;
+                }
+                if (block == NULL) {
+                    goto out;
+                }
+                block_left = n;
+            }
+            struct Page *page = block ++;
+            block_left --;
+            clear_page(page2kva(page));
+            set_page_ref(page, 1);
+            page->pra_vaddr = la;
+            *ptep = page2pa(page) | PTE_P | perm;
+            rmap_add(page, mm, la);
+            batch[nr ++] = page;
+            if (nr == POPULATE_BATCH) {
+                if (swap_init_ok && !(vm_flags & VM_LOCKED)) {
+                    swap_map_swappable_batch(mm, batch, nr);
+                }
+                total += nr;
+                nr = 0;
+            }
+        }
+    }
+out:
+    if (block_left > 0) {
+        free_pages(block, block_left);
+    }
+    if (nr > 0 && swap_init_ok && !(vm_flags & VM_LOCKED)) {
+        swap_map_swappable_batch(mm, batch, nr);
+    }
+    total += nr;
+    vmm_stats.populated += total;
+    return total;
+}
+
+// mlock_charge - account @n more locked pages to @mm, -E_NO_MEM past mlock_limit
+static int
+mlock_charge(struct mm_struct *mm, size_t n) {
+    int ret = -E_NO_MEM;
+    spin_lock(&mlock_lock);
+    if (mlock_pages + n <= mlock_limit) {
+        mlock_pages += n;
+        mm->locked_vm += n;
+        ret = 0;
+    }
+    spin_unlock(&mlock_lock);
+    return ret;
+}
+
+static void
+mlock_uncharge(struct mm_struct *mm, size_t n) {
+    spin_lock(&mlock_lock);
+    assert(mm->locked_vm >= n && mlock_pages >= n);
+    mlock_pages -= n;
+    mm->locked_vm -= n;
+    spin_unlock(&mlock_lock);
+}
+
+/* *
+ * lock_range - make every page of @vma in [@start, @end) present, the way
+ * the faults of a first access would: empty PTEs are populated, swapped
+ * out pages read in and, in a writable vma, pages still shared copy-on-write
+ * or the zero page copied. Then the pages are taken off their swap queues.
+ * Returns -E_NO_MEM if memory runs short, the pages done so far are left
+ * off their queues. mm lock held.
+ * */
+static int
+lock_range(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    uint32_t perm = PTE_U | ((vma->vm_flags & VM_WRITE) ? PTE_W : 0);
+    uintptr_t la;
+    populate_range(mm, start, end, vma->vm_flags | VM_LOCKED);
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        struct Page *page;
+        if (ptep == NULL || *ptep == 0) {
+            // populate_range ran out of memory
+            return -E_NO_MEM;
+        }
+        if (!(*ptep & PTE_P)) {
+            if (!swap_init_ok || nr_free_pages() == 0) {
+                return -E_NO_MEM;
+            }
+            swap_in(mm, la, &page);
+            page_insert(mm->pgdir, page, la, perm);
+            rmap_add(page, mm, la);
+            page->pra_vaddr = la;
+        }
+        else if ((perm & PTE_W) && !(*ptep & PTE_W)) {
+            // what the first write fault would do
+            struct Page *old = pte2page(*ptep);
+            if (old != zero_page && page_ref(old) == 1) {
+                page = old;
+            }
+            else {
+                if ((page = alloc_page()) == NULL) {
+                    return -E_NO_MEM;
+                }
+                if (old == zero_page) {
+                    clear_page(page2kva(page));
+                }
+                else {
+                    memcpy(page2kva(page), page2kva(old), PGSIZE);
+                }
+            }
+            if (page_insert(mm->pgdir, page, la, perm) != 0) {
+                if (page != old) {
+                    free_page(page);
+                }
+                return -E_NO_MEM;
+            }
+            rmap_add(page, mm, la);
+            page->pra_vaddr = la;
+        }
+        else {
+            page = pte2page(*ptep);
+        }
+        if (swap_init_ok && page != zero_page) {
+            swap_set_unswappable(mm, la);
+        }
+    }
+    return 0;
+}
+
+// unlock_range - hand the pages of @mm in [@start, @end) that are on no swap queue back to the swap manager
+static void
+unlock_range(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    struct Page *batch[POPULATE_BATCH];
+    uintptr_t la;
+    int nr = 0;
+    if (!swap_init_ok) {
+        return;
+    }
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL) {
+            la = ROUNDDOWN(la, PTSIZE) + PTSIZE - PGSIZE;
+            continue;
+        }
+        if (!(*ptep & PTE_P)) {
+            continue;
+        }
+        struct Page *page = pte2page(*ptep);
+        if (page == zero_page || PageSwap(page)) {
+            continue;
+        }
+        page->pra_vaddr = la;
+        batch[nr ++] = page;
+        if (nr == POPULATE_BATCH) {
+            swap_map_swappable_batch(mm, batch, nr);
+            nr = 0;
+        }
+    }
+    if (nr > 0) {
+        swap_map_swappable_batch(mm, batch, nr);
+    }
+}
+
+/* *
+ * __mm_mlock - mm_mlock of [@start, @end), mm lock held. The vmas are
+ * split and their pages locked, and only when all of them are VM_LOCKED
+ * set and the vmas merged; on failure the pages go back to the swap manager.
+ * */
+static int
+__mm_mlock(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    list_entry_t *list = &(mm->mmap_list), *le;
+    struct vma_struct *vma;
+    uintptr_t la = start;
+    size_t n = 0;
+    // the whole range must be mapped
+    for (le = list_next(list); le != list && la < end; le = list_next(le)) {
+        vma = le2vma(le, list_link);
+        if (vma->vm_end <= la) {
+            continue;
+        }
+        if (vma->vm_start > la) {
+            break;
+        }
+        uintptr_t to = (vma->vm_end < end) ? vma->vm_end : end;
+        if (!(vma->vm_flags & VM_LOCKED)) {
+            n += (to - la) / PGSIZE;
+        }
+        la = to;
+    }
+    if (la < end) {
+        return -E_INVAL;
+    }
+    int ret;
+    if ((ret = mlock_charge(mm, n)) != 0) {
+        return ret;
+    }
+    if ((ret = vma_range_split(mm, start, end)) != 0) {
+        mlock_uncharge(mm, n);
+        return ret;
+    }
+    for (le = list_next(list); le != list; le = list_next(le)) {
+        vma = le2vma(le, list_link);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start >= start && !(vma->vm_flags & VM_LOCKED)) {
+            if ((ret = lock_range(mm, vma, vma->vm_start, vma->vm_end)) != 0) {
+                goto failed;
+            }
+        }
+    }
+    le = list_next(list);
+    while (le != list) {
+        vma = le2vma(le, list_link);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start >= start) {
+            vma->vm_flags |= VM_LOCKED;
+            if (mm->merge_vma) {
+                vma = vma_merge(mm, vma);
+            }
+        }
+        le = list_next(&(vma->list_link));
+    }
+    return 0;
+
+failed:
+    // requeue the pages of the vmas that were not locked before
+    for (le = list_next(list); le != list; le = list_next(le)) {
+        vma = le2vma(le, list_link);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start >= start && !(vma->vm_flags & VM_LOCKED)) {
+            unlock_range(mm, vma->vm_start, vma->vm_end);
+        }
+    }
+    mlock_uncharge(mm, n);
+    return ret;
+}
+
+// __mm_munlock - mm_munlock of [@start, @end), mm lock held
+static int
+__mm_munlock(struct mm_struct *mm, uintptr_t start, uintptr_t end) {
+    int ret = vma_range_split(mm, start, end);
+    if (ret != 0) {
+        return ret;
+    }
+    size_t n = 0;
+    list_entry_t *list = &(mm->mmap_list), *le = list_next(list);
+    while (le != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        if (vma->vm_start >= end) {
+            break;
+        }
+        if (vma->vm_start >= start && (vma->vm_flags & VM_LOCKED)) {
+            n += (vma->vm_end - vma->vm_start) / PGSIZE;
+            vma->vm_flags &= ~VM_LOCKED;
+            unlock_range(mm, vma->vm_start, vma->vm_end);
+            if (mm->merge_vma) {
+                vma = vma_merge(mm, vma);
+            }
+        }
+        le = list_next(&(vma->list_link));
+    }
+    mlock_uncharge(mm, n);
+    return 0;
+}
+
+/* *
+ * mm_mlock - keep the pages of @mm in [@addr, @addr + @len), rounded out
+ * to pages, resident: they are faulted in now and not swapped out until
+ * mm_munlock, unmapped, or the mm destroyed. The range must be mapped, or
+ * -E_INVAL; -E_NO_MEM if the pages would pass mlock_limit or do not fit
+ * in memory, nothing is locked then. Locks are not inherited by mm_dup.
+ * */
+int
+mm_mlock(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!(start < end && end <= KERNBASE)) {
+        return -E_INVAL;
+    }
+    spin_lock(&(mm->mm_lock));
+    int ret = __mm_mlock(mm, start, end);
+    spin_unlock(&(mm->mm_lock));
+    return ret;
+}
+
+/* *
+ * mm_munlock - let the pages of @mm in [@addr, @addr + @len), rounded out
+ * to pages, be swapped out again. Parts of the range not locked, or not
+ * mapped, are skipped.
+ * */
+int
+mm_munlock(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = ROUNDDOWN(addr, PGSIZE), end = ROUNDUP(addr + len, PGSIZE);
+    if (!(start < end && end <= KERNBASE)) {
+        return -E_INVAL;
+    }
+    spin_lock(&(mm->mm_lock));
+    int ret = __mm_munlock(mm, start, end);
+    spin_unlock(&(mm->mm_lock));
+    return ret;
+}
+
+// fault-around does not map ahead when free memory is this low, it would only cause swapping
+#define FAULT_AROUND_MIN_FREE   64
+
+/* *
+ * fault_around_update - account the pages mapped ahead at the last fault
+ * of @mm that have been accessed since, and adapt the window to the fault
+ * at page @addr: right past the pages mapped ahead last time looks like a
+ * sequential sweep and doubles the window, anything else halves it.
+ * */
+static void
+fault_around_update(struct mm_struct *mm, uintptr_t addr) {
+    int i;
+    if (mm->fault_ahead > 0) {
+        pte_t *ptep = get_pte(mm->pgdir, mm->fault_last + PGSIZE, 0);
+        // the pages mapped ahead never cross a page table
+        for (i = 0; ptep != NULL && i < mm->fault_ahead; i ++, ptep ++) {
+            if ((*ptep & (PTE_P | PTE_A)) == (PTE_P | PTE_A)) {
+                vmm_stats.used_ahead ++;
+            }
+        }
+    }
+    uintptr_t expect = mm->fault_last + (mm->fault_ahead + 1) * PGSIZE;
+    if (addr > mm->fault_last && addr <= expect) {
+        mm->fault_window = (mm->fault_window == 0) ? 1 : mm->fault_window * 2;
+        if (mm->fault_window > mm->fault_around_max) {
+            mm->fault_window = mm->fault_around_max;
+        }
+    }
+    else {
+        mm->fault_window /= 2;
+    }
+    mm->fault_last = addr;
+    mm->fault_ahead = 0;
+}
+
+/* *
+ * fault_around - map up to @window zero-filled pages after the
+ * page @addr just faulted in, as long as they are in @vma and in the same
+ * page table and their PTEs are empty. With @zero, that page is mapped
+ * read-only instead of new ones. Stops at the first PTE in use, so the
+ * pages mapped are contiguous. Returns how many were mapped.
+ * */
+static int
+fault_around(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr, uint32_t perm, struct Page *zero, int window) {
+    uintptr_t la, end = addr + (window + 1) * PGSIZE;
+    uintptr_t pt_end = ROUNDDOWN(addr, PTSIZE) + PTSIZE;
+    if (end < addr || end > vma->vm_end) {
+        end = vma->vm_end;
+    }
+    if (pt_end != 0 && end > pt_end) {
+        end = pt_end;
+    }
+
+    int n = 0;
+    pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+    for (la = addr + PGSIZE; ptep != NULL && la < end; la += PGSIZE) {
+        if (*(++ ptep) != 0) {
+            break;
+        }
+        if (zero != NULL) {
+            if (page_insert(mm->pgdir, zero, la, perm & ~PTE_W) != 0) {
+                break;
+            }
+            n ++;
+            continue;
+        }
+        if (nr_free_pages() <= FAULT_AROUND_MIN_FREE) {
+            break;
+        }
+        struct Page *page = alloc_page();
+        if (page == NULL) {
+            break;
+        }
+        clear_page(page2kva(page));
+        if (page_insert(mm->pgdir, page, la, perm) != 0) {
+            free_page(page);
+            break;
+        }
+        rmap_add(page, mm, la);
+        if (swap_init_ok) {
+            swap_map_swappable(mm, la, page, 0);
+            page->pra_vaddr = la;
+        }
+        n ++;
+    }
+    return n;
+}
+
+// a MADV_SEQUENTIAL scan may still be using the pages this close behind it
+#define SEQ_RECLAIM_LAG         4
+// the most pages put first for reclaim at one fault
+#define SEQ_RECLAIM_MAX         64
+
+/* *
+ * seq_reclaim_behind - put the pages of the MADV_SEQUENTIAL @vma that the
+ * scan, now at page @addr, has passed since the last fault first for
+ * reclaim: a scan does not come back, and the pages that will be used
+ * again stay in memory. Only pages mapped by this mm alone are moved.
+ * */
+static void
+seq_reclaim_behind(struct mm_struct *mm, struct vma_struct *vma, uintptr_t addr) {
+    struct Page *pages[SEQ_RECLAIM_MAX];
+    uintptr_t la, end = addr - SEQ_RECLAIM_LAG * PGSIZE;
+    int n = 0;
+    if (addr < vma->vm_scan || addr < vma->vm_start + SEQ_RECLAIM_LAG * PGSIZE) {
+        // a new scan
+        vma->vm_scan = vma->vm_start;
+        return;
+    }
+    if ((la = vma->vm_scan) >= end) {
+        return;
+    }
+    if (end - la > SEQ_RECLAIM_MAX * PGSIZE) {
+        la = end - SEQ_RECLAIM_MAX * PGSIZE;
+    }
+    for (; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL) {
+            la = ROUNDDOWN(la, PTSIZE) + PTSIZE - PGSIZE;
+            continue;
+        }
+        if (*ptep & PTE_P) {
+            struct Page *page = pte2page(*ptep);
+            if (page != zero_page && page_ref(page) == 1) {
+                pages[n ++] = page;
+            }
+        }
+    }
+    vma->vm_scan = end;
+    if (n > 0) {
+        swap_deactivate_batch(mm, pages, n);
+        vmm_stats.advice_evict += n;
+    }
+}
+
+#define CHECK_ADVISE_BASE       0x10000000
+#define CHECK_ADVISE_SEQ        (CHECK_ADVISE_BASE + PTSIZE)
+#define CHECK_ADVISE_NPAGE      8
+
+/* *
+ * check_advise_swap - check what the advice does to swap: pages behind a
+ * MADV_SEQUENTIAL scan go first for reclaim, and MADV_DONTNEED frees the
+ * swap slots and refaults zero pages. Called by swap_init after
+ * check_swap, check_vmm runs before the swap disk is set up.
+ * */
+void
+check_advise_swap(void) {
+    // the zero page stays allocated, count without it
+    struct Page *zero = zero_page_get();
+    assert(zero != NULL);
+    size_t nr_free_pages_store = nr_free_pages(), evict = vmm_stats.advice_evict;
+    struct mm_struct *mm = mm_create();
+    swap_entry_t entry[3];
+    int i;
+    assert(mm != NULL && mm_setup_pgdir(mm) == 0);
+    // the check counts pages exactly, no fault-around
+    mm->fault_around_max = 0;
+
+    // a normal page faulted first, then a sequential scan
+    assert(mm_map(mm, CHECK_ADVISE_BASE, PGSIZE, VM_READ | VM_WRITE, NULL) == 0);
+    assert(mm_map(mm, CHECK_ADVISE_SEQ, CHECK_ADVISE_NPAGE * PGSIZE, VM_READ | VM_WRITE, NULL) == 0);
+    assert(mm_advise(mm, CHECK_ADVISE_SEQ, CHECK_ADVISE_NPAGE * PGSIZE, MADV_SEQUENTIAL) == 0);
+    assert(do_pgfault(mm, 2, CHECK_ADVISE_BASE) == 0);
+    for (i = 0; i < CHECK_ADVISE_NPAGE; i ++) {
+        assert(do_pgfault(mm, 2, CHECK_ADVISE_SEQ + i * PGSIZE) == 0);
+    }
+    // the scan has passed SEQ_RECLAIM_LAG pages beyond the first 3
+    assert(vmm_stats.advice_evict == evict + CHECK_ADVISE_NPAGE - 1 - SEQ_RECLAIM_LAG);
+
+    // so they are written out before the older normal page
+    spin_lock(&(mm->mm_lock));
+    assert(swap_out(mm, 3, 0) == 3);
+    spin_unlock(&(mm->mm_lock));
+    assert(*get_pte(mm->pgdir, CHECK_ADVISE_BASE, 0) & PTE_P);
+    for (i = 0; i < CHECK_ADVISE_NPAGE; i ++) {
+        pte_t pte = *get_pte(mm->pgdir, CHECK_ADVISE_SEQ + i * PGSIZE, 0);
+        assert(((pte & PTE_P) == 0) == (i < 3));
+        if (i < 3) {
+            entry[i] = pte;
+            assert(swap_entry_count(entry[i]) == 1);
+        }
+    }
+
+    // dontneed drops pages and slots, the vma stays and reads find zeroes
+    assert(mm_advise(mm, CHECK_ADVISE_SEQ, CHECK_ADVISE_NPAGE * PGSIZE, MADV_DONTNEED) == 0);
+    assert(mm->map_count == 2);
+    for (i = 0; i < 3; i ++) {
+        assert(swap_entry_count(entry[i]) == 0);
+    }
+    for (i = 0; i < CHECK_ADVISE_NPAGE; i ++) {
+        pte_t *ptep = get_pte(mm->pgdir, CHECK_ADVISE_SEQ + i * PGSIZE, 0);
+        assert(ptep == NULL || *ptep == 0);
+    }
+    assert(do_pgfault(mm, 0, CHECK_ADVISE_SEQ) == 0);
+    assert(pte2page(*get_pte(mm->pgdir, CHECK_ADVISE_SEQ, 0)) == zero);
+
+    exit_mmap(mm);
+    mm_put_pgdir(mm);
+    mm_destroy(mm);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_advise_swap() succeeded!\n");
+}
+
+/* vmm_print_stats - print the vmm counters */
+void
+vmm_print_stats(void) {
+    cprintf("page faults: %u\n", pgfault_num);
+    cprintf("fault-around: %u faults, %u pages mapped ahead, %u used (faults avoided)\n",
+            vmm_stats.fault_around, vmm_stats.mapped_ahead, vmm_stats.used_ahead);
+    cprintf("zero page: %u read faults mapped it, %u write faults replaced it\n",
+            vmm_stats.zero_mapped, vmm_stats.zero_copied);
+    cprintf("copy-on-write: %u write faults copied a shared page, %u took it over\n",
+            vmm_stats.cow_copied, vmm_stats.cow_reused);
+    cprintf("vmas: %u merged, %u split; find_vma: %u lookups, %u cache misses, %u list steps\n",
+            vmm_stats.vma_merged, vmm_stats.vma_split, vmm_stats.find_vma, vmm_stats.find_vma_miss,
+            vmm_stats.find_vma_steps);
+    cprintf("populate: %u pages mapped without a fault\n", vmm_stats.populated);
+    cprintf("prefetch: %u pages queued, %u read, %u dropped; %u used, %u unused; %u throttled\n",
+            vmm_stats.pf_queued, vmm_stats.pf_read, vmm_stats.pf_dropped, vmm_stats.pf_used,
+            vmm_stats.pf_unused, vmm_stats.pf_throttled);
+    cprintf("advice: %u pages behind sequential scans reclaimed first, %u read in by willneed\n",
+            vmm_stats.advice_evict, vmm_stats.advice_willneed);
+    cprintf("mlock: %u pages locked, limit %u\n", mlock_pages, mlock_limit);
+    cprintf("rmap: %u chained mappings, %u not recorded; %u shared pages written out, %u victims busy\n",
+            vmm_stats.rmap_items, vmm_stats.rmap_nomem, vmm_stats.rmap_shared_out, vmm_stats.rmap_busy);
+    cprintf("range ops: %u tlb flushes of %u pages, %u full flushes, %u page tables freed\n",
+            vmm_stats.tlb_flush, vmm_stats.tlb_flush_pages, vmm_stats.tlb_flush_all, vmm_stats.pt_freed);
+}
+
 /* do_pgfault - interrupt handler to process the page fault execption
  * 				缺页异常中断处理器
  * @mm         : the control struct for a set of vma using the same PDT
@@ -345,6 +1855,7 @@ volatile unsigned int pgfault_num=0;
 int
 do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
     int ret = -E_INVAL;
+    spin_lock(&(mm->mm_lock));
     //try to find a vma which include addr
     //从mm关联的vma链表块中查询，查找是否存在 当前addr匹配的vma块
     struct vma_struct *vma = find_vma(mm, addr);
@@ -470,14 +1981,76 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
         cprintf("get_pte in do_pgfault failed\n");
         goto failed;
     }
+    struct Page *zero = NULL;
     //如果对应页表项的内容每一位都全为0，
     //说明之前并不存在，需要设置对应的数据，进行线性地址与物理地址的映射
-    if (*ptep == 0) { // if the phy addr isn't exist, then alloc a page & map the phy addr with logical addr
+    if (*ptep == 0 && !(error_code & 2) && (zero = zero_page_get()) != NULL) {
+        // a read of never written memory, share the zero page until the first write
+        if (page_insert(mm->pgdir, zero, addr, perm & ~PTE_W) != 0) {
+            cprintf("page_insert of the zero page in do_pgfault failed\n");
+            goto failed;
+        }
+        vmm_stats.zero_mapped ++;
+    }
+    else if (*ptep & PTE_P) {
+        // a write to a present, read-only page of a writable vma: the zero
+        // page or a page shared by mm_dup
+        struct Page *old = pte2page(*ptep);
+        if (old != zero_page && page_ref(old) == 1) {
+            // the other mms have copied it or are gone, take it over
+            if (page_insert(mm->pgdir, old, addr, perm) != 0) {
+                goto failed;
+            }
+            if (swap_init_ok && !(vma->vm_flags & VM_LOCKED)) {
+                // it may be on the queue of the mm that faulted it in
+                swap_page_unqueue(old);
+                swap_map_swappable(mm, addr, old, 0);
+                old->pra_vaddr = addr;
+            }
+            vmm_stats.cow_reused ++;
+        }
+        else {
+            struct Page *page = alloc_page();
+            if (page == NULL) {
+                cprintf("alloc_page for a copy-on-write fault failed\n");
+                goto failed;
+            }
+            if (old == zero_page) {
+                clear_page(page2kva(page));
+                vmm_stats.zero_copied ++;
+            }
+            else {
+                memcpy(page2kva(page), page2kva(old), PGSIZE);
+                vmm_stats.cow_copied ++;
+            }
+            // drops this mapping's reference to old
+            if (page_insert(mm->pgdir, page, addr, perm) != 0) {
+                free_page(page);
+                goto failed;
+            }
+            rmap_add(page, mm, addr);
+            // a locked page keeps off the swap queues
+            if (swap_init_ok && !(vma->vm_flags & VM_LOCKED)) {
+                swap_map_swappable(mm, addr, page, 0);
+                page->pra_vaddr = addr;
+            }
+        }
+    }
+    else if (*ptep == 0) { // if the phy addr isn't exist, then alloc a page & map the phy addr with logical addr
         // 令pgdir指向的页表中，la线性地址对应的二级页表项与一个新分配的物理页Page进行虚实地址的映射
-        if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
+        struct Page *page;
+        if ((page = pgdir_alloc_page(mm->pgdir, addr, perm)) == NULL) {
             cprintf("pgdir_alloc_page in do_pgfault failed\n");
             goto failed;
         }
+        //记录反向映射，新页只有这一个映射，不需分配内存
+        rmap_add(page, mm, addr);
+        //将新映射的page物理页设置为可交换的，纳入发生缺页的mm自己的swap置换队列
+        if (swap_init_ok && !(vma->vm_flags & VM_LOCKED)) {
+            swap_map_swappable(mm, addr, page, 0);
+            //设置物理页关联的虚拟内存
+            page->pra_vaddr = addr;
+        }
     }
     //若不是全为0，则可能之前被交换到swap磁盘中
     else { // if this pte is a swap entry, then load data from disk to a page with phy addr
@@ -493,6 +2066,8 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
             }    
             //将将交换进来的page页与mm->padir页表中对应addr的二级页表项建立映射关系(perm标识这个二级页表的各个权限位)
             page_insert(mm->pgdir, page, addr, perm);
+            //记录反向映射，换出时据此找到映射它的所有页表项
+            rmap_add(page, mm, addr);
             //当前page是可交换的，将其加入全局虚拟内存交换管理器的管理
             swap_map_swappable(mm, addr, page, 1);
             page->pra_vaddr = addr;
@@ -503,9 +2078,28 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
             goto failed;
         }
    }
+   // MADV_RANDOM: no readahead of any kind
+   if (vma->vm_advice != MADV_RANDOM) {
+       // read the next pages along a strided fault pattern from swap
+       prefetch_fault(mm, vma, addr);
+       // map the next pages too if the faults look sequential, MADV_SEQUENTIAL says they are
+       if (mm->fault_around_max > 0) {
+           fault_around_update(mm, addr);
+           int window = (vma->vm_advice == MADV_SEQUENTIAL) ? mm->fault_around_max : mm->fault_window;
+           if (window > 0 && (mm->fault_ahead = fault_around(mm, vma, addr, perm, zero, window)) > 0) {
+               vmm_stats.fault_around ++;
+               vmm_stats.mapped_ahead += mm->fault_ahead;
+           }
+       }
+       if (vma->vm_advice == MADV_SEQUENTIAL && swap_init_ok) {
+           seq_reclaim_behind(mm, vma, addr);
+       }
+   }
    //返回0代表缺页异常处理成功
    ret = 0;
 failed:
+    spin_unlock(&(mm->mm_lock));
+    trace_do_pgfault(addr, error_code, ret);
     return ret;
 }
 
@@ -5,10 +5,13 @@
 #include <list.h>
 #include <memlayout.h>
 #include <sync.h>
+#include <spinlock.h>
 
 //pre define
 struct mm_struct;
 
+#define PREFETCH_DEPTH_MAX      8
+
 // the virtual continuous memory area(vma)
 // 连续虚拟内存区域
 struct vma_struct {
@@ -24,6 +27,15 @@ struct vma_struct {
     // 双向链表，按照从小到大的顺序用vma_struct表示的虚拟内存空间链接起来
     // 连续虚拟内存块链表节点 (mm_struct->mmap_list)
     list_entry_t list_link;  // linear list link which sorted by start addr of vma
+    int vm_advice;                 // MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL, see mm_advise()
+    uintptr_t vm_scan;             // MADV_SEQUENTIAL: the pages below are reclaimed first
+    // stride prefetch state, see kern/mm/prefetch.c
+    uintptr_t pf_last;             // page of the last fault
+    int pf_stride;                 // # of pages between the last two faults
+    int pf_confidence;             // # of faults in a row at that stride
+    int pf_depth;                  // # of pages to prefetch along it, 0: throttled
+    int pf_nr;                     // # of pages read in since the last fault
+    uintptr_t pf_addr[PREFETCH_DEPTH_MAX];
 };
 
 // 可以使用page_link节点找到所关联的vma_struct
@@ -33,6 +45,16 @@ struct vma_struct {
 #define VM_READ                 0x00000001
 #define VM_WRITE                0x00000002
 #define VM_EXEC                 0x00000004
+#define VM_LOCKED               0x00000008      // pages kept resident, see mm_mlock()
+// mm_map option, not kept in vm_flags: map all pages right away
+#define VM_POPULATE             0x00000100
+
+// mm_advise advice: how the pages of a range will be accessed
+#define MADV_NORMAL             0       // no advice, the default
+#define MADV_RANDOM             1       // no readahead
+#define MADV_SEQUENTIAL         2       // readahead at full depth, reclaim behind the scan
+#define MADV_WILLNEED           3       // read the swapped-out pages in now
+#define MADV_DONTNEED           4       // drop the pages and swap slots now, refault as zeroes
 
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
@@ -46,20 +68,88 @@ struct mm_struct {
     int map_count;                 // the count of these vma
     // 用于虚拟内存置换算法的属性，使用void*指针做到通用 (lab中默认的swap_fifo替换算法中，将其做为了一个先进先出链表队列)
     void *sm_priv;                   // the private data for swap manager
+    // the fifo swap manager's queue of the pages of this mm, sm_priv points to it
+    list_entry_t swap_list;
+    // guards the vma list and the page tables, taken before the swap lock
+    spinlock_t mm_lock;
+    // fault-around state, see fault_around() in vmm.c
+    uintptr_t fault_last;          // page of the last fault
+    int fault_ahead;               // # of pages mapped after it
+    int fault_window;              // # of pages to map after the next fault
+    int fault_around_max;          // bound of fault_window, 0 disables fault-around
+    bool merge_vma;                // merge adjacent vmas with the same flags
+    size_t locked_vm;              // # of pages in VM_LOCKED vmas
+};
+
+#define FAULT_AROUND_MAX        16
+// mlock_limit at boot: this fraction of the free memory
+#define MLOCK_LIMIT_DIV         4
+
+// vmm counters, see vmm_print_stats()
+struct vmm_stats {
+    size_t fault_around;           // faults that mapped pages ahead
+    size_t mapped_ahead;           // pages mapped ahead
+    size_t used_ahead;             // of those, accessed before the next fault: faults avoided
+    size_t zero_mapped;            // read faults that mapped the zero page
+    size_t zero_copied;            // write faults that replaced it with a private page
+    size_t cow_copied;             // write faults that copied a page shared by mm_dup
+    size_t cow_reused;             // write faults that found the copy-on-write page no longer shared
+    size_t tlb_flush;              // batched flushes by invlpg, of range ops and mm_dup
+    size_t tlb_flush_pages;        // pages they invalidated
+    size_t tlb_flush_all;          // batched flushes by a %cr3 reload
+    size_t pt_freed;               // page tables freed when unmapping emptied them
+    size_t vma_merged;             // vmas merged into a neighbour
+    size_t vma_split;              // vmas split by mm_unmap, mm_protect and mm_advise
+    size_t find_vma;               // find_vma calls
+    size_t find_vma_miss;          // of those, not answered by mmap_cache
+    size_t find_vma_steps;         // vmas they walked past
+    size_t populated;              // pages mapped by mm_map with VM_POPULATE
+    size_t pf_queued;              // pages queued for prefetch from swap
+    size_t pf_read;                // of those, read in
+    size_t pf_dropped;             // of those, dropped: locks busy, memory low or queue full
+    size_t pf_used;                // pages read in that were accessed before the next fault
+    size_t pf_unused;              // and that were not
+    size_t pf_throttled;           // times a vma's prefetching was stopped
+    size_t advice_evict;           // pages behind a MADV_SEQUENTIAL scan put first for reclaim
+    size_t advice_willneed;        // pages read in by MADV_WILLNEED
+    size_t rmap_items;             // mappings on rmap chains, past the first of each page
+    size_t rmap_nomem;             // mappings not recorded for lack of memory
+    size_t rmap_shared_out;        // pages written out with several mappings taken down
+    size_t rmap_busy;              // swap victims put back: an mm busy or a mapping not recorded
 };
 
+extern struct vmm_stats vmm_stats;
+
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
-void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
+struct vma_struct *insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
+int mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_protect(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags);
+int mm_advise(struct mm_struct *mm, uintptr_t addr, size_t len, int advice);
+int mm_mlock(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_munlock(struct mm_struct *mm, uintptr_t addr, size_t len);
+int mm_map(struct mm_struct *mm, uintptr_t addr, size_t len, uint32_t vm_flags, struct vma_struct **vma_store);
 
 struct mm_struct *mm_create(void);
 void mm_destroy(struct mm_struct *mm);
+int mm_setup_pgdir(struct mm_struct *mm);
+void mm_put_pgdir(struct mm_struct *mm);
+struct mm_struct *mm_dup(struct mm_struct *oldmm);
+void exit_mmap(struct mm_struct *mm);
+void unmap_range(struct mm_struct *mm, uintptr_t start, uintptr_t end);
+void protect_range(struct mm_struct *mm, uintptr_t start, uintptr_t end, uint32_t perm);
 
 void vmm_init(void);
 
 int do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr);
+void vmm_print_stats(void);
+void check_advise_swap(void);
+void cow_bench(size_t mb);
+void vma_bench(int n);
+void populate_bench(size_t mb);
 
 extern volatile unsigned int pgfault_num;
+extern size_t mlock_limit;
 extern struct mm_struct *check_mm_struct;
 #endif /* !__KERN_MM_VMM_H__ */
 
@@ -0,0 +1,128 @@
+#include <defs.h>
+#include <x86.h>
+#include <atomic.h>
+#include <stdio.h>
+#include <assert.h>
+#include <smp.h>
+#include <spinlock.h>
+
+/* *
+ * Lock stress benchmark, run from the kmonitor with `lockbench`.
+ *
+ * Every online cpu takes and releases the same lock @iters times around
+ * an unprotected counter increment, which must add up in the end. The
+ * other cpus run their part in the IPI handler, started without waiting
+ * by smp_call_function, and all of them start together on bench.go. The
+ * boot cpu runs its part with interrupts disabled so that it can not be
+ * caught holding the lock while it sends another cross-cpu call.
+ * */
+
+enum {
+    BENCH_SPIN,
+    BENCH_TICKET,
+    BENCH_MCS,
+    NR_BENCH,
+};
+
+static const char *bench_name[NR_BENCH] = {"spin", "ticket", "mcs"};
+
+static struct lockstat bench_spin_stat = LOCKSTAT_INIT("bench-spin");
+static struct lockstat bench_ticket_stat = LOCKSTAT_INIT("bench-ticket");
+static struct lockstat bench_mcs_stat = LOCKSTAT_INIT("bench-mcs");
+
+static spinlock_t bench_spin = SPINLOCK_INIT_STAT("bench", &bench_spin_stat);
+static ticketlock_t bench_ticket = TICKETLOCK_INIT(&bench_ticket_stat);
+static mcslock_t bench_mcs = MCSLOCK_INIT(&bench_mcs_stat);
+
+static struct {
+    int kind;
+    int iters;
+    volatile uint32_t ready;            // # of other cpus waiting for go
+    volatile uint32_t done;             // # of other cpus finished
+    volatile bool go;
+    volatile uint32_t counter;          // incremented under the lock
+    uint64_t cycles[NCPU];
+} bench;
+
+static void
+bench_loop(void) {
+    struct mcs_node node;
+    int i;
+    uint64_t start = rdtsc();
+    for (i = 0; i < bench.iters; i ++) {
+        switch (bench.kind) {
+        case BENCH_SPIN:
+            spin_lock(&bench_spin);
+            bench.counter ++;
+            spin_unlock(&bench_spin);
+            break;
+        case BENCH_TICKET:
+            ticket_lock(&bench_ticket);
+            bench.counter ++;
+            ticket_unlock(&bench_ticket);
+            break;
+        case BENCH_MCS:
+            mcs_lock(&bench_mcs, &node);
+            bench.counter ++;
+            mcs_unlock(&bench_mcs, &node);
+            break;
+        }
+    }
+    bench.cycles[this_cpu()->id] = rdtsc() - start;
+}
+
+/* bench_worker - the part of the other cpus, in their IPI handler */
+static void
+bench_worker(void *arg) {
+    fetch_add(&bench.ready, 1);
+    while (!bench.go) {
+        pause();
+    }
+    bench_loop();
+    fetch_add(&bench.done, 1);
+}
+
+/* lock_bench - run the benchmark for each kind of lock and print cycles per acquisition */
+void
+lock_bench(int iters) {
+    int kind, i;
+    bool intr_flag;
+    if (iters <= 0) {
+        return;
+    }
+    cprintf("lockbench: %d cpu(s), %d iterations each\n", ncpu, iters);
+    cprintf("lock          cycles/op   max cycles\n");
+    for (kind = 0; kind < NR_BENCH; kind ++) {
+        bench.kind = kind;
+        bench.iters = iters;
+        bench.ready = bench.done = 0;
+        bench.go = 0;
+        bench.counter = 0;
+        for (i = 0; i < ncpu; i ++) {
+            bench.cycles[i] = 0;
+        }
+
+        local_intr_save(intr_flag);
+        smp_call_function(bench_worker, NULL, 0);
+        while (bench.ready != ncpu - 1) {
+            pause();
+        }
+        bench.go = 1;
+        bench_loop();
+        while (bench.done != ncpu - 1) {
+            pause();
+        }
+        local_intr_restore(intr_flag);
+
+        assert(bench.counter == (uint32_t)ncpu * iters);
+        uint64_t max = 0;
+        for (i = 0; i < ncpu; i ++) {
+            if (bench.cycles[i] > max) {
+                max = bench.cycles[i];
+            }
+        }
+        uint64_t per_op = max;
+        do_div(per_op, (uint32_t)ncpu * iters);
+        cprintf("%-12s %10u %12llu\n", bench_name[kind], (uint32_t)per_op, max);
+    }
+}
@@ -0,0 +1,205 @@
+#include <defs.h>
+#include <x86.h>
+#include <atomic.h>
+#include <stdio.h>
+#include <assert.h>
+#include <smp.h>
+#include <spinlock.h>
+
+// every lockstat that has recorded something, newest first
+static struct lockstat * volatile lockstat_list;
+
+/* lockstat_register - put @s on lockstat_list, the first time only */
+static void
+lockstat_register(struct lockstat *s) {
+    if (xchg(&s->registered, 1) != 0) {
+        return;
+    }
+    do {
+        s->next = lockstat_list;
+    } while (cmpxchg((volatile uint32_t *)&lockstat_list, (uint32_t)s->next, (uint32_t)s) != (uint32_t)s->next);
+}
+
+/* lockstat_record - account one acquisition, @spin is 0 if there was no wait */
+static inline void
+lockstat_record(struct lockstat *s, uint64_t spin) {
+    if (s == NULL) {
+        return;
+    }
+    if (!s->registered) {
+        lockstat_register(s);
+    }
+    s->acquired ++;
+    if (spin != 0) {
+        uint32_t cycles = (spin >> 32) ? 0xFFFFFFFF : (uint32_t)spin;
+        s->contended ++;
+        s->spin_cycles += spin;
+        if (cycles > s->max_spin) {
+            s->max_spin = cycles;
+        }
+    }
+}
+
+void
+spin_lock_init(spinlock_t *lock, const char *name) {
+    lock->locked = 0;
+    lock->name = name;
+    lock->cpu = NULL;
+    lock->stat = NULL;
+}
+
+/* spin_holding - whether this cpu holds @lock */
+bool
+spin_holding(spinlock_t *lock) {
+    return lock->locked && lock->cpu == this_cpu();
+}
+
+/* *
+ * spin_lock - take @lock, spinning on plain reads while it is held so
+ * the cache line is only written when the lock looks free
+ * */
+void
+spin_lock(spinlock_t *lock) {
+    uint64_t spin = 0;
+    if (spin_holding(lock)) {
+        panic("spin_lock: %s already held by this cpu.\n", lock->name);
+    }
+    if (xchg(&lock->locked, 1) != 0) {
+        uint64_t start = rdtsc();
+        do {
+            while (lock->locked) {
+                pause();
+            }
+        } while (xchg(&lock->locked, 1) != 0);
+        spin = rdtsc() - start;
+    }
+    lock->cpu = this_cpu();
+    lockstat_record(lock->stat, spin);
+}
+
+/* spin_trylock - take @lock if it is free, returns 1 on success */
+bool
+spin_trylock(spinlock_t *lock) {
+    if (lock->locked || xchg(&lock->locked, 1) != 0) {
+        return 0;
+    }
+    lock->cpu = this_cpu();
+    lockstat_record(lock->stat, 0);
+    return 1;
+}
+
+void
+spin_unlock(spinlock_t *lock) {
+    if (!spin_holding(lock)) {
+        panic("spin_unlock: %s not held by this cpu.\n", lock->name);
+    }
+    lock->cpu = NULL;
+    // xchg orders the stores of the critical section before the release
+    xchg(&lock->locked, 0);
+}
+
+/* ticket_lock - take a ticket, wait until it is served */
+void
+ticket_lock(ticketlock_t *lock) {
+    uint64_t spin = 0;
+    uint32_t ticket = fetch_add(&lock->next, 1);
+    if (lock->owner != ticket) {
+        uint64_t start = rdtsc();
+        while (lock->owner != ticket) {
+            pause();
+        }
+        spin = rdtsc() - start;
+    }
+    lockstat_record(lock->stat, spin);
+}
+
+/* ticket_trylock - take @lock if nobody holds or waits for it */
+bool
+ticket_trylock(ticketlock_t *lock) {
+    uint32_t owner = lock->owner;
+    if (cmpxchg(&lock->next, owner, owner + 1) != owner) {
+        return 0;
+    }
+    lockstat_record(lock->stat, 0);
+    return 1;
+}
+
+void
+ticket_unlock(ticketlock_t *lock) {
+    // only the holder writes owner; on x86 a compiler barrier is enough
+    asm volatile ("" ::: "memory");
+    lock->owner = lock->owner + 1;
+}
+
+/* mcs_lock - queue @node at the tail of @lock, wait until the previous holder hands over */
+void
+mcs_lock(mcslock_t *lock, struct mcs_node *node) {
+    uint64_t spin = 0;
+    node->next = NULL;
+    node->locked = 1;
+    struct mcs_node *prev = (struct mcs_node *)xchg((volatile uint32_t *)&lock->tail, (uint32_t)node);
+    if (prev != NULL) {
+        uint64_t start = rdtsc();
+        prev->next = node;
+        while (node->locked) {
+            pause();
+        }
+        spin = rdtsc() - start;
+    }
+    lockstat_record(lock->stat, spin);
+}
+
+/* mcs_trylock - take @lock with @node if it is free */
+bool
+mcs_trylock(mcslock_t *lock, struct mcs_node *node) {
+    node->next = NULL;
+    node->locked = 1;
+    if (cmpxchg((volatile uint32_t *)&lock->tail, 0, (uint32_t)node) != 0) {
+        return 0;
+    }
+    lockstat_record(lock->stat, 0);
+    return 1;
+}
+
+/* mcs_unlock - hand @lock to the next waiter, or leave it free */
+void
+mcs_unlock(mcslock_t *lock, struct mcs_node *node) {
+    if (node->next == NULL) {
+        if (cmpxchg((volatile uint32_t *)&lock->tail, (uint32_t)node, 0) == (uint32_t)node) {
+            return;
+        }
+        // a waiter swapped itself in but has not linked to us yet
+        while (node->next == NULL) {
+            pause();
+        }
+    }
+    node->next->locked = 0;
+}
+
+/* *
+ * lockstat_print - acquisitions, contended acquisitions and spin cycles
+ * of every lock with statistics that has been taken
+ * */
+void
+lockstat_print(void) {
+    struct lockstat *s;
+    cprintf("lock           acquired  contended   avg spin   max spin\n");
+    for (s = lockstat_list; s != NULL; s = s->next) {
+        uint64_t avg = s->spin_cycles;
+        if (s->contended != 0) {
+            do_div(avg, s->contended);
+        }
+        cprintf("%-12s %10u %10u %10u %10u\n", s->name, s->acquired, s->contended, (uint32_t)avg, s->max_spin);
+    }
+}
+
+/* lockstat_reset - clear the counters; locks taken meanwhile may count one acquisition off */
+void
+lockstat_reset(void) {
+    struct lockstat *s;
+    for (s = lockstat_list; s != NULL; s = s->next) {
+        s->acquired = s->contended = 0;
+        s->spin_cycles = 0;
+        s->max_spin = 0;
+    }
+}
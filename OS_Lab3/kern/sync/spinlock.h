@@ -0,0 +1,95 @@
+#ifndef __KERN_SYNC_SPINLOCK_H__
+#define __KERN_SYNC_SPINLOCK_H__
+
+#include <defs.h>
+#include <sync.h>
+
+struct cpu;
+
+/* *
+ * Contention statistics of a lock, see lockstat_print(). A lock records
+ * into its lockstat only if it has one; the counters are updated by the
+ * holder right after it acquires the lock, so they need no atomics. Several
+ * locks must not share a lockstat.
+ * */
+struct lockstat {
+    const char *name;
+    size_t acquired;                    // # of acquisitions
+    size_t contended;                   // # of acquisitions that had to wait
+    uint64_t spin_cycles;               // total cycles spent waiting
+    uint32_t max_spin;                  // longest wait, in cycles
+    volatile uint32_t registered;       // on the lockstat list
+    struct lockstat *next;
+};
+
+#define LOCKSTAT_INIT(n)        { .name = (n) }
+
+void lockstat_print(void);
+void lockstat_reset(void);
+
+/* *
+ * Test-and-test-and-set spinlock. A cpu must not take a lock it already
+ * holds; spin_lock panics instead of deadlocking. Locks taken from
+ * interrupt handlers must be taken with spin_lock_irqsave everywhere.
+ * */
+typedef struct {
+    volatile uint32_t locked;
+    const char *name;                   // for debugging
+    struct cpu *cpu;                    // holder, valid while locked
+    struct lockstat *stat;              // NULL: no statistics
+} spinlock_t;
+
+#define SPINLOCK_INIT(n)            { .locked = 0, .name = (n), .cpu = NULL, .stat = NULL }
+#define SPINLOCK_INIT_STAT(n, s)    { .locked = 0, .name = (n), .cpu = NULL, .stat = (s) }
+
+void spin_lock_init(spinlock_t *lock, const char *name);
+void spin_lock(spinlock_t *lock);
+bool spin_trylock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+bool spin_holding(spinlock_t *lock);
+
+#define spin_lock_irqsave(lock, x)          do { local_intr_save(x); spin_lock(lock); } while (0)
+#define spin_unlock_irqrestore(lock, x)     do { spin_unlock(lock); local_intr_restore(x); } while (0)
+
+/* *
+ * Ticket lock: waiters are served in arrival order. Everyone spins on the
+ * same owner word, so a release costs one cache line transfer per waiter.
+ * */
+typedef struct {
+    volatile uint32_t next;             // next ticket to hand out
+    volatile uint32_t owner;            // ticket being served
+    struct lockstat *stat;
+} ticketlock_t;
+
+#define TICKETLOCK_INIT(s)          { .next = 0, .owner = 0, .stat = (s) }
+
+void ticket_lock(ticketlock_t *lock);
+bool ticket_trylock(ticketlock_t *lock);
+void ticket_unlock(ticketlock_t *lock);
+
+/* *
+ * MCS queue lock: FIFO like the ticket lock, but every waiter spins on
+ * its own mcs_node, which the caller provides (usually on its stack) and
+ * passes to both mcs_lock and mcs_unlock. A release touches only the
+ * next waiter's node.
+ * */
+struct mcs_node {
+    struct mcs_node * volatile next;
+    volatile uint32_t locked;
+};
+
+typedef struct {
+    struct mcs_node * volatile tail;    // last waiter, NULL if free
+    struct lockstat *stat;
+} mcslock_t;
+
+#define MCSLOCK_INIT(s)             { .tail = NULL, .stat = (s) }
+
+void mcs_lock(mcslock_t *lock, struct mcs_node *node);
+bool mcs_trylock(mcslock_t *lock, struct mcs_node *node);
+void mcs_unlock(mcslock_t *lock, struct mcs_node *node);
+
+void lock_bench(int iters);
+
+#endif /* !__KERN_SYNC_SPINLOCK_H__ */
+
@@ -0,0 +1,99 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <sync.h>
+#include <spinlock.h>
+
+/* *
+ * Interrupts-off time of local_intr_save regions, per call site.
+ *
+ * Sites are keyed by the __FILE__ pointer and line of the save, in a small
+ * open addressed table; a region that finds the table full is only counted
+ * in the totals. Durations are in cycles, clamped to 32 bits. The table
+ * is shared by all cpus and guarded by irqoff_lock.
+ * */
+
+#define IRQOFF_SITES            64
+
+static struct irqoff_site {
+    const char *file;                   // NULL if the slot is free
+    int line;
+    size_t count;
+    uint64_t total;
+    uint32_t max;
+} irqoff_sites[IRQOFF_SITES];
+
+static size_t irqoff_count, irqoff_untracked;
+static uint64_t irqoff_total;
+
+static spinlock_t irqoff_lock = SPINLOCK_INIT("irqoff");
+
+/* __irqoff_end - called by local_intr_restore right before interrupts are enabled again */
+void
+__irqoff_end(void) {
+    struct cpu *c = this_cpu();
+    uint64_t d = rdtsc() - c->irqoff_since;
+    uint32_t cycles = (d >> 32) ? 0xFFFFFFFF : (uint32_t)d;
+    uint32_t i, h = (((uintptr_t)c->irqoff_file >> 2) ^ (c->irqoff_line * 31)) % IRQOFF_SITES;
+
+    spin_lock(&irqoff_lock);
+    irqoff_count ++;
+    irqoff_total += d;
+    for (i = 0; i < IRQOFF_SITES; i ++, h = (h + 1) % IRQOFF_SITES) {
+        struct irqoff_site *s = irqoff_sites + h;
+        if (s->file == NULL) {
+            s->file = c->irqoff_file;
+            s->line = c->irqoff_line;
+        }
+        if (s->file == c->irqoff_file && s->line == c->irqoff_line) {
+            s->count ++;
+            s->total += d;
+            if (cycles > s->max) {
+                s->max = cycles;
+            }
+            goto out;
+        }
+    }
+    irqoff_untracked ++;
+out:
+    spin_unlock(&irqoff_lock);
+}
+
+/* irqoff_print_stats - print the totals and the @n sites with the longest interrupts-off time */
+void
+irqoff_print_stats(int n) {
+    bool printed[IRQOFF_SITES] = {0};
+    int i, k;
+    cprintf("irq-off regions: %u, %llu cycles in total, %u sites not tracked\n",
+            irqoff_count, irqoff_total, irqoff_untracked);
+    cprintf("         max        avg      count  site\n");
+    for (k = 0; k < n; k ++) {
+        struct irqoff_site *worst = NULL;
+        for (i = 0; i < IRQOFF_SITES; i ++) {
+            struct irqoff_site *s = irqoff_sites + i;
+            if (s->file != NULL && !printed[i] && (worst == NULL || s->max > worst->max)) {
+                worst = s;
+            }
+        }
+        if (worst == NULL) {
+            break;
+        }
+        printed[worst - irqoff_sites] = 1;
+        uint64_t avg = worst->total;
+        do_div(avg, worst->count);
+        cprintf("  %10u %10u %10u  %s:%d\n", worst->max, (uint32_t)avg, worst->count, worst->file, worst->line);
+    }
+}
+
+void
+irqoff_reset_stats(void) {
+    bool intr_flag;
+    spin_lock_irqsave(&irqoff_lock, intr_flag);
+    {
+        memset(irqoff_sites, 0, sizeof(irqoff_sites));
+        irqoff_count = irqoff_untracked = 0;
+        irqoff_total = 0;
+    }
+    spin_unlock_irqrestore(&irqoff_lock, intr_flag);
+}
@@ -4,11 +4,26 @@
 #include <x86.h>
 #include <intr.h>
 #include <mmu.h>
+#include <smp.h>
+
+/* *
+ * local_intr_save/local_intr_restore also measure how long interrupts stay
+ * disabled: the outermost save records where and when in the cpu's
+ * struct cpu, the matching restore charges the time to that place (see
+ * kern/sync/sync.c).
+ * */
+void __irqoff_end(void);
+void irqoff_print_stats(int n);
+void irqoff_reset_stats(void);
 
 static inline bool
-__intr_save(void) {
+__intr_save(const char *file, int line) {
     if (read_eflags() & FL_IF) {
         intr_disable();
+        struct cpu *c = this_cpu();
+        c->irqoff_file = file;
+        c->irqoff_line = line;
+        c->irqoff_since = rdtsc();
         return 1;
     }
     return 0;
@@ -17,11 +32,12 @@ __intr_save(void) {
 static inline void
 __intr_restore(bool flag) {
     if (flag) {
+        __irqoff_end();
         intr_enable();
     }
 }
 
-#define local_intr_save(x)      do { x = __intr_save(); } while (0)
+#define local_intr_save(x)      do { x = __intr_save(__FILE__, __LINE__); } while (0)
 #define local_intr_restore(x)   __intr_restore(x);
 
 #endif /* !__KERN_SYNC_SYNC_H__ */
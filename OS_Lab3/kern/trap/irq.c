@@ -0,0 +1,279 @@
+#include <defs.h>
+#include <stdio.h>
+#include <error.h>
+#include <string.h>
+#include <assert.h>
+#include <sync.h>
+#include <clock.h>
+#include <picirq.h>
+#include <trap.h>
+#include <irq.h>
+
+/* *
+ * Each irq line has a chain of irqaction, allocated from a static pool
+ * since drivers register before (and without) any allocator of small
+ * objects. Every vector, exception or irq, also has a hit counter and
+ * latency statistics: the cycles from the rdtsc in __alltraps to the end
+ * of trap_dispatch, with min, max and a log2 histogram. The 'interrupts'
+ * monitor command prints the table with the handlers, 'latency' the
+ * distributions.
+ * */
+
+#define NR_IRQ_ACTIONS          32
+#define LAT_BUCKETS             32      // bucket i: [2^i, 2^(i+1)) cycles
+
+struct irqaction {
+    irq_handler_t handler;
+    uint32_t flags;
+    const char *name;
+    void *dev;
+    struct irqaction *next;             // next handler on the line, or the pool free list
+};
+
+static struct irq_desc {
+    struct irq_chip *chip;              // NULL: pic_chip for ISA irqs, none for the others
+    struct irqaction *action;           // chain of handlers
+    size_t unhandled;                   // # of times no handler claimed the irq
+} irq_desc[NR_IRQS];
+
+static struct irqaction irqaction_pool[NR_IRQ_ACTIONS];
+static struct irqaction *irqaction_free;
+static bool irqaction_pool_ready;
+
+static struct vector_stat {
+    size_t count;
+    uint64_t cycles;
+    uint32_t min, max;
+    size_t hist[LAT_BUCKETS];
+} vector_stats[256];
+
+static struct irq_chip *
+irq_chip(unsigned int irq) {
+    if (irq_desc[irq].chip != NULL) {
+        return irq_desc[irq].chip;
+    }
+    return (irq < 16) ? &pic_chip : NULL;
+}
+
+static struct irqaction *
+irqaction_alloc(void) {
+    int i;
+    if (!irqaction_pool_ready) {
+        for (i = 0; i < NR_IRQ_ACTIONS; i ++) {
+            irqaction_pool[i].next = irqaction_free;
+            irqaction_free = irqaction_pool + i;
+        }
+        irqaction_pool_ready = 1;
+    }
+    struct irqaction *action = irqaction_free;
+    if (action != NULL) {
+        irqaction_free = action->next;
+    }
+    return action;
+}
+
+static void
+irqaction_free_one(struct irqaction *action) {
+    action->next = irqaction_free;
+    irqaction_free = action;
+}
+
+/* irq_set_chip - let @chip enable, disable and acknowledge line @irq */
+void
+irq_set_chip(unsigned int irq, struct irq_chip *chip) {
+    assert(irq < NR_IRQS);
+    irq_desc[irq].chip = chip;
+}
+
+/* *
+ * request_irq - add @handler, called with @dev, to line @irq and enable the
+ * line if it is the first one. Returns -E_INVAL for a bad line or a line
+ * already taken that the old or new handler does not share, and -E_NO_MEM
+ * when the action pool is empty.
+ * */
+int
+request_irq(unsigned int irq, irq_handler_t handler, uint32_t flags, const char *name, void *dev) {
+    bool intr_flag;
+    int ret = 0;
+    if (irq >= NR_IRQS || handler == NULL) {
+        return -E_INVAL;
+    }
+    local_intr_save(intr_flag);
+    {
+        struct irq_desc *desc = irq_desc + irq;
+        struct irqaction *action, **pp;
+        if (desc->action != NULL && !(desc->action->flags & flags & IRQF_SHARED)) {
+            ret = -E_INVAL;
+            goto out;
+        }
+        if ((action = irqaction_alloc()) == NULL) {
+            ret = -E_NO_MEM;
+            goto out;
+        }
+        action->handler = handler;
+        action->flags = flags;
+        action->name = name;
+        action->dev = dev;
+        action->next = NULL;
+        for (pp = &(desc->action); *pp != NULL; pp = &((*pp)->next))
+            /* find the tail */;
+        *pp = action;
+        struct irq_chip *chip = irq_chip(irq);
+        if (desc->action == action && chip != NULL && chip->enable != NULL) {
+            chip->enable(irq);
+        }
+    }
+out:
+    local_intr_restore(intr_flag);
+    return ret;
+}
+
+/* free_irq - remove the handler of line @irq registered with @dev, disable the line if it was the last */
+void
+free_irq(unsigned int irq, void *dev) {
+    bool intr_flag;
+    assert(irq < NR_IRQS);
+    local_intr_save(intr_flag);
+    {
+        struct irq_desc *desc = irq_desc + irq;
+        struct irqaction *action, **pp;
+        for (pp = &(desc->action); (action = *pp) != NULL; pp = &(action->next)) {
+            if (action->dev == dev) {
+                *pp = action->next;
+                irqaction_free_one(action);
+                break;
+            }
+        }
+        if (action == NULL) {
+            cprintf("free_irq: no handler of irq %d for %p\n", irq, dev);
+        }
+        struct irq_chip *chip = irq_chip(irq);
+        if (action != NULL && desc->action == NULL && chip != NULL && chip->disable != NULL) {
+            chip->disable(irq);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* *
+ * irq_dispatch - called by trap_dispatch for vectors that are not
+ * exceptions: acknowledge the line and run its handlers. Returns 0 if the
+ * vector has no handler at all, which the caller reports.
+ * */
+bool
+irq_dispatch(struct trapframe *tf) {
+    unsigned int irq = tf->tf_trapno - IRQ_OFFSET;
+    if (tf->tf_trapno < IRQ_OFFSET || irq >= NR_IRQS || irq_desc[irq].action == NULL) {
+        return 0;
+    }
+    struct irq_desc *desc = irq_desc + irq;
+    struct irq_chip *chip = irq_chip(irq);
+    struct irqaction *action;
+    bool handled = 0;
+    if (chip != NULL && chip->ack != NULL) {
+        chip->ack(irq);
+    }
+    for (action = desc->action; action != NULL; action = action->next) {
+        handled |= action->handler(irq, tf, action->dev);
+    }
+    if (!handled) {
+        desc->unhandled ++;
+    }
+    return 1;
+}
+
+/* irq_account - charge one trap of @vector that took @cycles */
+void
+irq_account(uint32_t vector, uint64_t cycles) {
+    if (vector < 256) {
+        struct vector_stat *vs = vector_stats + vector;
+        uint32_t c = (cycles >> 32) ? 0xFFFFFFFF : (uint32_t)cycles;
+        if (vs->count == 0 || c < vs->min) {
+            vs->min = c;
+        }
+        if (c > vs->max) {
+            vs->max = c;
+        }
+        vs->count ++;
+        vs->cycles += cycles;
+        vs->hist[(c == 0) ? 0 : 31 - __builtin_clz(c)] ++;
+    }
+}
+
+static const char *
+vector_name(uint32_t vector) {
+    unsigned int irq = vector - IRQ_OFFSET;
+    if (vector >= IRQ_OFFSET && irq < NR_IRQS && irq_desc[irq].action != NULL) {
+        return irq_desc[irq].action->name;
+    }
+    return trapname(vector);
+}
+
+/* irq_print_latency - print count, min, avg, max and the histogram of every vector taken */
+void
+irq_print_latency(void) {
+    uint32_t vector;
+    int i;
+    cprintf("vec  name                  count       min       avg       max  (cycles)\n");
+    for (vector = 0; vector < 256; vector ++) {
+        struct vector_stat *vs = vector_stats + vector;
+        if (vs->count == 0) {
+            continue;
+        }
+        uint64_t avg = vs->cycles;
+        do_div(avg, vs->count);
+        cprintf("%3d  %-16s %10u %9u %9u %9u\n    ", vector, vector_name(vector),
+                vs->count, vs->min, (uint32_t)avg, vs->max);
+        for (i = 0; i < LAT_BUCKETS; i ++) {
+            if (vs->hist[i] != 0) {
+                cprintf(" 2^%d:%u", i, vs->hist[i]);
+            }
+        }
+        cprintf("\n");
+    }
+}
+
+/* irq_reset_stats - forget the counts and latencies of all vectors */
+void
+irq_reset_stats(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        memset(vector_stats, 0, sizeof(vector_stats));
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* irq_print_stats - print every vector taken so far, and every irq line with handlers */
+void
+irq_print_stats(void) {
+    uint32_t vector;
+    cprintf("vec  irq  chip         count  cycles/hit  handlers\n");
+    for (vector = 0; vector < 256; vector ++) {
+        unsigned int irq = vector - IRQ_OFFSET;
+        bool is_irq = (vector >= IRQ_OFFSET && irq < NR_IRQS);
+        struct vector_stat *vs = vector_stats + vector;
+        if (vs->count == 0 && !(is_irq && irq_desc[irq].action != NULL)) {
+            continue;
+        }
+        uint64_t avg = vs->cycles;
+        if (vs->count != 0) {
+            do_div(avg, vs->count);
+        }
+        if (!is_irq) {
+            cprintf("%3d    -  %-6s %12u  %10u  %s\n", vector, "cpu", vs->count, (uint32_t)avg, trapname(vector));
+            continue;
+        }
+        struct irq_chip *chip = irq_chip(irq);
+        struct irqaction *action;
+        cprintf("%3d  %3d  %-6s %12u  %10u ", vector, irq, (chip != NULL) ? chip->name : "-",
+                vs->count, (uint32_t)avg);
+        for (action = irq_desc[irq].action; action != NULL; action = action->next) {
+            cprintf(" %s", action->name);
+        }
+        if (irq_desc[irq].unhandled != 0) {
+            cprintf("  (%u unhandled)", irq_desc[irq].unhandled);
+        }
+        cprintf("\n");
+    }
+}
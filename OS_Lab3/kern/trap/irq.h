@@ -0,0 +1,45 @@
+#ifndef __KERN_TRAP_IRQ_H__
+#define __KERN_TRAP_IRQ_H__
+
+#include <defs.h>
+
+struct trapframe;
+
+/* *
+ * Interrupt handler registration (kern/trap/irq.c).
+ *
+ * IRQ n arrives as vector IRQ_OFFSET + n, whoever routed it. A driver
+ * attaches a handler with request_irq(); the first handler of a line
+ * enables it, freeing the last one disables it. A line may carry several
+ * handlers if all of them ask for IRQF_SHARED; they are called in turn and
+ * each returns whether its device raised the interrupt.
+ *
+ * How a line is enabled, disabled and acknowledged is up to its irq_chip:
+ * the 8259A/IOAPIC for the ISA irqs unless told otherwise, the local APIC
+ * for its own vectors. The line is acknowledged once, before the handlers
+ * run, so they do not have to.
+ * */
+#define NR_IRQS                 32
+
+struct irq_chip {
+    const char *name;
+    void (*enable)(unsigned int irq);
+    void (*disable)(unsigned int irq);
+    void (*ack)(unsigned int irq);
+};
+
+#define IRQF_SHARED             0x1
+
+typedef bool (*irq_handler_t)(unsigned int irq, struct trapframe *tf, void *dev);
+
+int request_irq(unsigned int irq, irq_handler_t handler, uint32_t flags, const char *name, void *dev);
+void free_irq(unsigned int irq, void *dev);
+void irq_set_chip(unsigned int irq, struct irq_chip *chip);
+bool irq_dispatch(struct trapframe *tf);
+void irq_account(uint32_t vector, uint64_t cycles);
+void irq_print_stats(void);
+void irq_print_latency(void);
+void irq_reset_stats(void);
+
+#endif /* !__KERN_TRAP_IRQ_H__ */
+
@@ -0,0 +1,104 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sync.h>
+#include <clock.h>
+#include <smp.h>
+#include <softirq.h>
+
+/* *
+ * Pending softirqs are bits in softirq_pending_mask, set by hard irq
+ * handlers with interrupts disabled. do_softirq() clears the mask, enables
+ * interrupts and runs every action that was pending once, round robin, so
+ * a source that always has more work gets one budget per round and never
+ * more. After MAX_SOFTIRQ_RESTART rounds whatever is still pending waits
+ * for the next interrupt; a tick is requested so that there is one.
+ * Softirqs are raised and run on the boot cpu only, where the device
+ * irqs and the tick arrive.
+ * */
+
+#define MAX_SOFTIRQ_RESTART     4
+
+static struct softirq {
+    softirq_action_t action;
+    int budget;
+    // statistics, see softirq_print_stats()
+    size_t runs;                        // # of calls of the action
+    size_t exhausted;                   // # of calls that used up the budget
+} softirq_vec[NR_SOFTIRQS];
+
+static volatile uint32_t softirq_pending_mask;
+static bool softirq_active;             // do_softirq is running, don't nest
+static size_t softirq_deferred;         // # of times work was left for the next irq
+
+/* open_softirq - set the @action of softirq @nr and its @budget per call */
+void
+open_softirq(int nr, softirq_action_t action, int budget) {
+    assert(nr >= 0 && nr < NR_SOFTIRQS && budget > 0);
+    softirq_vec[nr].action = action;
+    softirq_vec[nr].budget = budget;
+}
+
+/* raise_softirq - mark softirq @nr pending, it runs when trap() returns */
+void
+raise_softirq(int nr) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        softirq_pending_mask |= (1 << nr);
+    }
+    local_intr_restore(intr_flag);
+}
+
+bool
+softirq_pending(void) {
+    return softirq_pending_mask != 0;
+}
+
+/* *
+ * do_softirq - run the pending softirqs. Called with interrupts disabled,
+ * from trap() when the interrupted code had them enabled and from the idle
+ * loop; returns with interrupts disabled.
+ * */
+void
+do_softirq(void) {
+    uint32_t pending;
+    int nr, restart = MAX_SOFTIRQ_RESTART;
+    if (softirq_active || softirq_pending_mask == 0 || this_cpu()->id != 0) {
+        return;
+    }
+    softirq_active = 1;
+    while ((pending = softirq_pending_mask) != 0 && restart -- > 0) {
+        softirq_pending_mask = 0;
+        intr_enable();
+        for (nr = 0; nr < NR_SOFTIRQS; nr ++) {
+            struct softirq *s = softirq_vec + nr;
+            if (!(pending & (1 << nr)) || s->action == NULL) {
+                continue;
+            }
+            s->runs ++;
+            if (s->action(s->budget)) {
+                s->exhausted ++;
+                raise_softirq(nr);
+            }
+        }
+        intr_disable();
+    }
+    if (softirq_pending_mask != 0) {
+        softirq_deferred ++;
+        clock_request_tick(clock_ticks() + 1);
+    }
+    softirq_active = 0;
+}
+
+void
+softirq_print_stats(void) {
+    static const char *names[NR_SOFTIRQS] = {"timer", "console", "prefetch"};
+    int nr;
+    for (nr = 0; nr < NR_SOFTIRQS; nr ++) {
+        cprintf("  softirq %-8s budget %4d, %u runs, %u out of budget\n", names[nr],
+                softirq_vec[nr].budget, softirq_vec[nr].runs, softirq_vec[nr].exhausted);
+    }
+    cprintf("  %u times left for the next interrupt\n", softirq_deferred);
+}
@@ -0,0 +1,31 @@
+#ifndef __KERN_TRAP_SOFTIRQ_H__
+#define __KERN_TRAP_SOFTIRQ_H__
+
+#include <defs.h>
+
+/* *
+ * Deferred interrupt work (kern/trap/softirq.c).
+ *
+ * A hard irq handler only acknowledges its device, queues what it got and
+ * calls raise_softirq(). The work itself is done by the softirq's action,
+ * on the way out of trap() with interrupts enabled. The action is given
+ * its budget, the most items it may handle in one go, and returns whether
+ * work is left; if so, it runs again after the other pending softirqs.
+ * */
+enum {
+    TIMER_SOFTIRQ,
+    CONSOLE_SOFTIRQ,
+    PREFETCH_SOFTIRQ,
+    NR_SOFTIRQS,
+};
+
+typedef bool (*softirq_action_t)(int budget);
+
+void open_softirq(int nr, softirq_action_t action, int budget);
+void raise_softirq(int nr);
+bool softirq_pending(void);
+void do_softirq(void);
+void softirq_print_stats(void);
+
+#endif /* !__KERN_TRAP_SOFTIRQ_H__ */
+
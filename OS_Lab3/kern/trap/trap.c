@@ -10,16 +10,9 @@
 #include <vmm.h>
 #include <swap.h>
 #include <kdebug.h>
-
-#define TICK_NUM 100
-
-static void print_ticks() {
-    cprintf("%d ticks\n",TICK_NUM);
-#ifdef DEBUG_GRADE
-    cprintf("End of Test.\n");
-    panic("EOT: kernel seems ok.");
-#endif
-}
+#include <trace.h>
+#include <softirq.h>
+#include <irq.h>
 
 /* *
  * Interrupt descriptor table:
@@ -66,7 +59,13 @@ idt_init(void) {
     lidt(&idt_pd);
 }
 
-static const char *
+/* idt_load - load the IDT built by idt_init on another cpu */
+void
+idt_load(void) {
+    lidt(&idt_pd);
+}
+
+const char *
 trapname(int trapno) {
     static const char * const excnames[] = {
         "Divide error",
@@ -159,7 +158,7 @@ print_pgfault(struct trapframe *tf) {
      * bit 1 == 0 means read, 1 means write
      * bit 2 == 0 means kernel, 1 means user
      * */
-    cprintf("page fault at 0x%08x: %c/%c [%s].\n", rcr2(),
+    trace_pgfault(rcr2(),
             (tf->tf_err & 4) ? 'U' : 'K',
             (tf->tf_err & 2) ? 'W' : 'R',
             (tf->tf_err & 1) ? "protection fault" : "no page found");
@@ -183,8 +182,6 @@ extern struct mm_struct *check_mm_struct;
 
 static void
 trap_dispatch(struct trapframe *tf) {
-    char c;
-
     int ret;
 
     switch (tf->tf_trapno) {
@@ -197,40 +194,16 @@ trap_dispatch(struct trapframe *tf) {
             panic("handle pgfault failed. %e\n", ret);
         }
         break;
-    case IRQ_OFFSET + IRQ_TIMER:
-#if 0
-    LAB3  CHALLENGE 1 : If some page replacement algorithm(such as CLOCK PRA) need tick to change the priority of pages, 
-    then you can add code here. 
-#endif
-        /* LAB1 YOUR CODE : STEP 3 */
-        /* handle the timer interrupt */
-        /* (1) After a timer interrupt, you should record this event using a global variable (increase it), such as ticks in kern/driver/clock.c
-         * (2) Every TICK_NUM cycle, you can print some info using a funciton, such as print_ticks().
-         * (3) Too Simple? Yes, I think so!
-         */
-        ticks ++;
-        if (ticks % TICK_NUM == 0) {
-            print_ticks();
-        }
-        break;
-    case IRQ_OFFSET + IRQ_COM1:
-        c = cons_getc();
-        cprintf("serial [%03d] %c\n", c, c);
-        break;
-    case IRQ_OFFSET + IRQ_KBD:
-        c = cons_getc();
-        cprintf("kbd [%03d] %c\n", c, c);
-        break;
     //LAB1 CHALLENGE 1 : YOUR CODE you should modify below codes.
     case T_SWITCH_TOU:
     case T_SWITCH_TOK:
         panic("T_SWITCH_** ??\n");
         break;
-    case IRQ_OFFSET + IRQ_IDE1:
-    case IRQ_OFFSET + IRQ_IDE2:
-        /* do nothing */
-        break;
     default:
+        // device interrupts go to the handlers registered with request_irq
+        if (irq_dispatch(tf)) {
+            break;
+        }
         // in kernel, it must be a mistake
         if ((tf->tf_cs & 3) == 0) {
             print_trapframe(tf);
@@ -243,10 +216,17 @@ trap_dispatch(struct trapframe *tf) {
  * trap - handles or dispatches an exception/interrupt. if and when trap() returns,
  * the code in kern/trap/trapentry.S restores the old CPU state saved in the
  * trapframe and then uses the iret instruction to return from the exception.
+ * @entry_tsc is the time-stamp counter read by __alltraps.
  * */
 void
-trap(struct trapframe *tf) {
+trap(struct trapframe *tf, uint64_t entry_tsc) {
     // dispatch based on what type of trap occurred
     trap_dispatch(tf);
+    // the hard part is over, charge it to the vector
+    irq_account(tf->tf_trapno, rdtsc() - entry_tsc);
+    // run deferred work, unless we interrupted code that had irqs disabled
+    if (tf->tf_eflags & FL_IF) {
+        do_softirq();
+    }
 }
 
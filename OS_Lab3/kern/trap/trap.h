@@ -38,6 +38,7 @@
 #define IRQ_IDE1                14
 #define IRQ_IDE2                15
 #define IRQ_ERROR               19
+#define IRQ_IPI                 20
 #define IRQ_SPURIOUS            31
 
 /* *
@@ -83,6 +84,8 @@ struct trapframe {
 } __attribute__((packed));
 
 void idt_init(void);
+void idt_load(void);
+const char *trapname(int trapno);
 void print_trapframe(struct trapframe *tf);
 void print_regs(struct pushregs *regs);
 bool trap_in_kernel(struct trapframe *tf);
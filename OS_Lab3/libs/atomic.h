@@ -7,6 +7,9 @@ static inline void set_bit(int nr, volatile void *addr) __attribute__((always_in
 static inline void clear_bit(int nr, volatile void *addr) __attribute__((always_inline));
 static inline void change_bit(int nr, volatile void *addr) __attribute__((always_inline));
 static inline bool test_bit(int nr, volatile void *addr) __attribute__((always_inline));
+static inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval) __attribute__((always_inline));
+static inline uint32_t cmpxchg(volatile uint32_t *addr, uint32_t old, uint32_t newval) __attribute__((always_inline));
+static inline uint32_t fetch_add(volatile uint32_t *addr, uint32_t val) __attribute__((always_inline));
 
 /* *
  * set_bit - Atomically set a bit in memory
@@ -18,7 +21,7 @@ static inline bool test_bit(int nr, volatile void *addr) __attribute__((always_i
  * */
 static inline void
 set_bit(int nr, volatile void *addr) {
-    asm volatile ("btsl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
+    asm volatile ("lock; btsl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
 }
 
 /* *
@@ -28,7 +31,7 @@ set_bit(int nr, volatile void *addr) {
  * */
 static inline void
 clear_bit(int nr, volatile void *addr) {
-    asm volatile ("btrl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
+    asm volatile ("lock; btrl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
 }
 
 /* *
@@ -38,7 +41,7 @@ clear_bit(int nr, volatile void *addr) {
  * */
 static inline void
 change_bit(int nr, volatile void *addr) {
-    asm volatile ("btcl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
+    asm volatile ("lock; btcl %1, %0" :"=m" (*(volatile long *)addr) : "Ir" (nr));
 }
 
 /* *
@@ -53,5 +56,47 @@ test_bit(int nr, volatile void *addr) {
     return oldbit != 0;
 }
 
+/* *
+ * xchg - Atomically store @newval at @addr and return the old value
+ * @addr:   the word to exchange
+ * @newval: the value to store
+ *
+ * xchg with a memory operand is always locked, and is a full barrier.
+ * */
+static inline uint32_t
+xchg(volatile uint32_t *addr, uint32_t newval) {
+    uint32_t result;
+    asm volatile ("xchgl %0, %1" : "+m" (*addr), "=a" (result) : "1" (newval) : "cc", "memory");
+    return result;
+}
+
+/* *
+ * cmpxchg - Atomically store @newval at @addr if it holds @old
+ * @addr:   the word to update
+ * @old:    the value expected at @addr
+ * @newval: the value to store
+ *
+ * Returns the value found at @addr, the store happened iff it equals @old.
+ * */
+static inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t old, uint32_t newval) {
+    uint32_t prev;
+    asm volatile ("lock; cmpxchgl %2, %1" : "=a" (prev), "+m" (*addr) : "r" (newval), "0" (old) : "cc", "memory");
+    return prev;
+}
+
+/* *
+ * fetch_add - Atomically add @val to the word at @addr
+ * @addr:   the word to add to
+ * @val:    the value to add
+ *
+ * Returns the value at @addr before the addition.
+ * */
+static inline uint32_t
+fetch_add(volatile uint32_t *addr, uint32_t val) {
+    asm volatile ("lock; xaddl %0, %1" : "+r" (val), "+m" (*addr) :: "cc", "memory");
+    return val;
+}
+
 #endif /* !__LIBS_ATOMIC_H__ */
 
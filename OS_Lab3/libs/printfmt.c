@@ -22,33 +22,130 @@ static const char * const error_string[MAXERROR + 1] = {
     [E_NO_MEM]              "out of memory",
     [E_NO_FREE_PROC]        "out of processes",
     [E_FAULT]               "segmentation fault",
+    [E_BUSY]                "resource busy",
 };
 
 /* *
- * printnum - print a number (base <= 16) in reverse order
+ * A putstr callback, if supplied, receives whole runs of output (literal text
+ * between escapes, a formatted number, a string argument, padding) in one
+ * call instead of one putch call per character.
+ * */
+typedef void (*putstr_t)(const char *, size_t, void *);
+
+static const char pad_space[] = "                                ";
+static const char pad_zero[] = "00000000000000000000000000000000";
+
+/* *
+ * putstr - emit @n characters of @str through @putstr, or one by one through @putch
+ * */
+static void
+putstr(void (*putch)(int, void*), putstr_t puts, void *putdat,
+        const char *str, size_t n) {
+    if (puts != NULL) {
+        if (n > 0) {
+            puts(str, n, putdat);
+        }
+        return;
+    }
+    while (n -- > 0) {
+        putch(*str ++, putdat);
+    }
+}
+
+/* *
+ * putpad - emit @n copies of @padc
+ * */
+static void
+putpad(void (*putch)(int, void*), putstr_t puts, void *putdat, int padc, int n) {
+    if (puts == NULL || (padc != ' ' && padc != '0')) {
+        while (n -- > 0) {
+            putch(padc, putdat);
+        }
+        return;
+    }
+    const char *pad = (padc == ' ') ? pad_space : pad_zero;
+    for (; n > 0; n -= sizeof(pad_space) - 1) {
+        puts(pad, (n < sizeof(pad_space) - 1) ? n : sizeof(pad_space) - 1, putdat);
+    }
+}
+
+/* *
+ * div10 - return @n / 10, and the remainder in *@rem
+ *
+ * 0xCCCCCCCD / 2^35 approximates 1/10 closely enough to be exact
+ * for every 32-bit dividend.
+ * */
+static inline uint32_t
+div10(uint32_t n, uint32_t *rem) {
+    uint32_t q = (uint32_t)(((uint64_t)n * 0xCCCCCCCDU) >> 35);
+    *rem = n - q * 10;
+    return q;
+}
+
+/* *
+ * formatnum - convert @num to digits of @base, stored backwards so that the
+ * least significant digit ends right before @end
+ * @end:        points one past the last byte of the buffer
+ * @num:        the number to convert
+ * @base:       base for print, must be in [2, 16]
+ *
+ * Returns the number of digits written. Bases 8 and 16 are shifts and masks,
+ * base 10 multiplies by a reciprocal; only other bases pay for do_div on
+ * every digit.
+ * */
+static int
+formatnum(char *end, unsigned long long num, unsigned base) {
+    static const char digits[] = "0123456789abcdef";
+    char *p = end;
+    if ((base & (base - 1)) == 0) {
+        unsigned shift = (base == 16) ? 4 : (base == 8) ? 3 : (base == 4) ? 2 : 1;
+        do {
+            *-- p = digits[(uint32_t)num & (base - 1)];
+            num >>= shift;
+        } while (num != 0);
+    }
+    else if (base == 10) {
+        uint32_t low, rem;
+        // peel off 9 digits at a time until the rest fits 32 bits
+        while ((num >> 32) != 0) {
+            int i;
+            low = do_div(num, 1000000000);
+            for (i = 0; i < 9; i ++) {
+                low = div10(low, &rem);
+                *-- p = '0' + rem;
+            }
+        }
+        low = (uint32_t)num;
+        do {
+            low = div10(low, &rem);
+            *-- p = '0' + rem;
+        } while (low != 0);
+    }
+    else {
+        do {
+            *-- p = digits[do_div(num, base)];
+        } while (num != 0);
+    }
+    return end - p;
+}
+
+/* *
+ * printnum - print a number (base <= 16)
  * @putch:      specified putch function, print a single character
+ * @puts:       optional bulk version of @putch, may be NULL
  * @putdat:     used by @putch function
  * @num:        the number will be printed
- * @base:       base for print, must be in [1, 16]
+ * @base:       base for print, must be in [2, 16]
  * @width:      maximum number of digits, if the actual width is less than @width, use @padc instead
  * @padc:       character that padded on the left if the actual width is less than @width
  * */
 static void
-printnum(void (*putch)(int, void*), void *putdat,
+printnum(void (*putch)(int, void*), putstr_t puts, void *putdat,
         unsigned long long num, unsigned base, int width, int padc) {
-    unsigned long long result = num;
-    unsigned mod = do_div(result, base);
-
-    // first recursively print all preceding (more significant) digits
-    if (num >= base) {
-        printnum(putch, putdat, result, base, width - 1, padc);
-    } else {
-        // print any needed pad characters before first digit
-        while (-- width > 0)
-            putch(padc, putdat);
-    }
-    // then print this (the least significant) digit
-    putch("0123456789abcdef"[mod], putdat);
+    char buf[64];
+    int n = formatnum(buf + sizeof(buf), num, base);
+    putpad(putch, puts, putdat, padc, width - n);
+    putstr(putch, puts, putdat, buf + sizeof(buf) - n, n);
 }
 
 /* *
@@ -115,17 +212,33 @@ printfmt(void (*putch)(int, void*), void *putdat, const char *fmt, ...) {
  * */
 void
 vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap) {
+    vprintfmt_bulk(putch, NULL, putdat, fmt, ap);
+}
+
+/* *
+ * vprintfmt_bulk - same as vprintfmt, but hands runs of characters to @puts
+ * @putch:      specified putch function, print a single character
+ * @puts:       print @n characters starting at @str in one go, NULL to use @putch only
+ * @putdat:     used by @putch and @puts functions
+ * @fmt:        the format string to use
+ * @ap:         arguments for the format string
+ * */
+void
+vprintfmt_bulk(void (*putch)(int, void*), void (*puts)(const char *, size_t, void*),
+        void *putdat, const char *fmt, va_list ap) {
     register const char *p;
     register int ch, err;
     unsigned long long num;
     int base, width, precision, lflag, altflag;
+    size_t len;
 
     while (1) {
-        while ((ch = *(unsigned char *)fmt ++) != '%') {
-            if (ch == '\0') {
-                return;
-            }
-            putch(ch, putdat);
+        // copy out the literal text up to the next escape in one go
+        for (p = fmt; *fmt != '%' && *fmt != '\0'; fmt ++)
+            /* do nothing */;
+        putstr(putch, puts, putdat, p, fmt - p);
+        if (*fmt ++ == '\0') {
+            return;
         }
 
         // Process a %-escape sequence
@@ -192,10 +305,11 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
                 err = -err;
             }
             if (err > MAXERROR || (p = error_string[err]) == NULL) {
-                printfmt(putch, putdat, "error %d", err);
+                putstr(putch, puts, putdat, "error ", 6);
+                printnum(putch, puts, putdat, err, 10, -1, ' ');
             }
             else {
-                printfmt(putch, putdat, "%s", p);
+                putstr(putch, puts, putdat, p, strlen(p));
             }
             break;
 
@@ -204,21 +318,27 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
             if ((p = va_arg(ap, char *)) == NULL) {
                 p = "(null)";
             }
-            if (width > 0 && padc != '-') {
-                for (width -= strnlen(p, precision); width > 0; width --) {
-                    putch(padc, putdat);
-                }
+            len = strnlen(p, precision);
+            if (padc != '-') {
+                putpad(putch, puts, putdat, padc, width - (int)len);
             }
-            for (; (ch = *p ++) != '\0' && (precision < 0 || -- precision >= 0); width --) {
-                if (altflag && (ch < ' ' || ch > '~')) {
-                    putch('?', putdat);
-                }
-                else {
-                    putch(ch, putdat);
+            if (altflag) {
+                // unprintable characters become '?', the printable runs between go out whole
+                const char *q = p, *end = p + len;
+                for (; q < end; q ++) {
+                    if (*q < ' ' || *q > '~') {
+                        putstr(putch, puts, putdat, p, q - p);
+                        putch('?', putdat);
+                        p = q + 1;
+                    }
                 }
+                putstr(putch, puts, putdat, p, end - p);
+            }
+            else {
+                putstr(putch, puts, putdat, p, len);
             }
-            for (; width > 0; width --) {
-                putch(' ', putdat);
+            if (padc == '-') {
+                putpad(putch, puts, putdat, ' ', width - (int)len);
             }
             break;
 
@@ -246,8 +366,7 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
 
         // pointer
         case 'p':
-            putch('0', putdat);
-            putch('x', putdat);
+            putstr(putch, puts, putdat, "0x", 2);
             num = (unsigned long long)(uintptr_t)va_arg(ap, void *);
             base = 16;
             goto number;
@@ -257,7 +376,7 @@ vprintfmt(void (*putch)(int, void*), void *putdat, const char *fmt, va_list ap)
             num = getuint(&ap, lflag);
             base = 16;
         number:
-            printnum(putch, putdat, num, base, width, padc);
+            printnum(putch, puts, putdat, num, base, width, padc);
             break;
 
         // escaped '%' character
@@ -295,6 +414,23 @@ sprintputch(int ch, struct sprintbuf *b) {
     }
 }
 
+/* *
+ * sprintputstr - 'print' @n characters in a buffer at once
+ * @str:        the characters will be printed
+ * @n:          the number of characters
+ * @b:          the buffer to place the characters
+ * */
+static void
+sprintputstr(const char *str, size_t n, struct sprintbuf *b) {
+    size_t room = b->ebuf - b->buf;
+    b->cnt += n;
+    if (n > room) {
+        n = room;
+    }
+    memcpy(b->buf, str, n);
+    b->buf += n;
+}
+
 /* *
  * snprintf - format a string and place it in a buffer
  * @str:        the buffer to place the result into
@@ -332,7 +468,7 @@ vsnprintf(char *str, size_t size, const char *fmt, va_list ap) {
         return -E_INVAL;
     }
     // print the string to the buffer
-    vprintfmt((void*)sprintputch, &b, fmt, ap);
+    vprintfmt_bulk((void*)sprintputch, (void*)sprintputstr, &b, fmt, ap);
     // null terminate the buffer
     *b.buf = '\0';
     return b.cnt;
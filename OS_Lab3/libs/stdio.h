@@ -17,6 +17,8 @@ char *readline(const char *prompt);
 /* libs/printfmt.c */
 void printfmt(void (*putch)(int, void *), void *putdat, const char *fmt, ...);
 void vprintfmt(void (*putch)(int, void *), void *putdat, const char *fmt, va_list ap);
+void vprintfmt_bulk(void (*putch)(int, void *), void (*puts)(const char *, size_t, void *),
+                    void *putdat, const char *fmt, va_list ap);
 int snprintf(char *str, size_t size, const char *fmt, ...);
 int vsnprintf(char *str, size_t size, const char *fmt, va_list ap);
 
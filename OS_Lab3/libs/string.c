@@ -1,6 +1,22 @@
 #include <string.h>
 #include <x86.h>
 
+/* *
+ * Word-at-a-time (SWAR) helpers.
+ *
+ * The string scanners below look at four bytes per iteration. HASZERO(w)
+ * is non-zero iff some byte of @w is zero, and the lowest set 0x80 bit
+ * marks the first such byte (higher bits can be false positives, so the
+ * exact position is always found again with a byte loop). Words are only
+ * loaded from word-aligned addresses: an aligned word never straddles a
+ * page, so reading the bytes after the terminator can't fault.
+ * */
+#define WORD_SIZE               sizeof(uint32_t)
+#define WORD_MASK               (WORD_SIZE - 1)
+#define ONES                    0x01010101U
+#define HIGHS                   0x80808080U
+#define HASZERO(w)              (((w) - ONES) & ~(w) & HIGHS)
+
 /* *
  * strlen - calculate the length of the string @s, not including
  * the terminating '\0' character.
@@ -10,11 +26,22 @@
  * */
 size_t
 strlen(const char *s) {
-    size_t cnt = 0;
-    while (*s ++ != '\0') {
-        cnt ++;
+    const char *p = s;
+    while (((uintptr_t)p & WORD_MASK) != 0) {
+        if (*p == '\0') {
+            return p - s;
+        }
+        p ++;
     }
-    return cnt;
+    const uint32_t *w = (const uint32_t *)p;
+    while (!HASZERO(*w)) {
+        w ++;
+    }
+    p = (const char *)w;
+    while (*p != '\0') {
+        p ++;
+    }
+    return p - s;
 }
 
 /* *
@@ -33,7 +60,16 @@ strlen(const char *s) {
 size_t
 strnlen(const char *s, size_t len) {
     size_t cnt = 0;
-    while (cnt < len && *s ++ != '\0') {
+    while (cnt < len && ((uintptr_t)(s + cnt) & WORD_MASK) != 0) {
+        if (s[cnt] == '\0') {
+            return cnt;
+        }
+        cnt ++;
+    }
+    while (len - cnt >= WORD_SIZE && !HASZERO(*(const uint32_t *)(s + cnt))) {
+        cnt += WORD_SIZE;
+    }
+    while (cnt < len && s[cnt] != '\0') {
         cnt ++;
     }
     return cnt;
@@ -141,6 +177,22 @@ strncmp(const char *s1, const char *s2, size_t n) {
  * */
 char *
 strchr(const char *s, char c) {
+    while (((uintptr_t)s & WORD_MASK) != 0) {
+        if (*s == '\0') {
+            return NULL;
+        }
+        if (*s == c) {
+            return (char *)s;
+        }
+        s ++;
+    }
+    // stop at the first word holding either the terminator or @c
+    uint32_t cmask = (uint8_t)c * ONES;
+    const uint32_t *w = (const uint32_t *)s;
+    while (!HASZERO(*w) && !HASZERO(*w ^ cmask)) {
+        w ++;
+    }
+    s = (const char *)w;
     while (*s != '\0') {
         if (*s == c) {
             return (char *)s;
@@ -356,6 +408,25 @@ int
 memcmp(const void *v1, const void *v2, size_t n) {
     const char *s1 = (const char *)v1;
     const char *s2 = (const char *)v2;
+    // align @s1, then skip equal words (16 bytes per step while possible);
+    // only bytes inside [v, v + n) are ever read, so @s2 may be unaligned
+    while (n > 0 && ((uintptr_t)s1 & WORD_MASK) != 0) {
+        if (*s1 != *s2) {
+            return (int)((unsigned char)*s1 - (unsigned char)*s2);
+        }
+        s1 ++, s2 ++, n --;
+    }
+    const uint32_t *w1 = (const uint32_t *)s1, *w2 = (const uint32_t *)s2;
+    while (n >= 4 * WORD_SIZE) {
+        if (((w1[0] ^ w2[0]) | (w1[1] ^ w2[1]) | (w1[2] ^ w2[2]) | (w1[3] ^ w2[3])) != 0) {
+            break;
+        }
+        w1 += 4, w2 += 4, n -= 4 * WORD_SIZE;
+    }
+    while (n >= WORD_SIZE && *w1 == *w2) {
+        w1 ++, w2 ++, n -= WORD_SIZE;
+    }
+    s1 = (const char *)w1, s2 = (const char *)w2;
     while (n -- > 0) {
         if (*s1 != *s2) {
             return (int)((unsigned char)*s1 - (unsigned char)*s2);
@@ -20,6 +20,29 @@
 
 #define barrier() __asm__ __volatile__ ("" ::: "memory")
 
+/* *
+ * mul_u64_u32_shr - compute (@a * @mul) >> @shift without losing the high
+ * bits of the 96-bit product and without a 64-bit division, @shift <= 32
+ * */
+static inline uint64_t
+mul_u64_u32_shr(uint64_t a, uint32_t mul, unsigned int shift) {
+    uint32_t ah = (uint32_t)(a >> 32), al = (uint32_t)a;
+    uint64_t ret = ((uint64_t)al * mul) >> shift;
+    if (ah != 0) {
+        ret += ((uint64_t)ah * mul) << (32 - shift);
+    }
+    return ret;
+}
+
+/* cpuid leaf 1 feature flags returned in %edx */
+#define CPUID_FEAT_FPU          0x00000001  // on-chip x87 FPU
+#define CPUID_FEAT_TSC          0x00000010  // time-stamp counter
+#define CPUID_FEAT_MSR          0x00000020  // rdmsr/wrmsr
+#define CPUID_FEAT_APIC         0x00000200  // on-chip local APIC
+#define CPUID_FEAT_FXSR         0x01000000  // fxsave/fxrstor
+#define CPUID_FEAT_SSE          0x02000000  // SSE extensions
+#define CPUID_FEAT_SSE2         0x04000000  // SSE2 extensions
+
 static inline uint8_t inb(uint16_t port) __attribute__((always_inline));
 static inline void insl(uint32_t port, void *addr, int cnt) __attribute__((always_inline));
 static inline void outb(uint16_t port, uint8_t data) __attribute__((always_inline));
@@ -49,6 +72,16 @@ static inline uintptr_t rcr1(void) __attribute__((always_inline));
 static inline uintptr_t rcr2(void) __attribute__((always_inline));
 static inline uintptr_t rcr3(void) __attribute__((always_inline));
 static inline void invlpg(void *addr) __attribute__((always_inline));
+static inline void lcr4(uintptr_t cr4) __attribute__((always_inline));
+static inline uintptr_t rcr4(void) __attribute__((always_inline));
+static inline void clts(void) __attribute__((always_inline));
+static inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp) __attribute__((always_inline));
+static inline uint64_t rdtsc(void) __attribute__((always_inline));
+static inline uint64_t rdmsr(uint32_t msr) __attribute__((always_inline));
+static inline void wrmsr(uint32_t msr, uint64_t val) __attribute__((always_inline));
+static inline void fxsave(void *area) __attribute__((always_inline));
+static inline void fxrstor(const void *area) __attribute__((always_inline));
+static inline void pause(void) __attribute__((always_inline));
 
 static inline uint8_t
 inb(uint16_t port) {
@@ -200,6 +233,78 @@ invlpg(void *addr) {
     asm volatile ("invlpg (%0)" :: "r" (addr) : "memory");
 }
 
+static inline void
+lcr4(uintptr_t cr4) {
+    asm volatile ("mov %0, %%cr4" :: "r" (cr4) : "memory");
+}
+
+static inline uintptr_t
+rcr4(void) {
+    uintptr_t cr4;
+    asm volatile ("mov %%cr4, %0" : "=r" (cr4) :: "memory");
+    return cr4;
+}
+
+/* clts - clear the task-switched flag in cr0, so x87/SSE instructions don't trap */
+static inline void
+clts(void) {
+    asm volatile ("clts" ::: "memory");
+}
+
+/* *
+ * cpuid - execute the cpuid instruction for leaf @info and store the
+ * resulting registers into the non-NULL output pointers.
+ * */
+static inline void
+cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp) {
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile ("cpuid"
+                  : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                  : "a" (info), "c" (0));
+    if (eaxp) *eaxp = eax;
+    if (ebxp) *ebxp = ebx;
+    if (ecxp) *ecxp = ecx;
+    if (edxp) *edxp = edx;
+}
+
+/* rdtsc - read the 64-bit time-stamp counter */
+static inline uint64_t
+rdtsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+/* rdmsr/wrmsr - read/write a model specific register */
+static inline uint64_t
+rdmsr(uint32_t msr) {
+    uint64_t val;
+    asm volatile ("rdmsr" : "=A" (val) : "c" (msr));
+    return val;
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr" :: "c" (msr), "A" (val));
+}
+
+/* fxsave/fxrstor - save/restore x87 and SSE state, @area must be 16-byte aligned and 512 bytes long */
+static inline void
+fxsave(void *area) {
+    asm volatile ("fxsave (%0)" :: "r" (area) : "memory");
+}
+
+static inline void
+fxrstor(const void *area) {
+    asm volatile ("fxrstor (%0)" :: "r" (area) : "memory");
+}
+
+/* pause - spin-wait hint */
+static inline void
+pause(void) {
+    asm volatile ("pause" ::: "memory");
+}
+
 static inline int __strcmp(const char *s1, const char *s2) __attribute__((always_inline));
 static inline char *__strcpy(char *dst, const char *src) __attribute__((always_inline));
 static inline void *__memset(void *s, char c, size_t n) __attribute__((always_inline));
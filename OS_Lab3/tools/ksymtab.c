@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <elf.h>
+
+/* *
+ * ksymtab - build the function table that debuginfo_eip() in
+ * kern/debug/kdebug.c searches before falling back to the raw stabs.
+ *
+ * It reads the .stab and .stabstr sections of a linked kernel and writes a
+ * flat binary file: a header followed by one entry per function, sorted by
+ * start address. The Makefile turns that file into the .ksymtab section of
+ * the final kernel. Only text addresses, stab indices and string offsets
+ * are stored; none of them move when .ksymtab is linked in after .stabstr.
+ * */
+
+#define N_FUN       0x24
+#define N_SO        0x64
+
+#define KSYMTAB_MAGIC   0x4d59534b      // "KSYM"
+
+/* keep in sync with kern/debug/stab.h */
+struct stab {
+    uint32_t n_strx;
+    uint8_t n_type;
+    uint8_t n_other;
+    uint16_t n_desc;
+    uint32_t n_value;
+};
+
+/* keep in sync with kern/debug/kdebug.c */
+struct ksymtab_header {
+    uint32_t magic;
+    uint32_t nsyms;
+    uint32_t nstabs;                    // # of stabs the table was built from
+};
+
+struct ksym {
+    uint32_t addr;                      // first address of the function
+    uint32_t size;                      // size of the function in bytes
+    uint32_t name;                      // offset of the name in .stabstr
+    uint16_t namelen;                   // length of the name, up to the ':'
+    uint16_t narg;                      // number of N_PSYM stabs after the N_FUN
+    uint32_t stab_file;                 // index of the N_SO stab of the source file
+    uint32_t stab_fun;                  // index of the N_FUN stab
+    uint32_t stab_last;                 // index of the last stab of the function
+};
+
+static void *
+read_file(const char *name, size_t *size) {
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening file '%s': %s\n", name, strerror(errno));
+        exit(-1);
+    }
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    void *buf = malloc(*size);
+    if (buf == NULL || fread(buf, 1, *size, fp) != *size) {
+        fprintf(stderr, "read '%s' error\n", name);
+        exit(-1);
+    }
+    fclose(fp);
+    return buf;
+}
+
+static const Elf32_Shdr *
+find_section(const uint8_t *elf, size_t size, const char *name) {
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf;
+    const Elf32_Shdr *sh = (const Elf32_Shdr *)(elf + eh->e_shoff);
+    const char *shstr = (const char *)elf + sh[eh->e_shstrndx].sh_offset;
+    int i;
+    for (i = 0; i < eh->e_shnum; i ++) {
+        if (strcmp(shstr + sh[i].sh_name, name) == 0 && sh[i].sh_offset + sh[i].sh_size <= size) {
+            return sh + i;
+        }
+    }
+    fprintf(stderr, "section '%s' not found\n", name);
+    exit(-1);
+}
+
+static int
+ksym_cmp(const void *a, const void *b) {
+    uint32_t x = ((const struct ksym *)a)->addr, y = ((const struct ksym *)b)->addr;
+    return (x > y) - (x < y);
+}
+
+int
+main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: <kernel elf> <output filename>\n");
+        return -1;
+    }
+    size_t size;
+    uint8_t *elf = read_file(argv[1], &size);
+    if (size < sizeof(Elf32_Ehdr) || memcmp(elf, ELFMAG, SELFMAG) != 0 || elf[EI_CLASS] != ELFCLASS32) {
+        fprintf(stderr, "'%s' is not an elf32 file\n", argv[1]);
+        return -1;
+    }
+    const Elf32_Shdr *stab_sh = find_section(elf, size, ".stab");
+    const Elf32_Shdr *stabstr_sh = find_section(elf, size, ".stabstr");
+    const struct stab *stabs = (const struct stab *)(elf + stab_sh->sh_offset);
+    const char *stabstr = (const char *)elf + stabstr_sh->sh_offset;
+    // the kernel sees __STAB_END__ before the BYTE(0) padding of the section
+    uint32_t nstabs = stab_sh->sh_size / sizeof(struct stab);
+
+    struct ksym *syms = calloc(nstabs + 1, sizeof(struct ksym));
+    uint32_t nsyms = 0, i, j, file = 0;
+    for (i = 0; i < nstabs; i ++) {
+        if (stabs[i].n_type == N_SO && stabs[i].n_value != 0) {
+            file = i;
+        }
+        // an N_FUN with an empty name marks the end of the previous function
+        if (stabs[i].n_type != N_FUN || stabs[i].n_strx >= stabstr_sh->sh_size
+                || stabstr[stabs[i].n_strx] == '\0') {
+            continue;
+        }
+        struct ksym *s = syms + nsyms ++;
+        const char *name = stabstr + stabs[i].n_strx, *colon = strchr(name, ':');
+        s->addr = stabs[i].n_value;
+        s->name = stabs[i].n_strx;
+        s->namelen = (colon != NULL) ? colon - name : strlen(name);
+        s->stab_file = file;
+        s->stab_fun = i;
+        for (j = i + 1; j < nstabs && stabs[j].n_type != N_FUN && stabs[j].n_type != N_SO; j ++) {
+            if (j == i + 1 + s->narg && stabs[j].n_type == 0xa0 /* N_PSYM */) {
+                s->narg ++;
+            }
+        }
+        s->stab_last = j - 1;
+        if (j < nstabs && stabs[j].n_type == N_FUN && stabstr[stabs[j].n_strx] == '\0') {
+            s->size = stabs[j].n_value;
+            s->stab_last = j;
+        }
+    }
+    qsort(syms, nsyms, sizeof(struct ksym), ksym_cmp);
+    // functions without an end marker extend up to the next one
+    for (i = 0; i < nsyms; i ++) {
+        if (syms[i].size == 0 && i + 1 < nsyms) {
+            syms[i].size = syms[i + 1].addr - syms[i].addr;
+        }
+    }
+
+    struct ksymtab_header hdr = {KSYMTAB_MAGIC, nsyms, nstabs};
+    FILE *ofp = fopen(argv[2], "wb+");
+    if (ofp == NULL || fwrite(&hdr, sizeof(hdr), 1, ofp) != 1
+            || fwrite(syms, sizeof(struct ksym), nsyms, ofp) != nsyms) {
+        fprintf(stderr, "write '%s' error\n", argv[2]);
+        return -1;
+    }
+    fclose(ofp);
+    return 0;
+}
+